@@ -17,6 +17,46 @@
 
 #include "application.h"
 #include "globals.h"
+#include <atomic>
+
+// PSoC bus traffic and health counters, minute counters roll over every ONE_MINUTE
+struct I2CBusStats {
+    unsigned long transactions, bytes, nacks, timeouts, retries, failures;
+    unsigned long minuteTransactions, minuteBytes, lastMinuteTransactions, lastMinuteBytes, minuteMarker;
+};
+
+// One step of a lamp program: ramp to the target, stay there for hold, then optionally wait for a time of day
+struct LampSegment {
+    uint16_t cct;           // target CCT, SEG_CCT_KEEP, SEG_CCT_MAX or SEG_CCT_MAX_LESS_ONE
+    uint8_t level;          // target brightness
+    uint8_t flags;          // SEG_* flags
+    uint32_t duration;      // ramp time in ms, or per mille of the program duration
+    uint32_t hold;          // time at the target in ms, or per mille of the program duration
+    uint16_t waitUntil;     // local minute of day, SEG_WAIT_UNTIL only
+};
+
+// One alarm, sorted by minuteOfDay in the alarm table
+struct AlarmRecord {
+    uint8_t type;           // ALARM_TYPE_*, plus ALARM_ENABLED when armed
+    uint8_t dayMask;        // bit 0 = Sunday (weekday 1) ... bit 6 = Saturday
+    uint16_t minuteOfDay;   // local time
+    uint8_t duration;       // minutes
+    uint8_t program;        // ALARM_PROGRAM_*
+};
+
+class ArioCtrl;
+typedef void (ArioCtrl::*RampDoneCallback)(void);
+
+// One ramp timeline. CCT and level each run their own, both are evaluated in the same tick.
+struct RampChannel {
+    bool active;
+    int curve;                      // RAMP_CURVE_*, a perceptual level ramp holds Q16 lightness in start and delta
+    float start, delta, dest;
+    float slope;                    // RAMP_CURVE_HERMITE start velocity times duration, RAMP_CURVE_LINEAR delta per ms
+    unsigned long startTime, duration;
+    uint32_t progressRecip;         // Q16 progress per ms, scaled by 2^16
+    RampDoneCallback done;          // called once the channel lands on dest, NULL if none
+};
 
 class ArioCtrl
 {
@@ -33,6 +73,8 @@ class ArioCtrl
 
         void Ario_Init(void);
         void Set_TimeZone(void);
+        float Zone_Standard(void);
+        float Local_Offset(void);
         void Load_RTC_Schedule(void);
         void Load_Max_CCT(void);
         void Turn_Lamp_On(byte interactionType);
@@ -41,6 +83,7 @@ class ArioCtrl
         ///////// button functions //////////
         void TopButton_Action(void);
         void MidButton_Action(void);
+        void Button_Release(void);
 
         void decode_cmd(int cmd);
         void Increase_Brightness_App(void);
@@ -51,76 +94,208 @@ class ArioCtrl
         void Set_CCT(unsigned int cct);
 
         void Demo_Init(void);
+        bool Program_Init(void);
+        bool Program_Upload_Segment(unsigned int index, const char* hex);
+        void Program_Set_Length(unsigned int length);
         void Scheduler(void);
+        uint8_t Ramp_State(void);
+        void Resume_Save(void);
+        void Resume_Invalidate(bool untilReboot = FALSE);
+
+        ////////// boot profile //////////
+        volatile unsigned long bootProfile[BOOT_PHASE_COUNT]; // FIRST_LIGHT is set by the output thread
+        void Boot_Mark(int phase);
+        void Boot_Report(char* buffer, size_t size);
+
+        ////////// benchmark //////////
+        void Benchmark_Run(void);
+        void Benchmark_Save_Baseline(void);
+        void Benchmark_Report(char* buffer, size_t size, bool compare);
 
         ///////// Alarm Functions //////////
-        void Set_Wake_Alarm(String str);
-        void Set_Bedtime_Reminder(String str);
-        void Configure_Sensor_PIR(String str);
-        void Configure_Sensor_ALS(String str);
+        bool Set_Wake_Alarm(const char* str);
+        bool Set_Bedtime_Reminder(const char* str);
+        void Configure_Sensor_PIR(const char* str);
+        void Configure_Sensor_ALS(const char* str);
+        bool Command_Batch_Apply(const byte* frame, unsigned int length);
+        bool Alarm_Set(uint8_t type, uint8_t dayMask, uint16_t minuteOfDay, uint8_t duration, uint8_t program, bool replace);
+        bool Alarm_Set_Days(uint8_t type, uint8_t dayMask, bool enable);
+        bool Alarm_Lookup(uint8_t type, int weekday, AlarmRecord* out);
+        void Alarm_Table_Clear(void);
+        bool Command_Batch_Hex(const char* hex);
 
         ///////// Sensors Functions //////////
+#if SENSOR_PIR_AVAILABLE
         void PIR_Routine(void);
+        void Occupancy_Report(char* buffer, size_t size);
+#endif
+#if SENSOR_ALS_AVAILABLE
         void ALS_Routine(void);
+#endif
 
         ///////// cloud comm ///////////////
         void Cloud_Print_Schedule(void);
-        void Cloud_Debug_Print(String str);
-        void Cloud_Debug_Print(String msgType, String payload);
-        void Report_to_Cloud(String msgType, String payload);
+        void Cloud_Print_Perf(void);
+        void Cloud_Debug_Print(const char* str);
+        void Cloud_Debug_Print(const char* msgType, const char* payload);
+        void Report_to_Cloud(const char* msgType, const char* payload);
+
+        ////////// I2C trace & stats //////////
+        I2CBusStats busStats; // written by the output thread only, read through Cloud_Print_Perf()
+        void I2C_Trace_Start(void);
+        void I2C_Trace_Stop(void);
+        void I2C_Trace_Dump(void);
 
         ////////// LED Diagnostic //////////////
         void PSoC_onOff(byte onOff);
         void PSoC_LEDVal(byte val0, byte val1, byte val2, byte val3);
 
     private:
-        bool pirEnabled, cloudReportFlag, pirDebounceFlag, alsMeasureFlag, AMalarmFlag, PMalarmFlag, amAlarmNow, pmAlarmNow;
+        bool ditherActive, pirEnabled, cloudReportFlag, amAlarmNow, pmAlarmNow;
+        int holdDirection, holdAxis;
+        unsigned int programCounter;
+        // trace capture state, owned by the output thread. I2C_Trace_Start/Stop only post a request to it.
+        bool i2cTraceEnabled;
+        volatile unsigned int i2cTraceLength;
+        std::atomic<bool> i2cResendPending; // set by either thread after i2cFailMarker, taken by the application thread
+        volatile unsigned int i2cWrittenMask;
+        volatile unsigned long i2cFailMarker;
+        unsigned long marker, ditherMarker, ditherSettleMarker, i2cTraceMarker, holdStartTime, pirOffTimer, pirHoldTimeMarker;
+#if SENSOR_PIR_AVAILABLE
+        bool pirDebounceFlag;
+        unsigned long pirDebounceTimer, pirReportTimer;
+
+        // Occupancy history of the last week and the slot being observed now
+        uint8_t occupancyMap[OCCUPANCY_BYTES];
+        int occupancySlot, prewarmSlot;
+        bool occupancySeen, prewarmActive;
+        unsigned long prewarmMarker;
+        void Occupancy_Load(void);
+        void Occupancy_Tick(void);
+        bool Occupancy_Bit(int slot);
+#endif
+#if SENSOR_ALS_AVAILABLE
+        bool alsMeasureFlag;
         int alsMeasuredLevel;
-        unsigned int programCounter, rampRegCounter, rampRegEndCounter, alsRunningSum, alsMeasureCount;
-        unsigned long marker, pirDebounceTimer, pirOffTimer, pirHoldTimeMarker, pirReportTimer, alsMeasureTimer, alsSampleTimer, alsReportTimer, dawnSimDuration, bedTimeDuration;
+        unsigned int alsRunningSum, alsMeasureCount;
+        unsigned long alsMeasureTimer, alsSampleTimer, alsReportTimer;
+#endif
+
+        // Ramp Mode Register
+        RampChannel rampCCT, rampLevel;
+        unsigned long rampFrameMarker; // millis() of the last ramp frame, app commands move marker and must not hold a frame back
+
+        // Lighting layers. The base (time of day schedule plus ALS offset) is what the lamp returns to. A user adjustment
+        // (MODE_ADJUST) and a running program (demo, dawn simulation, bedtime, uploaded) sit on top and own the output while active.
+        float layerScheduleCCT, layerScheduleLevel, layerAlsOffset;
+        bool layerAlsValid, layersDirty;
+        unsigned long layerScheduleStamp;
+        float baseCCT, baseLevel; // composed base, recomputed only when a layer changed
 
-        // Linear Ramp Mode Register
-        float rampRegCCTStep, rampRegLevelStep, alsAdjustedLevel;
-        //unsigned int rampRegCounter, rampRegEndCounter;
+        // App adjustments received since the last Scheduler pass, -1 if none. Only the latest target is driven.
+        float pendingCCT, pendingLevel;
+        unsigned long pendingCCTDuration;
+
+        // Clock snapshot, sampled once per Scheduler pass (the only place lamp logic reads the RTC)
+        unsigned long clockNow, clockDayNumber;
+        int clockHour, clockMinute, clockSecond, clockWeekday;
+
+        // Time zone, decoded once by Set_TimeZone. The DST state holds from dstWindowStart for dstWindowLength seconds (UTC).
+        float zoneStandard;
+        uint8_t dstRule;
+        bool dstActive;
+        unsigned long dstWindowStart, dstWindowLength;
+
+        // Hold Adjust Register
+        float holdStartPos;
 
         void Load_Current_Version(void);
+        bool Resume_Restore(void);
+        unsigned long resumeSaveMarker;
+        bool resumeDisabled;
+        bool bootTracked;
+        void Boot_Track(void);
+        uint32_t benchResult[BENCH_COUNT];
+        uint64_t benchSchedulerCycles[BENCH_MODE_COUNT];
+        uint32_t benchSchedulerPasses[BENCH_MODE_COUNT];
+        bool benchMuted; // PSoC_Queue_Write drops frames while a kernel runs on the real output path
 
         void PSoC_Init(void);
-        //bool IsDST(int dayOfMonth, int month, int dayOfWeek);
-        void Increase_Level(void);
-        void Decrease_Level(void);
+        void DST_Window_Update(unsigned long utc);
+        void Time_Zone_Apply(void);
+        void Hold_Adjust(int direction);
 
-        void RampTo_Linear_Setup(float destCCT, float destLevel, unsigned long duration, int toMode);
-        bool RampTo_Linear_Playing(void);
+        void RampTo_Setup(float destCCT, float destLevel, unsigned long duration, int toMode, int curve = RAMP_CURVE_LINEAR);
+        void RampTo_CCT(float destCCT, unsigned long duration, int curve = RAMP_CURVE_LINEAR, RampDoneCallback done = NULL);
+        void RampTo_Level(float destLevel, unsigned long duration, int curve = RAMP_CURVE_LINEAR, RampDoneCallback done = NULL);
+        bool RampTo_Playing(void);
+        void Ramp_Tick(void);
+        void Ramp_Mode_Done(void);
+        void ALS_Configure(uint8_t enable, uint8_t sensitivity);
+        void Setting_Write(int addr, uint8_t value);
+        void Layer_Schedule_Update(void);
+        bool Compose_Base(void);
+        void RampTo_Base(unsigned long duration, int curve = RAMP_CURVE_LINEAR);
+        float CCT_Target(void);
+        float Level_Target(void);
+        void App_Adjust_Apply(void);
 
-        bool Demo_Playing(void);
-        void DawnSim_Init(void);
-        bool DawnSim_Playing(void);
-        void BedTime_Init(void);
-        bool BedTime_Playing(void);
+        void DawnSim_Init(unsigned int duration, uint8_t program);
+        void BedTime_Init(unsigned int duration, uint8_t program);
+        void BedTime_End(void);
+
+        // Lamp Program Interpreter
+        const LampSegment* programTable;
+        unsigned int programLength, programPhase;
+        unsigned long programMarker, programDuration;
+        void Program_Start(const LampSegment* table, unsigned int length, unsigned long duration);
+        bool Program_Load(void);
+        bool Program_Playing(void);
+        unsigned long Segment_Time(uint32_t value, bool scaled);
 
         ////////// time functions //////////
+        void Clock_Sample(void);
         float ValExtractor_LUT24(uint16_t* dataArray);
         void ColorDens_Calc(float cctTarget);
         void Load_RTC_Val(void); // loads and sends calculated RTC LED values to PSoC
         void PSoC_Load_LEDVal(float cctVal, float brightnessVal);
+        void Gamma_LUT_Init(void);
+        void PSoC_Dither_Tick(void);
 
         ///////// Scheduler Sub Routines //////
-        void Check_Wake_Alarm(void);
-        void Check_Bedtime_Reminder(void);
+        void Check_Alarms(void);
+        void Alarm_Fire(const AlarmRecord* alarm);
+        void Alarm_Seek(int minuteOfDay);
+        void Alarm_Table_Load(void);
+        void Alarm_Table_Store(void);
+        void Alarm_Table_Compact(void);
+        bool Alarm_Command(uint8_t type, const char* str);
+
         void Check_PIR_Schedule(void);
         void Daily_Subroutine(void);
 
+        // Alarm table, kept sorted by time. alarmCursor is the next alarm at or after alarmLastMinute.
+        AlarmRecord alarmTable[ALARM_TABLE_SIZE];
+        uint8_t alarmCount, alarmCursor;
+        int alarmLastMinute;
+        bool alarmStoreHeld;    // a batch frame stores the table once, after all of its alarm commands went in
+
         ///////// comm functions ///////////
         void EzI2Cs_Init(void);
-        void EzI2Cs_Write(byte slaveAddr, byte subAddrValue, byte* dataArray, byte length);
+        bool EzI2Cs_Write(byte slaveAddr, byte subAddrValue, byte* dataArray, byte length);
         void EzI2Cs_Read(byte slaveAddr, byte subAddrValue, byte* dataArray, byte length);
+        void I2C_Record(byte subAddrValue, byte* dataArray, byte length);
+        bool PSoC_Queue_Write(byte subAddr, byte* dataArray, byte length);
+        void Output_Thread_Start(void);
+        static void Output_Thread_Entry(void* param);
+        static void I2C_Stats_Roll(I2CBusStats* stats, unsigned long now);
+        void PSoC_Resend_Frame(void);
         void PSoC_WriteSingle(byte subAddr, byte data);
         void PSoC_changeLevel(byte level);
 
         ///////// serial debugging ///////////
         void UART_Init(void);
-        void debugPrint(String debugMsg);
+        void debugPrint(const char* debugMsg);
 
 };
 
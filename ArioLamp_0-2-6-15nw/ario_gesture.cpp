@@ -0,0 +1,116 @@
+/************************************************************************************************************************************/
+/** @file       ario_gesture.cpp
+ *  @brief      table driven button gesture recognizer (click, multi-click, long click, chorded and timed holds)
+ *  @details    replaces ClickButton for the mode button. A multi-click is committed as soon as no enabled row of the
+ *              table can still be matched by further presses, so gestures without a longer alternative do not have
+ *              to wait for GESTURE_CLICK_GAP. The latency of every gesture is kept per row for the LATENCY,GESTURE report.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "ario_gesture.h"
+
+GestureEngine::GestureEngine(int pin, const GestureDef* table, uint8_t tableSize){
+    this->pin       = pin;
+    this->table     = table;
+    this->tableSize = (tableSize < GESTURE_MAX_ROWS) ? tableSize : GESTURE_MAX_ROWS;
+    pressCount      = 0;
+    rawState        = FALSE;
+    pressed         = FALSE;
+    longDone        = FALSE;
+    holdDone        = FALSE;
+    bounceTime      = 0;
+    edgeTime        = 0;
+    lastLatency     = 0;
+    lastRow         = -1;
+    for(uint8_t i = 0; i < GESTURE_MAX_ROWS; i++) rowLatency[i] = GESTURE_LATENCY_NONE;
+}
+
+void GestureEngine::Update(void){
+    unsigned long now = millis();
+    bool reading = (digitalRead(pin) == HIGH);
+    if(reading != rawState){
+        rawState = reading;
+        bounceTime = now;
+    }
+    if((now - bounceTime >= GESTURE_DEBOUNCE_TIME) && (rawState != pressed)){ // debounced edge
+        pressed = rawState;
+        edgeTime = now;
+        if(pressed){
+            if(pressCount < 0xFF) pressCount++;
+            longDone = FALSE;
+            holdDone = FALSE;
+        } else if(longDone){ // release after a long click ends the sequence
+            pressCount = 0;
+        } else if(!Can_Extend()){ // nothing longer can match, no need to wait for another click
+            Commit(GESTURE_CLICK, edgeTime);
+        }
+    }
+
+    if(pressed){
+        if(!longDone && (now - edgeTime >= GESTURE_LONG_TIME)){
+            longDone = TRUE;
+            Commit(GESTURE_LONG, edgeTime + GESTURE_LONG_TIME);
+        }
+        if(!holdDone){
+            for(uint8_t i = 0; i < tableSize; i++){
+                const GestureDef* row = &table[i];
+                if((GESTURE_HOLD == row->type) && (now - edgeTime >= row->holdTime) && Row_Enabled(row)){
+                    holdDone = TRUE;
+                    Fire(i, now - edgeTime - row->holdTime);
+                    break;
+                }
+            }
+        }
+    } else if((0 != pressCount) && (now - edgeTime >= GESTURE_CLICK_GAP)){
+        Commit(GESTURE_CLICK, edgeTime);
+    }
+}
+
+bool GestureEngine::Row_Enabled(const GestureDef* row){
+    if((GESTURE_NO_CHORD != row->chordPin) && !digitalRead(row->chordPin)) return FALSE;
+    return (NULL == row->guard) || row->guard();
+}
+
+// true if another press could still complete an enabled gesture
+bool GestureEngine::Can_Extend(void){
+    for(uint8_t i = 0; i < tableSize; i++){
+        const GestureDef* row = &table[i];
+        if((GESTURE_HOLD != row->type) && (row->count > pressCount) && Row_Enabled(row)){
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void GestureEngine::Commit(uint8_t type, unsigned long decidedAt){
+    uint8_t count = pressCount;
+    pressCount = 0;
+    for(uint8_t i = 0; i < tableSize; i++){
+        const GestureDef* row = &table[i];
+        if((type == row->type) && (count == row->count) && Row_Enabled(row)){
+            Fire(i, millis() - decidedAt);
+            return;
+        }
+    }
+}
+
+// latency is taken before the action, which may block
+void GestureEngine::Fire(uint8_t row, unsigned long latency){
+    lastLatency = latency;
+    lastRow = row;
+    rowLatency[row] = latency;
+    table[row].action();
+}
+
+// "last row,ms;row:ms,row:ms,..." for every row that fired this boot
+void GestureEngine::Report(char* buffer, size_t size){
+    int length = snprintf(buffer, size, "%d,%lu;", lastRow, (lastRow < 0) ? 0UL : lastLatency);
+    for(uint8_t i = 0; i < tableSize; i++){
+        if((GESTURE_LATENCY_NONE == rowLatency[i]) || (length >= (int)size)) continue;
+        length += snprintf(buffer + length, size - length, "%s%u:%lu", (';' == buffer[length - 1]) ? "" : ",", i, rowLatency[i]);
+    }
+}
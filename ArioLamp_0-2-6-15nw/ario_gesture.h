@@ -0,0 +1,67 @@
+/************************************************************************************************************************************/
+/** @file       ario_gesture.h
+ *  @brief      see ario_gesture.cpp for description
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef ario_gesture_h
+#define ario_gesture_h
+
+#include "application.h"
+
+#define GESTURE_DEBOUNCE_TIME   20UL   // same as ClickButton default
+#define GESTURE_CLICK_GAP       250UL  // max release time between clicks of a multi-click
+#define GESTURE_LONG_TIME       1000UL // press held this long becomes a long click
+
+#define GESTURE_CLICK           0 // <count> short presses, committed after release
+#define GESTURE_LONG            1 // <count - 1> short presses followed by a press held past GESTURE_LONG_TIME
+#define GESTURE_HOLD            2 // one continuous press held past holdTime, fires once per press regardless of other gestures
+
+#define GESTURE_NO_CHORD        (-1)
+#define GESTURE_MAX_ROWS        16     // rows past this are ignored
+#define GESTURE_LATENCY_NONE    0xFFFFFFFFUL // row has not fired this boot
+
+typedef bool (*GestureGuard)(void);
+typedef void (*GestureAction)(void);
+
+// One row of a gesture table. Rows are matched in table order, so chorded rows go in front of their plain variant.
+struct GestureDef {
+    uint8_t type;               // GESTURE_CLICK, GESTURE_LONG or GESTURE_HOLD
+    uint8_t count;              // number of presses including the final one
+    int chordPin;               // button that has to be held when the gesture commits, GESTURE_NO_CHORD if none
+    unsigned long holdTime;     // GESTURE_HOLD only
+    GestureGuard guard;         // NULL means always enabled
+    GestureAction action;
+};
+
+class GestureEngine
+{
+    public:
+        GestureEngine(int pin, const GestureDef* table, uint8_t tableSize);
+
+        void Update(void);
+        void Report(char* buffer, size_t size);
+
+        unsigned long lastLatency;  // ms between the deciding edge and the commit of the last gesture
+        int lastRow;                // table row of the last gesture, -1 if none fired yet
+
+    private:
+        const GestureDef* table;
+        uint8_t tableSize, pressCount;
+        int pin;
+        bool rawState, pressed, longDone, holdDone;
+        unsigned long bounceTime, edgeTime;
+        unsigned long rowLatency[GESTURE_MAX_ROWS]; // last latency of each row
+
+        void Fire(uint8_t row, unsigned long latency);
+
+        bool Row_Enabled(const GestureDef* row);
+        bool Can_Extend(void);
+        void Commit(uint8_t type, unsigned long decidedAt);
+};
+
+#endif
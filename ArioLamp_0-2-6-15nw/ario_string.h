@@ -0,0 +1,119 @@
+/************************************************************************************************************************************/
+/** @file       ario_string.h
+ *  @brief      fixed capacity string for building outbound messages without the heap
+ *  @details    FixedString<N> holds up to N characters in place, so a message built in a local variable lives on the stack
+ *              and costs no allocation. Appending past the capacity drops the rest and sets Truncated(), a number is
+ *              either appended whole or not at all. Integers and fixed point values are formatted here directly rather
+ *              than through printf.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef ario_string_h
+#define ario_string_h
+
+#include "application.h"
+
+template <size_t N>
+class FixedString
+{
+    public:
+        FixedString(void){ Clear(); }
+        FixedString(const char* str){ Clear(); Append(str); }
+
+        void Clear(void){
+            length = 0;
+            truncated = FALSE;
+            buffer[0] = 0;
+        }
+
+        FixedString& Append(const char* str){
+            while(*str && Put(*str)) str++;
+            buffer[length] = 0;
+            return *this;
+        }
+
+        FixedString& Append(char c){
+            Put(c);
+            buffer[length] = 0;
+            return *this;
+        }
+
+        FixedString& Append_Uint(unsigned long value){
+            char digits[20];
+            int count = 0;
+            do{
+                digits[count++] = '0' + value % 10;
+                value /= 10;
+            } while(value);
+            if(length + count > N){
+                truncated = TRUE;
+                return *this;
+            }
+            while(count) buffer[length++] = digits[--count];
+            buffer[length] = 0;
+            return *this;
+        }
+
+        FixedString& Append_Int(long value){
+            if(value < 0){
+                if(!Put('-')) return *this;
+                return Append_Uint(0UL - (unsigned long)value);
+            }
+            return Append_Uint(value);
+        }
+
+        // value counts units of 10^-decimals, Append_Fixed(-1205, 2) gives "-12.05"
+        FixedString& Append_Fixed(long value, uint8_t decimals){
+            unsigned long scale = 1;
+            for(uint8_t i = 0; i < decimals; i++) scale *= 10;
+            unsigned long magnitude = (value < 0) ? 0UL - (unsigned long)value : value;
+            if((value < 0) && !Put('-')) return *this;
+            Append_Uint(magnitude/scale);
+            if(0 == decimals) return *this;
+            if(length + 1 + decimals > N){
+                truncated = TRUE;
+                buffer[length] = 0;
+                return *this;
+            }
+            buffer[length++] = '.';
+            unsigned long fraction = magnitude % scale;
+            for(scale /= 10; scale; scale /= 10) buffer[length++] = '0' + (fraction/scale) % 10;
+            buffer[length] = 0;
+            return *this;
+        }
+
+        // value as exactly digits upper case hex digits, Append_Hex(0x0A, 2) gives "0A"
+        FixedString& Append_Hex(unsigned long value, uint8_t digits){
+            if(length + digits > N){
+                truncated = TRUE;
+                return *this;
+            }
+            for(int shift = 4*(digits - 1); shift >= 0; shift -= 4) buffer[length++] = "0123456789ABCDEF"[(value >> shift) & 0x0F];
+            buffer[length] = 0;
+            return *this;
+        }
+
+        const char* c_str(void) const { return buffer; }
+        size_t Length(void) const { return length; }
+        bool Truncated(void) const { return truncated; }
+
+    private:
+        char buffer[N + 1];
+        size_t length;
+        bool truncated;
+
+        bool Put(char c){
+            if(length >= N){
+                truncated = TRUE;
+                return FALSE;
+            }
+            buffer[length++] = c;
+            return TRUE;
+        }
+};
+
+#endif
@@ -16,13 +16,43 @@
 #ifndef globals_h
 #define globals_h
 #include "application.h"
-#include "ario_ctrlG.h"
+
+
+// PRODUCT VARIANT-----------------------------------------------------------------------------------------------------------------//
+// Both products build from this source. FW15_base_src_4da94031 is a copy generated by tools/generate_fw15.cmake that defaults
+// to the FW15 variant. Everything below is a preprocessor constant, so absent sensors and features compile out together with
+// their state.
+#define ARIO_VARIANT_NW         0 // no-web lamp (this project): offline button menus, Pacific time, no cloud reports
+#define ARIO_VARIANT_FW15       1 // FW15 base lamp: CCT mode only, Central time, reports lamp events to the cloud
+#ifndef ARIO_VARIANT
+#define ARIO_VARIANT            ARIO_VARIANT_NW
+#endif
 
 
 // SYSTEM VARIABLES----------------------------------------------------------------------------------------------------------------//
-#define SENSOR_ALS_AVAILABLE    TRUE // Ambient light sensor (analog readout)
-#define SENSOR_PIR_AVAILABLE    TRUE // Proximity detector (digital readout)
-#define EXT_MEM_AVAILABLE       TRUE // True ONLY for Particle P1
+#if (ARIO_VARIANT == ARIO_VARIANT_FW15)
+#define SENSOR_ALS_AVAILABLE    1    // Ambient light sensor (analog readout)
+#define SENSOR_PIR_AVAILABLE    1    // Proximity detector (digital readout)
+#define EXT_MEM_AVAILABLE       1    // True ONLY for Particle P1
+#define DEFAULT_TIME_ZONE       (-6) // Central Time when the user has not set a zone
+#define NW_MODE_LAST            1    // button menu stops at NW_MODE_SET_CCT, the old cctMode
+#define CLOUD_REPORT_ENABLED    1    // Report_to_Cloud publishes
+#define OFFLINE_MODE_AVAILABLE  0    // always connects, the online toggle follows the WiFi state
+#define SOFT_RESET_AVAILABLE    0
+#define ALARM_TIME_NEEDS_ENABLE 1    // WAKE/BED only take the time with enable 1
+#define FW_VERSION              "0.2.6.15"
+#else
+#define SENSOR_ALS_AVAILABLE    1
+#define SENSOR_PIR_AVAILABLE    1
+#define EXT_MEM_AVAILABLE       1
+#define DEFAULT_TIME_ZONE       (-8) // Pacific Time
+#define NW_MODE_LAST            7    // NW_MODE_SYNC_TIME
+#define CLOUD_REPORT_ENABLED    0
+#define OFFLINE_MODE_AVAILABLE  1    // offline until paired (OFFLINE_MODE_ADDR), back offline after ONE_HOUR online
+#define SOFT_RESET_AVAILABLE    1    // six clicks of the mode button clear the user settings
+#define ALARM_TIME_NEEDS_ENABLE 0
+#define FW_VERSION              "0.3.0"
+#endif
 
 
 // PIN MAPPING----------------------------------------------------------------------------------------------------------------------//
@@ -40,6 +70,15 @@
 
 // TIME & PARAMETERS------------------------------------------------------------------------------------------------------------------//
 #define RAMP_DELAY              5UL
+
+#define RAMP_CURVE_LINEAR       0
+#define RAMP_CURVE_EASE         1 // smoothstep, slow start and slow finish
+#define RAMP_CURVE_EXP          2 // slow start, fast finish
+#define RAMP_CURVE_PERCEPTUAL   3 // level moves linearly in CIE lightness, CCT stays linear
+#define RAMP_CURVE_HERMITE      4 // retarget of a running ramp, starts at its velocity and eases into the new target
+
+#define RAMP_RETARGET_SLOPE_TIME 8UL // ms of the running ramp used to estimate its velocity on retarget
+#define APP_ADJUST_FADE_TIME    500UL
 #define ONE_HOUR                3600000UL
 #define HALF_HOUR               1800000UL
 #define FIFTEEN_MINUTES         900000UL
@@ -51,9 +90,20 @@
 #define ENTER_WIFI_PAIRING_TIME 15000UL
 #define MODE_CHANGE_FADE_TIME   15000UL
 
+#define HOLD_ADJUST_SWEEP_TIME      3000UL  // holding top/middle button sweeps brightness from min to max in this time
+#define HOLD_ADJUST_CCT_SWEEP_TIME  5000UL  // holding top/middle button sweeps CCT from MIN_CCT to 6500K in this time
+#define HOLD_ADJUST_ACCEL_TIME      600UL   // hold adjust speeds up to full rate within this time
+#define HOLD_ADJUST_CCT_STEP        20      // CCT resolution of hold adjust, in kelvin
+
 #define PIR_STABLE_TIME             30000UL // this is fixed based on component manufacturer
 #define PIR_OFF_HOLD_DELAY          ONE_MINUTE // time before PIR is allowed to turn lamp back on if enabled after user turned lamp off
 #define PIR_REPORT_PERIOD           ONE_MINUTE*10 // reports presence detection
+#define OCCUPANCY_SLOT_MINUTES      15    // one bit of occupancy history per slot
+#define OCCUPANCY_SLOTS_PER_DAY     96
+#define OCCUPANCY_BYTES             84    // 7 days * OCCUPANCY_SLOTS_PER_DAY bits
+#define PREWARM_LEAD_TIME           120UL // s before a predicted arrival the turn on ramp starts
+#define PREWARM_RAMP_TIME           120000UL // ms, slow enough to go unnoticed in an empty room
+#define PREWARM_CONFIRM_TIME        (ONE_MINUTE*20) // a pre-warmed lamp without motion in this time turns off again
 #define ALS_MEASURE_PERIOD          ONE_MINUTE
 #define ALS_REPORT_PERIOD           HALF_HOUR
 #define ALS_SAMPLE_INTERVAL         10UL
@@ -68,6 +118,7 @@
 #define INTERACTION_TYPE_BTN    0x0
 #define INTERACTION_TYPE_WEB    0x1
 #define INTERACTION_TYPE_PIR    0x2
+#define INTERACTION_TYPE_PREWARM 0x3 // PIR turn on ahead of a predicted arrival
 
 
 // COMMUNICATION & LAMP CONFIGURATIONS----------------------------------------------------------------------------------------------//
@@ -75,9 +126,24 @@
 #define UART_BAUD       9600
 
 #define NUM_LED_CH      4
+#define LED_GAMMA           1.0 // exponent of the output LUT, shipped schedules are tuned for a linear response
+#define LED_DITHER_BITS     4   // sub-LSB resolution of the temporal dither (16 steps between two register values)
+#define LED_DITHER_CEILING  64  // channels at or above this register value are rounded instead of dithered
+#define LED_DITHER_WINDOW   1000UL // ms a target holds before its channels are rounded and the dither stops
 #define PSOC_ADDR       1      // I2C slave address of PSoC
 #define NUM_BYTES_READ  6      // Number of bytes to read from PSoC
+#define PSOC_READ_SETTLE_TIME   30UL   // ms the PSoC needs after a read before the next transaction
 #define NUM_BYTES_WRITE 6      // Number of bytes to write to PSoC
+#define I2C_TRACE_SIZE  1024   // capture buffer for PSoC write traces, capture stops when full
+#define I2C_TRACE_REQUEST_NONE  0
+#define I2C_TRACE_REQUEST_START 1
+#define I2C_TRACE_REQUEST_STOP  2
+#define I2C_MAX_RETRIES         3      // extra attempts for a failed PSoC write
+#define I2C_RETRY_BACKOFF_US    100UL  // first retry delay, doubles on every further attempt
+#define I2C_RESEND_DELAY        100UL  // after a write gave up, the full register image is sent again this much later
+#define OUTPUT_QUEUE_SIZE       16     // PSoC frames between the control logic and the output thread, power of 2
+#define OUTPUT_THREAD_PRIORITY  (OS_THREAD_PRIORITY_DEFAULT + 1) // above the application thread
+#define OUTPUT_THREAD_STACK     1024
 
 #define MAX_CCT_UPPER_LIMIT 6500
 #define MAX_CCT_LOWER_LIMIT 4000
@@ -97,6 +163,106 @@
 #define MODE_DAWNSIM    3
 #define MODE_BEDTIME    4
 #define MODE_RAMP       5
+#define MODE_PROGRAM    6 // user uploaded lamp program
+
+
+// BATCH COMMAND FRAMES-------------------------------------------------------------------------------------------------------------//
+// A frame is a run of commands, each an opcode followed by a fixed size payload. Frames are applied all or nothing.
+#define BATCH_MAX_BYTES         64
+#define CMD_POWER               0x01 // on
+#define CMD_LEVEL               0x02 // level
+#define CMD_CCT                 0x03 // cct high byte, cct low byte
+#define CMD_WAKE_ENABLE         0x04 // day mask, enable (keeps the alarm time)
+#define CMD_WAKE_SET            0x05 // day mask, hour, minute, duration in minutes (also enables)
+#define CMD_BED_ENABLE          0x06 // day mask, enable
+#define CMD_BED_SET             0x07 // day mask, hour, minute, duration in minutes
+#define CMD_PIR                 0x08 // turn on enable, turn off enable, on duration in minutes, schedule enable
+#define CMD_PIR_SCHEDULE        0x09 // begin hour, begin minute, end hour, end minute
+#define CMD_ALS                 0x0A // enable, sensitivity
+#define CMD_ZONE                0x0B // zone, (offset + 12)*4 like "ZONE,"
+#define CMD_ALARM_ADD           0x0C // type, day mask, hour, minute, duration, program (adds another alarm)
+#define CMD_DST                 0x0D // DST_RULE_*
+#define ALARM_ALL_DAYS          0x7F // day mask bit 0 is Sunday (weekday 1)
+
+
+// DAYLIGHT SAVING TIME RULES (stored at DST_ENABLE_ADDR)-----------------------------------------------------------------------------//
+#define DST_RULE_NONE           0    // standard time all year
+#define DST_RULE_FIXED          1    // always one hour ahead, the old "DST,1" setting
+#define DST_RULE_US             2    // United States and Canada
+#define DST_RULE_EU             3    // European Union and UK
+#define DST_RULE_AU             4    // south east Australia
+#define DST_RULE_NZ             5    // New Zealand
+#define DST_LAST_WEEK           5    // rule week for the last Sunday of a month
+
+
+// BOOT PROFILE (micros() at each phase, 0 if the phase was skipped)-----------------------------------------------------------------//
+#define BOOT_PHASE_SETUP        0 // setup() entered
+#define BOOT_PHASE_PSOC_READ    1 // lamp state read back from the PSoC, cold boot only
+#define BOOT_PHASE_SETTINGS     2 // schedule and settings loaded, overlaps the PSoC settle time
+#define BOOT_PHASE_FRAME_QUEUED 3 // first frame handed to the output thread
+#define BOOT_PHASE_FIRST_LIGHT  4 // first frame on the PSoC, time to first light
+#define BOOT_PHASE_WATCHDOG     5
+#define BOOT_PHASE_CLOUD_REG    6 // cloud functions and variables registered
+#define BOOT_PHASE_FLASH        7 // external flash device created
+#define BOOT_PHASE_SETUP_DONE   8
+#define BOOT_PHASE_FIRST_LOOP   9
+#define BOOT_PHASE_COUNT        10
+#define BOOT_LIGHT_BUDGET       100000UL // us, boots with a slower first light are counted
+#define BOOT_STATS_MAGIC        0x424F5401UL
+
+
+// BENCHMARK (CPU cycles of the controller hot paths, System.ticks())---------------------------------------------------------------//
+#define BENCH_ITERATIONS        32  // each kernel reports its fastest run, so interrupts do not show up as regressions
+#define BENCH_COLOR_DENS        0   // ColorDens_Calc
+#define BENCH_LOAD_LEDVAL       1   // PSoC_Load_LEDVal with the frame write muted, output state restored afterwards
+#define BENCH_LUT24             2   // ValExtractor_LUT24
+#define BENCH_RAMP_VALUE        3   // one perceptual ramp channel evaluation, the Ramp_Tick inner step
+#define BENCH_BATCH_PARSE       4   // Command_Batch_Apply check of a frame holding every command
+#define BENCH_SCHEDULER         5   // + operatingMode, mean Scheduler() pass since boot
+#define BENCH_MODE_COUNT        7
+#define BENCH_ALS               (BENCH_SCHEDULER + BENCH_MODE_COUNT)     // one ALS sample and ALS_Level_Offset
+#define BENCH_TEXT_PARSE        (BENCH_SCHEDULER + BENCH_MODE_COUNT + 1) // a WAKE/BED command and a program segment
+#define BENCH_RAMP_LINEAR       (BENCH_SCHEDULER + BENCH_MODE_COUNT + 2) // BENCH_RAMP_VALUE on a linear ramp
+#define BENCH_COUNT             (BENCH_SCHEDULER + BENCH_MODE_COUNT + 3)
+#define BENCH_NO_BASELINE       0xFFFFFFFFUL
+
+
+// FAST RESUME (retained SRAM snapshot of the controller)---------------------------------------------------------------------------//
+#define RESUME_MAGIC            0x52534D02UL // bump when ResumeState changes
+#define RESUME_SAVE_PERIOD      100UL        // ms between snapshots
+#define RESUME_MAX_AGE          60UL         // s, an older snapshot is treated as a cold boot
+#define RESUME_PROGRAM_NONE     0
+#define RESUME_PROGRAM_DEMO     1
+#define RESUME_PROGRAM_DAWNSIM  2
+#define RESUME_PROGRAM_BEDTIME  3
+#define RESUME_PROGRAM_CUSTOM   4
+
+
+// ALARM TABLE----------------------------------------------------------------------------------------------------------------------//
+#define ALARM_TABLE_SIZE        16
+#define ALARM_RECORD_BYTES      6    // packed size of one AlarmRecord in EEPROM
+#define ALARM_TYPE_WAKE         0x01 // dawn simulation, only starts while the light is off
+#define ALARM_TYPE_BED          0x02 // bedtime reminder, only starts while the light is on
+#define ALARM_TYPE_MASK         0x0F
+#define ALARM_ENABLED           0x80 // a disabled alarm keeps its time
+#define ALARM_PROGRAM_BUILTIN   0    // dawn simulation or bedtime reminder
+#define ALARM_PROGRAM_CUSTOM    1    // uploaded lamp program
+
+
+// LAMP PROGRAM SEGMENTS--------------------------------------------------------------------------------------------------------------//
+#define SEG_DURATION_SCALED     0x01 // duration is in 1/1000 of the program duration
+#define SEG_HOLD_SCALED         0x02 // hold is in 1/1000 of the program duration
+#define SEG_WAIT_UNTIL          0x04 // after the hold, wait until the local minute of day in waitUntil
+#define SEG_LEVEL_KEEP          0x08 // level is left where it is
+#define SEG_CURVE_SHIFT         4
+#define SEG_CURVE_MASK          0x30 // RAMP_CURVE_* of the segment ramp
+#define SEG_CURVE(curve)        ((curve) << SEG_CURVE_SHIFT)
+#define SEG_CCT_KEEP            0      // any CCT outside MIN_CCT - 6500K leaves the CCT where it is
+#define SEG_CCT_MAX             0xFFFF // user max CCT
+#define SEG_CCT_MAX_LESS_ONE    0xFFFE // one below user max CCT
+
+#define PROGRAM_MAX_SEGMENTS    16
+#define PROGRAM_SEGMENT_BYTES   14 // packed little endian size of one uploaded segment
 
 
 // CLOUD COMMAND CODE (TO BE RETIRED SOON-------------------------------------------------------------------------------------------//
@@ -113,8 +279,8 @@
 // Basic Lamp Settings
 #define FACTORY_TEST_MODE_ADDR              (0x000) // 255 means factory test mode. currently only used for PIR and ALS test
 #define CURRENT_VERSION_ADDR                (0x001)
-#define DST_ENABLE_ADDR                     (0x00A) // Boolean, disbaled by default
-#define USER_TIME_ZONE                      (0x003) // -8 Pacific Time by default
+#define DST_ENABLE_ADDR                     (0x00A) // DST_RULE_*, disbaled by default
+#define USER_TIME_ZONE                      (0x003) // DEFAULT_TIME_ZONE by default
 #define HOLD_TIME_DURTION_ADDR              (0x004) // 60 minutes by default
 #define MAX_CCT_ADDR                        (0x005) // 6500(K) by default, reserve 2 bytes
 
@@ -154,6 +320,21 @@
 #define SCHEDULE_1_LEVEL_BASE_ADDR          (0x200) // Each value stored as 1 byte
 #define SCHEDULE_2_LEVEL_BASE_ADDR          (0x280) // Each value stored as 1 byte
 
+// Uploaded Lamp Program
+#define CUSTOM_PROGRAM_LENGTH_ADDR          (0x300) // number of segments, 0xFF or 0 means no program
+#define CUSTOM_PROGRAM_BASE_ADDR            (0x301) // PROGRAM_MAX_SEGMENTS * PROGRAM_SEGMENT_BYTES
+
+// Alarm Table, replaces the per weekday WAKEUP_ALARM_* / BEDTIME_ALARM_* arrays (migrated once when the count is unset)
+#define ALARM_TABLE_COUNT_ADDR              (0x3F0) // number of records, 0xFF means not migrated yet
+#define ALARM_TABLE_BASE_ADDR               (0x3F1) // ALARM_TABLE_SIZE * ALARM_RECORD_BYTES
+
+// Occupancy history, bit (slot & 7) of byte (slot >> 3), slot = (weekday - 1)*OCCUPANCY_SLOTS_PER_DAY + minute of day/OCCUPANCY_SLOT_MINUTES
+#define OCCUPANCY_VALID_ADDR                (0x451) // 0xFF until the history was first cleared
+#define OCCUPANCY_BASE_ADDR                 (0x452) // OCCUPANCY_BYTES
+
+// Benchmark baseline, BENCH_COUNT little endian uint32_t cycle counts, kept across firmware updates
+#define BENCH_BASELINE_ADDR                 (0x4A6) // to 0x4E1, kernels added later go at the end so old baselines line up
+
 // No Web addition
 #define OFFLINE_MODE_ADDR                    (0x008) // 1: offline mode engaged
 #define NW_MODE_DEFAULT     0
@@ -1,3 +1,4 @@
+// Generated from ArioLamp_0-2-6-15nw/ariolamp-0-2-6-15nw.ino by tools/generate_fw15.cmake, do not edit
 /************************************************************************************************************************************/
 /** @file       Ario_protoG_v1(main.cpp)
  *  @brief      This is the entry file for the Ario Lamp firmware.
@@ -28,25 +29,27 @@
 /************************************************************************************************************************************/
 
 #include "flashee-eeprom/flashee-eeprom.h"
-#include "clickButton/clickButton.h"
 #include "photon-wdgs/photon-wdgs.h"
 
 #include "application.h"
 #include "globals.h"
 //#include "connectivity.h"
 #include "ario_ctrlG.h"
+#include "ario_gesture.h"
+#include "ario_latency.h"
+#include "ario_memory.h"
+#include "ario_string.h"
 
 //PRODUCT_ID(1811);
 //PRODUCT_VERSION(9);
 
-//STARTUP(System.enableFeature(FEATURE_RETAINED_MEMORY));
+STARTUP(System.enableFeature(FEATURE_RETAINED_MEMORY); System.enableFeature(FEATURE_RESET_INFO));
 
 SYSTEM_MODE(SEMI_AUTOMATIC);
 SYSTEM_THREAD(ENABLED);
 
 using namespace Flashee;
 FlashDevice* flash;
-ClickButton modeButton(PIN_BUTTON_BOTTOM, HIGH, CLICKBTN_PULLUP); // debounced mode button
 
 // Factory Test Variables
 bool factoryMode = FALSE;
@@ -71,31 +74,50 @@ unsigned long lastTimeCheck = 0;////////////////////////////////////////////////
 const unsigned long TIME_CHECK_PERIOD = 300000;////////////////////////////////////////////////////////////////////
 unsigned int currentTime, lastTime;
 
-bool offlineMode = FALSE;
+bool offlineMode = OFFLINE_MODE_AVAILABLE;
+unsigned long onlineModeTimeOutLimit = millis();
 
-// Button results
-int function = 0;
-unsigned long cctModeTimeOutLimit = millis();
+unsigned long nwModeTimeOutLimit = millis();
 unsigned long statusLEDTimeoutLimit = millis();
 
-bool enterPairingFlag = FALSE;
-unsigned long enterPairingTimer = 0;
-
-char arioStateStr[40];
-String timeNowStr = "";
+// Lamp state published to the cloud "state" variable. Written only by loop(), read by the system thread through a
+// sequence lock: an odd sequence means a write is in progress, a changed sequence means the copy has to be retried.
+struct ArioState {
+    int lightIsOn, cct, level, mode, version;
+};
+ArioState arioState;
+volatile uint32_t arioStateSeq = 0;
 
 int lastScheduleUploadedFlag = 0;
 
 ArioCtrl aCtrl;
 
+// slowest loop stages, kept across a watchdog reset
+retained LatencyLog latencyLog;
+LatencyMonitor loopMonitor(&latencyLog);
+
+// heap and stack watermarks, kept across a reset
+retained MemoryLog memoryLog;
+MemoryMonitor memMonitor(&memoryLog);
+
+// Messages are built in FixedString. String is left only where the Particle API forces it: the Particle.function
+// handlers receive String, the function variables stateVarRead/timeVarRead return String and Time.timeStr() returns one.
+
 // forward function declarations
 void factoryTest();
 void stateVarConstructor();
+String stateVarRead();
+String timeVarRead();
 void disconnectCheck();
+void handle_update(system_event_t event, int param);
+void setPIR_nwMode(bool isSetStartTime);
+void manual_sync_time(bool syncToNine);
+void timeCheck();
 void buttonScanner();
 void statusLightManager();
 int ctrlArio(String ctrlCmd);
 int setArio(String setCmd);
+int batchArio(String batchCmd);
 int checkArio(String checkCmd);
 int uploadCCT(String cctString);
 int uploadLevel(String levelString);
@@ -103,17 +125,55 @@ int clearArio(String clearCmd);
 void reportMacAddress();
 void raiseHand();
 void ledDiagnostics();
+void soft_reset();
+
+// mode button gestures
+bool lampIsOn();
+void gestureClick();
+void gestureLedCheck();
+void gestureDemo();
+void gestureMenu();
+void gestureOnlineToggle();
+void gesturePairing();
+
+// A gesture commits as soon as no longer row can still match, so the six clicks and the four press long click go off on
+// the deciding edge while a single click waits GESTURE_CLICK_GAP for a second one.
+const GestureDef modeGestures[] = {
+    // type          count  chord               hold time                 guard     action
+    { GESTURE_CLICK, 1,     GESTURE_NO_CHORD,   0,                        NULL,     gestureClick },
+    { GESTURE_CLICK, 2,     PIN_BUTTON_TOP,     0,                        NULL,     gestureLedCheck },
+    { GESTURE_CLICK, 2,     PIN_BUTTON_MIDDLE,  0,                        NULL,     raiseHand },
+    { GESTURE_CLICK, 2,     GESTURE_NO_CHORD,   0,                        lampIsOn, gestureDemo },
+#if SOFT_RESET_AVAILABLE
+    { GESTURE_CLICK, 6,     GESTURE_NO_CHORD,   0,                        NULL,     soft_reset },
+#endif
+    { GESTURE_LONG,  1,     PIN_BUTTON_MIDDLE,  0,                        NULL,     reportMacAddress },
+    { GESTURE_LONG,  1,     GESTURE_NO_CHORD,   0,                        NULL,     gestureMenu },
+    { GESTURE_LONG,  2,     GESTURE_NO_CHORD,   0,                        NULL,     gestureOnlineToggle },
+    { GESTURE_LONG,  3,     GESTURE_NO_CHORD,   0,                        NULL,     gesturePairing },
+    { GESTURE_LONG,  4,     GESTURE_NO_CHORD,   0,                        NULL,     reportMacAddress },
+    { GESTURE_HOLD,  1,     GESTURE_NO_CHORD,   ENTER_WIFI_PAIRING_TIME,  NULL,     gesturePairing }, // alternative way of getting into Listening Mode
+};
+GestureEngine modeButton(PIN_BUTTON_BOTTOM, modeGestures, sizeof(modeGestures)/sizeof(modeGestures[0])); // debounced mode button
 
 int measureAmbient(String ambCmd); ///////////////////////////////////////////////////////////////////////////
 
 
 void setup() {
-    Serial.begin(9600);
+    aCtrl.Boot_Mark(BOOT_PHASE_SETUP);
+    loopMonitor.Begin();
+    memMonitor.Begin();
+
+    aCtrl.Ario_Init(); // first light goes out before any cloud or flash work
 
-    aCtrl.Ario_Init();
+    Serial.begin(9600);
+    if(loopMonitor.previousValid && ((RESET_REASON_WATCHDOG == loopMonitor.resetReason) || (LATENCY_STAGE_NONE != loopMonitor.previous.open.stage))){
+        loopMonitor.Serial_Dump();
+    }
 
     PhotonWdgs::begin(true,true,30000,TIMER7);
     System.on(firmware_update_pending, handle_update);
+    aCtrl.Boot_Mark(BOOT_PHASE_WATCHDOG);
 
     pinMode(PIN_BUTTON_TOP, INPUT_PULLDOWN); // not really needed, was declared in cpp
     pinMode(PIN_BUTTON_MIDDLE, INPUT_PULLDOWN);
@@ -124,53 +184,91 @@ void setup() {
 
     Particle.function("arioDo", ctrlArio);
     Particle.function("arioSet", setArio);
+    Particle.function("arioBatch", batchArio);
     Particle.function("arioCheck", checkArio);
     Particle.function("arioClear", clearArio);
     Particle.function("cctUpload", uploadCCT);
     Particle.function("levelUpload", uploadLevel);
     Particle.function("getAmbient", measureAmbient);
 
-    Particle.variable("fwVersion", "0.2.6.15");
-    Particle.variable("state", arioStateStr);
+    Particle.variable("fwVersion", FW_VERSION);
+    Particle.variable("state", stateVarRead);
     Particle.variable("maxCCT", aCtrl.maxCCT);
-    Particle.variable("time", timeNowStr);
+    Particle.variable("time", timeVarRead);
     Particle.variable("schFlag", lastScheduleUploadedFlag);
     Particle.variable("ambient", aCtrl.alsBackgroundLevel);
+    aCtrl.Boot_Mark(BOOT_PHASE_CLOUD_REG);
 
     flash = Devices::createAddressErase();
+    aCtrl.Boot_Mark(BOOT_PHASE_FLASH);
     System.set(SYSTEM_CONFIG_SOFTAP_PREFIX, "ARIO"); // Replace with PHOTON to use the Particle app pairing
 
     // Check if the controller is in factory mode. If EEPROM_DEFAULT_VAL then it is in factory test mode
     if(EEPROM.read(FACTORY_TEST_MODE_ADDR) == 255){ factoryMode = TRUE; /*System.set(SYSTEM_CONFIG_SOFTAP_PREFIX, "ARIO");*/ }
 
+#if OFFLINE_MODE_AVAILABLE
+    // Check if offline mode is engaged by pairing mode
+	if(EEPROM.read(OFFLINE_MODE_ADDR) == 255){        
+        offlineMode = FALSE;
+        WiFi.on();
+        Particle.connect();
+    } else{
+        offlineMode = TRUE;
+    }
+#else
     WiFi.on();
     Particle.connect();
-
+#endif
+    aCtrl.Boot_Mark(BOOT_PHASE_SETUP_DONE);
 }
 
 
 void loop() {
     PhotonWdgs::tickle();
+    aCtrl.Boot_Mark(BOOT_PHASE_FIRST_LOOP);
     if(!factoryMode && !ledCheck){
+        loopMonitor.Set_Context(aCtrl.operatingMode, aCtrl.nwMode, aCtrl.Ramp_State());
+        loopMonitor.Stage_Next(LATENCY_STAGE_STATE);
         stateVarConstructor();
 
+        loopMonitor.Stage_Next(LATENCY_STAGE_SCHEDULER);
         aCtrl.Scheduler();
 
+        loopMonitor.Stage_Next(LATENCY_STAGE_BUTTONS);
         buttonScanner();
 
         //disconnectCheck();
+#if OFFLINE_MODE_AVAILABLE
+        // if online mode then go offline in 15 minutes
+        if(!offlineMode && (millis() - onlineModeTimeOutLimit >= ONE_HOUR)){
+            EEPROM.write(OFFLINE_MODE_ADDR, 1);
+            offlineMode = TRUE;
+            WiFi.off();
+        }
+#endif
 
         //if(TRUE){ statusLightManager(); }
-        if(!aCtrl.cctMode){ statusLightManager(); }///////////////////////////////////////////////////////////////
+        loopMonitor.Stage_Next(LATENCY_STAGE_STATUS_LED);
+        if(aCtrl.nwMode == NW_MODE_DEFAULT){ statusLightManager(); }///////////////////////////////////////////////////////////////
 
-        if(aCtrl.cctMode && (millis() - cctModeTimeOutLimit >= CCT_MODE_TIMEOUT)){ aCtrl.cctMode = FALSE; RGB.control(false); } // CCT Mode Time Out
+        if((aCtrl.nwMode != NW_MODE_DEFAULT) && (millis() - nwModeTimeOutLimit >= NW_MODE_TIMEOUT)){ aCtrl.nwMode = NW_MODE_DEFAULT; RGB.control(false); } // CCT Mode Time Out
+#if SENSOR_PIR_AVAILABLE
+        loopMonitor.Stage_Next(LATENCY_STAGE_PIR);
+        if(millis() > PIR_STABLE_TIME){ aCtrl.PIR_Routine(); } // PIR logic
+#endif
 
-        if(SENSOR_PIR_AVAILABLE && (millis() > PIR_STABLE_TIME)){ aCtrl.PIR_Routine(); } // PIR logic
-
-        if(SENSOR_ALS_AVAILABLE && RGB.controlled() && !aCtrl.cctMode && (MODE_DEMO != aCtrl.operatingMode)){ aCtrl.ALS_Routine(); } // ALS logic
+#if SENSOR_ALS_AVAILABLE
+        loopMonitor.Stage_Next(LATENCY_STAGE_ALS);
+        if(RGB.controlled() && (aCtrl.nwMode == NW_MODE_DEFAULT) && (MODE_DEMO != aCtrl.operatingMode) && (MODE_PROGRAM != aCtrl.operatingMode)){ aCtrl.ALS_Routine(); } // ALS logic
+#endif
 
+        loopMonitor.Stage_Next(LATENCY_STAGE_TIME);
         timeCheck();
 
+        loopMonitor.Stage_Next(LATENCY_STAGE_MEMORY);
+        memMonitor.Loop();
+
+        loopMonitor.Loop_End();
     }
     else if (ledCheck) { //LED Diagnostic Mode
         ledDiagnostics();
@@ -281,17 +379,45 @@ void statusLightManager(){
     }
 }
 
+// Publishes the lamp state, only when it changed since the last pass
 void stateVarConstructor(){
-    int arioColor = aCtrl.currentCCT;
-    int arioBrightness = aCtrl.currentLevel;
-    int arioMode = aCtrl.operatingMode;
-    if(arioMode == MODE_RAMP){
-        arioMode = aCtrl.rampRegNextMode;
-    } else if(arioMode == MODE_DEMO){
-        arioMode = MODE_DEFAULT;
+    ArioState next;
+    next.lightIsOn = aCtrl.lightIsOn;
+    next.cct = aCtrl.currentCCT;
+    next.level = aCtrl.currentLevel;
+    next.mode = aCtrl.operatingMode;
+    if(next.mode == MODE_RAMP){
+        next.mode = aCtrl.rampRegNextMode;
+    } else if((next.mode == MODE_DEMO) || (next.mode == MODE_PROGRAM)){
+        next.mode = MODE_DEFAULT;
     }
-    sprintf(arioStateStr,"%d,%d,%d,%d,%d", aCtrl.lightIsOn, arioColor, arioBrightness, arioMode, aCtrl.currentVersion);
-    timeNowStr = Time.timeStr();
+    next.version = aCtrl.currentVersion;
+    if(0 == memcmp(&next, &arioState, sizeof(next))) return;
+    arioStateSeq++;
+    __sync_synchronize();
+    arioState = next;
+    __sync_synchronize();
+    arioStateSeq++;
+}
+
+// Text form of the state, built only when the cloud reads the variable
+String stateVarRead(){
+    ArioState snap;
+    uint32_t seq;
+    do{
+        seq = arioStateSeq;
+        __sync_synchronize();
+        snap = arioState;
+        __sync_synchronize();
+    } while((seq & 1) || (seq != arioStateSeq));
+    FixedString<40> stateStr;
+    stateStr.Append_Int(snap.lightIsOn).Append(',').Append_Int(snap.cct).Append(',').Append_Int(snap.level);
+    stateStr.Append(',').Append_Int(snap.mode).Append(',').Append_Int(snap.version);
+    return String(stateStr.c_str()); // a function variable has to return String
+}
+
+String timeVarRead(){
+    return Time.timeStr();
 }
 
 
@@ -325,95 +451,194 @@ void disconnectCheck(){
     }
 }
 
+void soft_reset(){
+    RGB.control(TRUE);
+    RGB.color(255,0,0);
+    delay(500);
+    RGB.color(0,0,0);
+    delay(500);
+    RGB.control(false);
+    uint8_t val = 0xFF;
+    EEPROM.write(4, val);
+    EEPROM.write(5, val);
+    EEPROM.write(7, val);
+    EEPROM.write(9, val);
+    EEPROM.write(10, val);
+    for(int addr = 16; addr <= 154; addr++){
+        EEPROM.write(addr, val);
+    }
+    aCtrl.Resume_Invalidate();
+    aCtrl.Alarm_Table_Clear();
+    aCtrl.Set_TimeZone();
+    aCtrl.Load_RTC_Schedule();
+    aCtrl.Load_Max_CCT();
+}
+
+bool lampIsOn(){
+    return aCtrl.lightIsOn;
+}
+
+void gestureClick(){
+    if(aCtrl.nwMode != NW_MODE_DEFAULT){
+        aCtrl.nwMode = NW_MODE_DEFAULT;
+        RGB.control(FALSE);
+    } else{
+        aCtrl.Light_Switch();
+    }
+}
+
+void gestureLedCheck(){
+    ledGroup = 0;
+    ledCheckMarker = millis() + 600UL;
+    ledCheck = TRUE;
+}
+
+void gestureDemo(){
+    aCtrl.Demo_Init();
+}
+
+void gestureMenu(){
+    if(!aCtrl.lightIsOn){
+        aCtrl.Light_Switch();
+    } else{ // NW Mode Cycler
+        if(aCtrl.nwMode < NW_MODE_LAST){
+            aCtrl.nwMode += 1;
+            RGB.control(TRUE);
+            if(aCtrl.nwMode == NW_MODE_SET_CCT){
+                RGB.color(255, 100, 0);
+            }else if(aCtrl.nwMode == NW_MODE_SET_WAKE){
+                RGB.color(255, 0, 0);
+            }else if(aCtrl.nwMode == NW_MODE_SET_BED){
+                RGB.color(0, 10, 255);
+            }else if(aCtrl.nwMode == NW_MODE_SET_PIR){
+                RGB.color(0, 255, 0);
+            }else if(aCtrl.nwMode == NW_MODE_PIR_SCH){
+                RGB.color(200, 255, 0);
+            }else if(aCtrl.nwMode == NW_MODE_ALARM_SCH){
+                RGB.color(51, 255, 255);
+            }else if(aCtrl.nwMode == NW_MODE_SYNC_TIME){
+                RGB.color(200, 15, 55);
+            }
+            nwModeTimeOutLimit = millis(); // reset the time marker
+        }
+    }
+}
+
+void gestureOnlineToggle(){
+#if OFFLINE_MODE_AVAILABLE
+    if(offlineMode){
+        onlineModeTimeOutLimit = millis();
+        offlineMode = FALSE;
+        WiFi.on();
+        Particle.connect();
+    } else {
+        EEPROM.write(OFFLINE_MODE_ADDR, 1);
+        offlineMode = TRUE;
+        WiFi.off();
+    }
+#else
+    if(WiFi.listening() || WiFi.connecting() || WiFi.ready()){
+        offlineMode = TRUE;
+        WiFi.off();
+    } else { // exits offline or listening mode
+        offlineMode = FALSE;
+        WiFi.on();
+        Particle.connect();
+    }
+#endif
+}
+
+void gesturePairing(){
+#if OFFLINE_MODE_AVAILABLE
+    EEPROM.write(OFFLINE_MODE_ADDR, 255);
+    onlineModeTimeOutLimit = millis();
+    offlineMode = FALSE;
+#endif
+    WiFi.disconnect();
+    aCtrl.nwMode = NW_MODE_DEFAULT;
+    WiFi.listen();
+}
 
 void buttonScanner(){
     modeButton.Update();
-    if(0 != modeButton.clicks) function = modeButton.clicks;
-    switch(function){
-        case 1:
-            if(aCtrl.cctMode){
-                aCtrl.cctMode = FALSE;
-                RGB.control(FALSE);
-            } else{
-                aCtrl.Light_Switch();
-            }
-            break;
-        case 2:
-            if (digitalRead(PIN_BUTTON_TOP)) {
-              ledGroup = 0;
-              ledCheckMarker = millis() + 600UL;
-              ledCheck = TRUE;
-            }
-            else if (digitalRead(PIN_BUTTON_MIDDLE)) {
-              raiseHand();
-            }
-            else if (aCtrl.lightIsOn) {
-              aCtrl.Demo_Init();
-            }
-            break;
-        case 3:
-            //
-            break;
-        case -1:
-            if(digitalRead(PIN_BUTTON_MIDDLE)){
-                reportMacAddress();
-            } else if(!aCtrl.lightIsOn){
-                aCtrl.Light_Switch();
-            } else{
-                aCtrl.cctMode = TRUE;
-                RGB.control(TRUE);
-                RGB.color(255, 50, 0);
-                cctModeTimeOutLimit = millis(); // reset the time marker
-            }
-            break;
-        case -2:
-            if(WiFi.listening() || WiFi.connecting() || WiFi.ready()){
-                offlineMode = TRUE;
-                WiFi.off();
-            } else { // exits offline or listening mode
-                offlineMode = FALSE;
-                WiFi.on();
-                Particle.connect();
+
+    if(digitalRead(PIN_BUTTON_TOP)){
+        if(aCtrl.nwMode <= NW_MODE_SET_CCT){
+            aCtrl.TopButton_Action();
+            nwModeTimeOutLimit = millis(); 
+        } else{
+            // place holder for other modes of NW
+            if(aCtrl.nwMode == NW_MODE_PIR_SCH){ setPIR_nwMode(TRUE); }
+            else if(aCtrl.nwMode == NW_MODE_SET_PIR){ const byte cmd[] = { CMD_PIR, 1, 1, 60, 1 }; aCtrl.Command_Batch_Apply(cmd, sizeof(cmd)); }
+            else if(aCtrl.nwMode == NW_MODE_SET_WAKE){ const byte cmd[] = { CMD_WAKE_ENABLE, ALARM_ALL_DAYS, 1 }; aCtrl.Command_Batch_Apply(cmd, sizeof(cmd)); }
+            else if(aCtrl.nwMode == NW_MODE_SET_BED){ const byte cmd[] = { CMD_BED_ENABLE, ALARM_ALL_DAYS, 1 }; aCtrl.Command_Batch_Apply(cmd, sizeof(cmd)); }
+            else if(aCtrl.nwMode == NW_MODE_SYNC_TIME){ manual_sync_time(TRUE); }
+            else if(aCtrl.nwMode == NW_MODE_ALARM_SCH){ // wake alarm at the current time every day, 60 minutes
+                const byte cmd[] = { CMD_WAKE_SET, ALARM_ALL_DAYS, (byte)Time.hour(), (byte)Time.minute(), 60 };
+                aCtrl.Command_Batch_Apply(cmd, sizeof(cmd));
             }
-            //Test
-            //if(TRUE){
-            //    String myID = System.deviceID();
-            //    aCtrl.Cloud_Debug_Print(myID);
-            //}
-            break;
-        case -3:
-            WiFi.disconnect();
-            aCtrl.cctMode = FALSE;
-            WiFi.listen();
-            break;
-
-        case -4:
-            reportMacAddress();
-            break;
-        default:
-            break;
-    }
-    modeButton.clicks = 0; // bug fix need testing: this avoids executing twice
-    function = 0;
-    if(digitalRead(PIN_BUTTON_TOP)){ aCtrl.TopButton_Action(); cctModeTimeOutLimit = millis(); }
-    if(digitalRead(PIN_BUTTON_MIDDLE)){ aCtrl.MidButton_Action(); cctModeTimeOutLimit = millis(); }
-
-    // Alternative way of getting into Listening Mode - Hold down Mode button for ~15 seocnds
-    if(digitalRead(PIN_BUTTON_BOTTOM)){
-        if(!enterPairingFlag){
-            enterPairingFlag = TRUE;
-            enterPairingTimer = millis();
+            RGB.control(TRUE);
+            RGB.color(255,255,255); delay(200); RGB.color(0,0,0); delay(200); RGB.color(255,255,255); delay(200); RGB.color(0,0,0); delay(200);
+            aCtrl.nwMode = NW_MODE_DEFAULT;
+            RGB.control(false); 
         }
-        if(enterPairingFlag && (millis() - enterPairingTimer > ENTER_WIFI_PAIRING_TIME)){
-            WiFi.disconnect();
-            aCtrl.cctMode = FALSE;///////////////////////////////////////////////////////////////////////////////////
-            WiFi.listen();
+    }
+
+    if(!digitalRead(PIN_BUTTON_TOP) && !digitalRead(PIN_BUTTON_MIDDLE)){
+        aCtrl.Button_Release();
+    }
+
+    if(digitalRead(PIN_BUTTON_MIDDLE)){
+        if(aCtrl.nwMode <= NW_MODE_SET_CCT){
+            aCtrl.MidButton_Action();
+            nwModeTimeOutLimit = millis();
+        } else{
+            // place holder for other modes of NW
+            if(aCtrl.nwMode == NW_MODE_PIR_SCH){ setPIR_nwMode(FALSE); }
+            else if(aCtrl.nwMode == NW_MODE_SET_PIR){ const byte cmd[] = { CMD_PIR, 0, 0, 60, 0 }; aCtrl.Command_Batch_Apply(cmd, sizeof(cmd)); }
+            else if(aCtrl.nwMode == NW_MODE_SET_WAKE){ const byte cmd[] = { CMD_WAKE_ENABLE, ALARM_ALL_DAYS, 0 }; aCtrl.Command_Batch_Apply(cmd, sizeof(cmd)); }
+            else if(aCtrl.nwMode == NW_MODE_SET_BED){ const byte cmd[] = { CMD_BED_ENABLE, ALARM_ALL_DAYS, 0 }; aCtrl.Command_Batch_Apply(cmd, sizeof(cmd)); }
+            else if(aCtrl.nwMode == NW_MODE_SYNC_TIME){ manual_sync_time(FALSE); }
+            else if(aCtrl.nwMode == NW_MODE_ALARM_SCH){ // bedtime reminder at the current time every day, 30 minutes
+                const byte cmd[] = { CMD_BED_SET, ALARM_ALL_DAYS, (byte)Time.hour(), (byte)Time.minute(), 30 };
+                aCtrl.Command_Batch_Apply(cmd, sizeof(cmd));
+            }
+            RGB.control(TRUE);
+            RGB.color(255,255,255); delay(200); RGB.color(0,0,0); delay(200); RGB.color(255,255,255); delay(200); RGB.color(0,0,0); delay(200);
+            aCtrl.nwMode = NW_MODE_DEFAULT;
+            RGB.control(false); 
         }
+    }
+}
+
+void setPIR_nwMode(bool isSetStartTime) {
+    int hour = Time.hour();
+    int min = Time.minute();
+    aCtrl.Resume_Invalidate();
+    EEPROM.write(PIR_ON_SET_ADDR, 1);
+    EEPROM.write(PIR_OFF_SET_ADDR, 1);
+    EEPROM.write(PIR_ON_DURATION, 60);
+    EEPROM.write(PIR_SCHEDULE_EN_ADDR, 1);    
+    if(isSetStartTime){
+        EEPROM.write(PIR_BEGIN_HOUR_ADDR, hour);                
+        EEPROM.write(PIR_BEGIN_MINUTE_ADDR, min);               
     } else{
-        enterPairingFlag = FALSE;
+        EEPROM.write(PIR_END_HOUR_ADDR, hour);               
+        EEPROM.write(PIR_END_MINUTE_ADDR, min);
     }
 }
 
+void manual_sync_time(bool syncToNine) {
+    Time.endDST(); // probably not needed
+    unsigned long localTime = syncToNine ? 1569099600 : 1569049200; // 2019.09.21 9:00 PM or 7:00 AM local
+    Time.setTime(localTime - (long)(aCtrl.Zone_Standard()*3600));
+    aCtrl.Set_TimeZone(); // DST state on that date, keeps the stored rule
+    Time.setTime(localTime - (long)(aCtrl.Local_Offset()*3600));
+    aCtrl.Set_TimeZone();
+}
+
+
+
 
 // Particle Cloud Functions
 int ctrlArio(String ctrlCmd) {
@@ -442,6 +667,8 @@ int ctrlArio(String ctrlCmd) {
         }
     } else if(ctrlCmd.substring(0,4) == "DEMO"){
         if(aCtrl.lightIsOn) aCtrl.Demo_Init();
+    } else if(ctrlCmd.substring(0,4) == "PROG"){
+        if(!aCtrl.Program_Init()) return 404; // light is off or no program uploaded
     } else{
         aCtrl.decode_cmd(ctrlCmd.toInt());
     }
@@ -449,6 +676,7 @@ int ctrlArio(String ctrlCmd) {
 }
 
 int setArio(String setCmd) {
+    aCtrl.Resume_Invalidate(); // settings move away from the snapshot, the next Scheduler pass takes a fresh one
     if(setCmd.substring(0,3) == "VER"){
         uint8_t newVersion = setCmd.substring(4).toInt();
         EEPROM.write(CURRENT_VERSION_ADDR, newVersion);
@@ -457,26 +685,54 @@ int setArio(String setCmd) {
         // "WAKE,2,1,0630,120" => enable at Monday (day 2) 6:30 AM for 120 minutes
         // "WAKE,4,0" => disable alarm for Wednesday (retains other settings in memory)
         // Duration cannot exceed 0xFF
-        aCtrl.Set_Wake_Alarm(setCmd.substring(5));
+        if(!aCtrl.Set_Wake_Alarm(setCmd.substring(5).c_str())){
+            aCtrl.Cloud_Debug_Print("Wake Alarm Table Full Or Format Not Correct!");
+            return 404;
+        }
         aCtrl.Cloud_Debug_Print("Wake Time Set!");
+    } else if(setCmd.substring(0,5) == "ALARM"){
+        // "ALARM,1,3E,0630,30,0" adds a wake alarm (type 1) Mon-Fri (day mask 0x3E) at 6:30 AM for 30 minutes with the
+        // built in program (0, or 1 for the uploaded program), next to the existing ones. "ALARM,CLR" removes all alarms.
+        if(setCmd.substring(6,9) == "CLR"){
+            aCtrl.Alarm_Table_Clear();
+        } else{
+            uint8_t type = setCmd.substring(6,7).toInt();
+            uint8_t dayMask = strtoul(setCmd.substring(8,10).c_str(), NULL, 16);
+            long hour = setCmd.substring(11,13).toInt(), minute = setCmd.substring(13,15).toInt();
+            if(((ALARM_TYPE_WAKE != type) && (ALARM_TYPE_BED != type)) || (hour < 0) || (23 < hour) || (minute < 0) || (59 < minute)){
+                aCtrl.Cloud_Debug_Print("Alarm Format Not Correct!");
+                return 404;
+            }
+            int programComma = setCmd.indexOf(',', 16);
+            uint8_t duration = setCmd.substring(16, (programComma < 0) ? setCmd.length() : programComma).toInt();
+            uint8_t program = (programComma < 0) ? ALARM_PROGRAM_BUILTIN : setCmd.substring(programComma + 1).toInt();
+            if(!aCtrl.Alarm_Set(type, dayMask, hour*60 + minute, duration, program, FALSE)){
+                aCtrl.Cloud_Debug_Print("Alarm Table Full Or Format Not Correct!");
+                return 404;
+            }
+        }
     } else if(setCmd.substring(0,3) == "BED"){
-        aCtrl.Set_Bedtime_Reminder(setCmd.substring(4));
+        if(!aCtrl.Set_Bedtime_Reminder(setCmd.substring(4).c_str())){
+            aCtrl.Cloud_Debug_Print("Bedtime Table Full Or Format Not Correct!");
+            return 404;
+        }
         aCtrl.Cloud_Debug_Print("Bed Time Set!");
     } else if(setCmd.substring(0,3) == "PIR"){
         // first number is enable turn on, second is turn off, thrid is on duration in minutes,
         // fourth is enable schedule, fifth is scheduled on time, sixth is scheduled off time
-        aCtrl.Configure_Sensor_PIR(setCmd.substring(4));
+        aCtrl.Configure_Sensor_PIR(setCmd.substring(4).c_str());
         // "PIR,1,1,060,1,1950,2010", everything disabled by default, duration cannot exceed 0xFF
         // user require to set duration if enable auto off first time or the app input default 30 minute duration
         aCtrl.Cloud_Debug_Print("PIR Configured!");
     } else if(setCmd.substring(0,3) == "ALS"){
-        aCtrl.Configure_Sensor_ALS(setCmd.substring(4));
+        aCtrl.Configure_Sensor_ALS(setCmd.substring(4).c_str());
         aCtrl.Cloud_Debug_Print("ALS Configured!");
     } else if(setCmd.substring(0,4) == "HOLD"){
         EEPROM.write(HOLD_TIME_DURTION_ADDR, setCmd.substring(5).toInt()); // no need to zero-pad, 60 minutes by default
         aCtrl.Cloud_Debug_Print("Hold Time Adjusted!");
     } else if(setCmd.substring(0,3) == "DST"){
-        EEPROM.write(DST_ENABLE_ADDR, setCmd.substring(4,5).toInt()); // "DST,1" to enable, "DST,0" to disable (default), (anything other than 1 would default to disable)
+        // "DST,0" to disable (default), "DST,1" always on, "DST,2" US, "DST,3" EU, "DST,4" Australia, "DST,5" New Zealand rules
+        EEPROM.write(DST_ENABLE_ADDR, setCmd.substring(4,5).toInt()); // anything else would default to disable
         aCtrl.Set_TimeZone();
     } else if(setCmd.substring(0,4) == "ZONE"){
         // Formula to calculate zone in app, (x+12)*4
@@ -488,39 +744,96 @@ int setArio(String setCmd) {
         aCtrl.Load_Max_CCT();
     } else if(setCmd.substring(0,5) == "DEBUG"){
         EEPROM.write(CLOUD_DEBUG_ADDR, setCmd.substring(6,7).toInt()); // "DEBUG,1" to enable, "DDEBUG,0" to disable cloud debug messages
+    } else if(setCmd.substring(0,4) == "PROG"){
+        // "PROG,3,<28 hex digits>" stores segment 3 of the uploaded program (see LampSegment)
+        // "PROG,LEN,4" makes the first 4 segments the program, "PROG,LEN,0" removes it
+        if(setCmd.substring(5,8) == "LEN"){
+            aCtrl.Program_Set_Length(setCmd.substring(9).toInt());
+        } else{
+            int comma = setCmd.indexOf(',', 5);
+            if((comma < 0) || !aCtrl.Program_Upload_Segment(setCmd.substring(5, comma).toInt(), setCmd.substring(comma + 1).c_str())){
+                aCtrl.Cloud_Debug_Print("Program Segment Format Not Correct!");
+                return 404;
+            }
+        }
+    } else if(setCmd.substring(0,5) == "TRACE"){
+        if(setCmd.charAt(6) == '1'){ aCtrl.I2C_Trace_Start(); } else{ aCtrl.I2C_Trace_Stop(); } // "TRACE,1" starts a new PSoC write capture
+    }
+    return 200;
+}
+
+// "01010280" => power on, level 128. Binary command frame as hex digits, see CMD_* in globals.h
+int batchArio(String batchCmd) {
+    if(!aCtrl.Command_Batch_Hex(batchCmd.c_str())){
+        aCtrl.Cloud_Debug_Print("Batch Format Not Correct!");
+        return 404;
     }
     return 200;
 }
 
 
+// "enable,hour,minute,duration" of the alarm of a type on a weekday, "0,255,255,255" if never set
+void alarmString(FixedString<40>* out, uint8_t type, int weekday){
+    AlarmRecord alarm;
+    if(aCtrl.Alarm_Lookup(type, weekday, &alarm)){
+        out->Append_Uint((alarm.type & ALARM_ENABLED) ? 1 : 0).Append(',').Append_Uint(alarm.minuteOfDay/60);
+        out->Append(',').Append_Uint(alarm.minuteOfDay%60).Append(',').Append_Uint(alarm.duration);
+    } else{
+        out->Append("0,255,255,255");
+    }
+}
+
 int checkArio(String checkCmd) {
-    char publishString[40];
+    FixedString<40> publishString;
     if(checkCmd.substring(0,4) == "WAKE"){
-        int day = checkCmd.substring(5).toInt();
-        int enable = EEPROM.read(WAKEUP_ALARM_ENABLE_BASE_ADDR + day);
-        int hour = EEPROM.read(WAKEUP_ALARM_HOUR_BASE_ADDR + day);
-        int min = EEPROM.read(WAKEUP_ALARM_MINUTE_BASE_ADDR + day);
-        int duration = EEPROM.read(WAKEUP_ALARM_DURATION_BASE_ADDR + day);
-        sprintf(publishString,"%d,%d,%d,%d", enable, hour, min, duration);
-        aCtrl.Cloud_Debug_Print("Wake Alarm was set at: ",publishString);
+        alarmString(&publishString, ALARM_TYPE_WAKE, checkCmd.substring(5).toInt());
+        aCtrl.Cloud_Debug_Print("Wake Alarm was set at: ", publishString.c_str());
     } else if(checkCmd.substring(0,3) == "BED"){
-        int day = checkCmd.substring(4).toInt();
-        int enable = EEPROM.read(BEDTIME_ALARM_ENABLE_BASE_ADDR + day);
-        int hour = EEPROM.read(BEDTIME_ALARM_HOUR_BASE_ADDR + day);
-        int min = EEPROM.read(BEDTIME_ALARM_MINUTE_BASE_ADDR + day);
-        int duration = EEPROM.read(BEDTIME_ALARM_DURATION_BASE_ADDR + day);
-        sprintf(publishString,"%d,%d,%d,%d", enable, hour, min, duration);
-        aCtrl.Cloud_Debug_Print("Bedtime Reminder was set at: ",publishString);
+        alarmString(&publishString, ALARM_TYPE_BED, checkCmd.substring(4).toInt());
+        aCtrl.Cloud_Debug_Print("Bedtime Reminder was set at: ", publishString.c_str());
     } else if(checkCmd.substring(0,4) == "TIME"){
-        aCtrl.Report_to_Cloud("time", Time.timeStr());
+        aCtrl.Report_to_Cloud("time", Time.timeStr().c_str());
     } else if(checkCmd.substring(0,7) == "FREEMEM"){
-        int freemem = System.freeMemory();
-        sprintf(publishString,"%u", freemem);
-        aCtrl.Cloud_Debug_Print("Free memory: ", publishString);
+        publishString.Append_Uint(System.freeMemory());
+        aCtrl.Cloud_Debug_Print("Free memory: ", publishString.c_str());
     } else if(checkCmd.substring(0,8) == "SCHEDULE"){
         aCtrl.Cloud_Print_Schedule();
     } else if(checkCmd.substring(0,3) == "MAC"){
         reportMacAddress();
+    } else if(checkCmd.substring(0,4) == "PERF"){
+        aCtrl.Cloud_Print_Perf();
+#if SENSOR_PIR_AVAILABLE
+    } else if(checkCmd.substring(0,9) == "OCCUPANCY"){
+        char occupancyString[40];
+        aCtrl.Occupancy_Report(occupancyString, sizeof(occupancyString));
+        aCtrl.Cloud_Debug_Print("Occupancy: ", occupancyString);
+#endif
+    } else if(checkCmd.substring(0,5) == "BENCH"){ // BENCH, BENCH,CMP compares with the stored baseline, BENCH,SAVE stores it
+        char benchString[256];
+        aCtrl.Benchmark_Run();
+        if(checkCmd.substring(6,10) == "SAVE") aCtrl.Benchmark_Save_Baseline();
+        aCtrl.Benchmark_Report(benchString, sizeof(benchString), checkCmd.substring(6,9) == "CMP");
+        aCtrl.Cloud_Debug_Print("Bench: ", benchString);
+    } else if(checkCmd.substring(0,4) == "BOOT"){
+        char bootString[160];
+        aCtrl.Boot_Report(bootString, sizeof(bootString));
+        aCtrl.Cloud_Debug_Print("Boot: ", bootString);
+    } else if(checkCmd.substring(0,4) == "HEAP"){
+        // "HEAP" for now and the watermarks of this boot, "HEAP,LOG" for the sample ring
+        char heapString[256];
+        memMonitor.Report(heapString, sizeof(heapString), (checkCmd.substring(5,8) == "LOG"));
+        aCtrl.Cloud_Debug_Print("Heap: ", heapString);
+    } else if(checkCmd.substring(0,7) == "LATENCY"){
+        // "LATENCY" for this boot, "LATENCY,LAST" for the boot before the last reset, "LATENCY,GESTURE" for the mode button
+        char latencyString[256];
+        if(checkCmd.substring(8,15) == "GESTURE"){
+            modeButton.Report(latencyString, sizeof(latencyString));
+        } else{
+            loopMonitor.Report(latencyString, sizeof(latencyString), (checkCmd.substring(8,12) == "LAST"));
+        }
+        aCtrl.Cloud_Debug_Print("Latency: ", latencyString);
+    } else if(checkCmd.substring(0,5) == "TRACE"){
+        aCtrl.I2C_Trace_Dump(); // over USB serial, too large for a publish
     } else{
         int addr = checkCmd.toInt();
         //if((addr == MAX_CCT_ADDR) || ((addr >= USER_SCHEDULE_CCT_BASE_ADDR) && (addr < USER_SCHEDULE_LEVEL_BASE_ADDR))){
@@ -528,10 +841,9 @@ int checkArio(String checkCmd) {
         //    EEPROM.get(addr, content);
         //    sprintf(publishString,"%d", content);
         //} else{
-            int content = EEPROM.read(addr);
-            sprintf(publishString,"%d", content);
+            publishString.Append_Uint(EEPROM.read(addr));
         //}
-        aCtrl.Cloud_Debug_Print("Content at the location is: ",publishString);
+        aCtrl.Cloud_Debug_Print("Content at the location is: ", publishString.c_str());
     }
     return 200;
 }
@@ -543,6 +855,7 @@ int checkArio(String checkCmd) {
 // "1,aaaabbbbccccddddeeeeffffgggghhhhiiiijjjjkkkkllll"
 int uploadCCT(String cctString){
     int part = cctString.substring(0,1).toInt(); // part 1 or part 2 of LUT
+    aCtrl.Resume_Invalidate();
     String content = cctString.substring(2); // extract the rest of the string
     if(((1 != part)&&(2 != part))||(content.length()!= 48)){ // check formatting
         aCtrl.Cloud_Debug_Print("CCT Schedule Format Not Correct!");
@@ -580,6 +893,7 @@ int uploadCCT(String cctString){
 
 int uploadLevel(String levelString){
     int part = levelString.substring(0,1).toInt(); // part 1 or part 2 of LUT
+    aCtrl.Resume_Invalidate();
     String content = levelString.substring(2); // extract the rest of the string
     if(((1 != part)&&(2 != part))||(content.length() != 36)){ // check formatting
         aCtrl.Cloud_Debug_Print("Level Schedule Format Not Correct!");
@@ -623,9 +937,11 @@ int uploadLevel(String levelString){
 
 int clearArio(String clearCmd) {
     if(clearCmd == "EEPROM"){
+        aCtrl.Resume_Invalidate(TRUE); // RAM still holds the old settings until the next boot
         EEPROM.clear();
         EEPROM.write(FACTORY_TEST_MODE_ADDR, 1); // Must write here otherwise the lamp would enter factory mode upon reboot
         factoryMode = FALSE;
+        aCtrl.Alarm_Table_Clear(); // the alarms in RAM would keep firing until the next boot
         aCtrl.Load_RTC_Schedule();
         aCtrl.Cloud_Debug_Print("EEPROM Cleared!");
         //set EEPROM FACTORY MODE ADDRESS TO TRUE; !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
@@ -634,9 +950,12 @@ int clearArio(String clearCmd) {
     //    WiFi.clearCredentials();
     } else if(clearCmd == "SCHEDULE"){ // returns to default schedule
         EEPROM.write(SCHEDULE_SELECT_ADDR, 0xFF);
+        aCtrl.Resume_Invalidate();
         aCtrl.Load_RTC_Schedule();
     } else if(clearCmd == "FACTORY"){ // complete factory reset
+        aCtrl.Resume_Invalidate(TRUE);
         EEPROM.clear();
+        aCtrl.Alarm_Table_Clear();
         aCtrl.Load_RTC_Schedule();
     } else if(clearCmd == "WDD"){ // testing
       EEPROM.write(FACTORY_TEST_MODE_ADDR, 1); // Must write here otherwise the lamp would enter factory mode upon reboot
@@ -648,7 +967,11 @@ int clearArio(String clearCmd) {
 
 void raiseHand() {
     if(Particle.connected()){ // so it doesn't trigger any offline logging when calling Report_to_Cloud()
+#if CLOUD_REPORT_ENABLED
         aCtrl.Report_to_Cloud("raiseHand", "true");
+#else
+        Particle.publish("raiseHand", "true");
+#endif
         RGB.control(TRUE);
         RGB.color(255,220,0);
         delay(2000);
@@ -658,11 +981,18 @@ void raiseHand() {
 
 void reportMacAddress(){
     if(Particle.connected()){ // so it doesn't trigger any offline logging when calling Report_to_Cloud()
-        char macString[17];
+        FixedString<17> macString;
         byte mac[6];
         WiFi.macAddress(mac);
-        sprintf(macString,"%02X:%02X:%02X:%02X:%02X:%02X",mac[0],mac[1],mac[2],mac[3],mac[4],mac[5]);
-        aCtrl.Report_to_Cloud("production", macString);
+        for(int i = 0; i < 6; i++){
+            if(0 != i) macString.Append(':');
+            macString.Append_Hex(mac[i], 2);
+        }
+#if CLOUD_REPORT_ENABLED
+        aCtrl.Report_to_Cloud("production", macString.c_str());
+#else
+        Particle.publish("production", macString.c_str());
+#endif
         RGB.control(TRUE);
         RGB.color(255,105,180);
         delay(2000);
@@ -672,16 +1002,15 @@ void reportMacAddress(){
 
 
 int measureAmbient(String ambCmd){ ///////////////////////////////////////////////////////////////////////////
-    if(SENSOR_ALS_AVAILABLE && RGB.controlled() && !aCtrl.cctMode){
-        char ambientStr[10];
+    if(SENSOR_ALS_AVAILABLE && RGB.controlled() && (aCtrl.nwMode == NW_MODE_DEFAULT)){
+        FixedString<10> ambientStr;
         double val = 0;
         for(int i = 0; i < 100; i++){
             val += analogRead(PIN_SENSOR_ALS);
             delay(5);
         }
-        int ambVal = val/100;
-        sprintf(ambientStr,"%d",ambVal);
-        aCtrl.Report_to_Cloud("ambient", ambientStr);
+        ambientStr.Append_Int(val/100);
+        aCtrl.Report_to_Cloud("ambient", ambientStr.c_str()); // compiled out without CLOUD_REPORT_ENABLED
     }
     return 200;
 }
@@ -691,8 +1020,6 @@ void timeCheck(){
     if(millis() - lastTimeCheck >= TIME_CHECK_PERIOD) {
         lastTimeCheck = millis();
 
-        aCtrl.Set_TimeZone();
-
         currentTime = Time.local();
         // RAM comparison
         if(currentTime < lastTime){
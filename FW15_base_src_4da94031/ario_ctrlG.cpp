@@ -1,3 +1,4 @@
+// Generated from ArioLamp_0-2-6-15nw/ario_ctrlG.cpp by tools/generate_fw15.cmake, do not edit
 /************************************************************************************************************************************/
 /** @file       ario_ctrlG.cpp
  *  @brief      core lamp control logic, lamp programs, scheduler
@@ -16,18 +17,47 @@
 #include "globals.h"
 #include "ario_ctrlG.h"
 #include "application.h"
+#include "ario_string.h"
+#include <atomic>
+
+// Outbound messages are built in FixedString or char buffers, String would allocate on every report
+#pragma GCC poison String
 
 float LED_COLOR_Cramer[NUM_LED_CH]; // [0]: 6500K, [1]: 4000K, [2]: 1800K top, [3]: 1800K bottom
 
 // converted color mixing density for each PSoC channel accounting for Brightness Level
 byte LED_CH_Dens[NUM_LED_CH]; // to be loaded to PSoC, can be simplified here
 
-unsigned int currentSecond, lastSecond, currentDay, lastDay, programEndTime;
+// 8.8 fixed point channel intensity (register value << 8) and the sigma-delta error carried between dither ticks
+uint16_t LED_CH_Intensity[NUM_LED_CH];
+uint16_t LED_CH_DitherErr[NUM_LED_CH];
+
+// 8.8 fixed point output intensity of each whole brightness level, fractional levels are interpolated
+uint16_t LED_Gamma_LUT[MAX_BRIGHTNESS + 1];
+bool ledFrameSent = FALSE; // first frame after boot is always written, the PSoC keeps its values over an MCU reset
+
+unsigned int currentDay, lastDay;
 
 /////////////////////////// I2C Slave comm  ////////////////////////////
 byte i2cSendBuffer[NUM_BYTES_WRITE];     /* array to hold i2c data bytes (data to send) */
 byte i2cRecvBuffer[NUM_BYTES_READ];      /* array to hold i2c data bytes (data read back) */
 
+// Frames from the control logic to the output thread, which is the only user of Wire once started.
+// Single producer (application thread) / single consumer (output thread), so head and tail are each written by one side.
+struct PSoCFrame {
+    byte subAddr;
+    byte length;
+    byte data[NUM_BYTES_WRITE];
+};
+PSoCFrame outputQueue[OUTPUT_QUEUE_SIZE];
+std::atomic<uint8_t> outputHead(0), outputTail(0);
+Thread* outputThread = NULL;
+os_semaphore_t outputReady = NULL; // given once per queued frame, the output thread sleeps on it while the queue is empty
+
+// PSoC write trace, records are: dt since previous record in ms (2 bytes, little endian, saturating), sub address, length, data
+byte i2cTraceBuffer[I2C_TRACE_SIZE];
+std::atomic<uint8_t> i2cTraceRequest(I2C_TRACE_REQUEST_NONE); // posted by the application thread, taken by the output thread
+
 
 /////////////////////////////// Time of Day Look Up Tables ////////////////////////////////
 
@@ -41,26 +71,107 @@ uint16_t def_levelArry[] = {  10,  10,  10,  10,  10,  40,  //  0 -  5:59 AM
                              255, 255, 255, 255, 200, 170,  // 12 - 17:59 PM
                              130,  80,  80,  60,  30,  10 };// 18 - 23:59 PM
 
+#define HOLD_AXIS_LEVEL 0
+#define HOLD_AXIS_CCT   1
+
+/////////////////////////////// Lamp Programs ////////////////////////////////
+
+#define PROGRAM_PHASE_SETUP 0
+#define PROGRAM_PHASE_RAMP  1
+#define PROGRAM_PHASE_HOLD  2
+#define PROGRAM_PHASE_WAIT  3
+
+//                                        cct                   level               flags                   duration    hold    waitUntil
+constexpr LampSegment demoProgram[] = { { (MIN_CCT+1),          0,                  0,                      500,        0,      0 },
+                                        { MIN_CCT,              100,                0,                      1500,       0,      0 },
+                                        { CCT_1800,             100,                0,                      2000,       0,      0 },
+                                        { CCT_6500,             MAX_BRIGHTNESS,     0,                      7000,       0,      0 }, // For Demo don't use maxCCT
+                                        { CCT_1800,             MAX_BRIGHTNESS,     0,                      9000,       0,      0 },
+                                        { MIN_CCT,              MAX_BRIGHTNESS,     0,                      4000,       0,      0 },
+                                        { MIN_CCT,              MIN_BRIGHTNESS,     0,                      4000,       0,      0 },
+                                        { (MIN_CCT+1),          MIN_BRIGHTNESS,     0,                      2000,       0,      0 } };
+
+// durations scaled to the wake up alarm duration, the brightening segments move evenly in perceived lightness
+#define DAWN_SEG_FLAGS (SEG_DURATION_SCALED | SEG_CURVE(RAMP_CURVE_PERCEPTUAL))
+constexpr LampSegment dawnSimProgram[] = { { SEG_CCT_KEEP,          96,                 DAWN_SEG_FLAGS,         375,        0,      0 },
+                                           { CCT_1800,              128,                DAWN_SEG_FLAGS,         125,        0,      0 },
+                                           { SEG_CCT_MAX_LESS_ONE,  MAX_BRIGHTNESS,     DAWN_SEG_FLAGS,         500,        0,      0 },
+                                           { SEG_CCT_MAX,           MAX_BRIGHTNESS,     0,                      HALF_HOUR,  0,      0 } }; // max cct persistence
+
+// blinks three times then holds dim for the bedtime reminder duration
+constexpr LampSegment bedTimeProgram[] = { { MIN_CCT,               MAX_BRIGHTNESS/2,   0,                      2000,       0,      0 },
+                                           { MIN_CCT,               5,                  0,                      1000,       0,      0 },
+                                           { MIN_CCT,               MAX_BRIGHTNESS/2,   0,                      1000,       0,      0 },
+                                           { MIN_CCT,               5,                  0,                      1000,       0,      0 },
+                                           { MIN_CCT,               MAX_BRIGHTNESS/2,   0,                      1000,       0,      0 },
+                                           { MIN_CCT,               5,                  0,                      1000,       0,      0 },
+                                           { MIN_CCT,               MAX_BRIGHTNESS/2,   0,                      1000,       0,      0 },
+                                           { MIN_CCT,               MAX_BRIGHTNESS/10,  SEG_HOLD_SCALED,        2000,       1000,   0 },
+                                           { MIN_CCT,               MIN_BRIGHTNESS,     0,                      2000,       0,      0 } };
+
+LampSegment customProgram[PROGRAM_MAX_SEGMENTS]; // loaded from EEPROM when the uploaded program starts
+
+#define PROGRAM_LENGTH(table) (sizeof(table)/sizeof(table[0]))
+
 uint16_t loaded_cctArry[24];
 uint16_t loaded_levelArry[24]; // had to be 16-bit int to reuse LUT_ValExtractor function
 
+// Runtime state and loaded settings, kept in retained SRAM so a warm reset (watchdog, OTA, System.reset) resumes without
+// reading the PSoC or EEPROM. Time stamps are millis() of the boot that saved them and are rebased on restore.
+struct ResumeState {
+    uint32_t magic, size;                   // RESUME_MAGIC and sizeof(ResumeState), another firmware layout never matches
+    unsigned long savedAt, savedTime;       // millis() and Time.now() of the snapshot
+    bool lightIsOn, layerAlsValid, rampCCTModeDone, rampLevelModeDone;
+    uint8_t programId, dstRule, alarmCount;
+    unsigned int operatingMode, rampRegNextMode, currentVersion, programCounter, programLength, programPhase;
+    int maxCCT, alsBackgroundLevel, holdDirection, holdAxis;
+    float currentCCT, currentLevel, layerAlsOffset, holdStartPos, zoneStandard;
+    RampChannel rampCCT, rampLevel;         // done callbacks are kept as the ModeDone flags
+    unsigned long marker, programMarker, programDuration, holdStartTime, pirHoldTimeMarker;
+    uint16_t cctSchedule[24], levelSchedule[24];
+    AlarmRecord alarmTable[ALARM_TABLE_SIZE];
+#if SENSOR_PIR_AVAILABLE
+    uint8_t occupancyMap[OCCUPANCY_BYTES];
+#endif
+    uint32_t crc;                           // CRC-32 of everything above
+};
+retained ResumeState resumeState;
+
 ArioCtrl::ArioCtrl(){
     lightIsOn           = FALSE;
-    cctMode             = FALSE;
+    nwMode              = NW_MODE_DEFAULT;
     pirEnabled          = FALSE;
-    pirDebounceTimer    = millis();
-    pirDebounceFlag     = FALSE;
     pirHoldTimeMarker   = millis();
     pirOffTimer         = millis();
+#if SENSOR_PIR_AVAILABLE
+    pirDebounceTimer    = millis();
+    pirDebounceFlag     = FALSE;
     pirReportTimer      = 0;
+    memset(occupancyMap, 0, sizeof(occupancyMap));
+    occupancySlot       = -1;
+    prewarmSlot         = -1;
+    occupancySeen       = FALSE;
+    prewarmActive       = FALSE;
+    prewarmMarker       = 0;
+#endif
+#if SENSOR_ALS_AVAILABLE
     alsMeasureFlag      = TRUE;
     alsMeasureTimer     = millis();
+    alsSampleTimer      = 0;
+    alsReportTimer      = millis();
     alsMeasureCount     = 0;
     alsRunningSum       = 0;
     alsMeasuredLevel    = -1;
+#endif
     alsBackgroundLevel  = -1;
-    alsAdjustedLevel    = -1;
-    alsReportTimer      = millis();
+    layerScheduleCCT    = 0;
+    layerScheduleLevel  = 0;
+    layerAlsOffset      = 0;
+    layerAlsValid       = FALSE;
+    layersDirty         = TRUE;
+    layerScheduleStamp  = 0xFFFFFFFFUL;
+    baseCCT             = 0;
+    baseLevel           = 0;
     operatingMode       = MODE_DEFAULT;
     marker              = millis();
     programCounter      = 0;
@@ -68,35 +179,99 @@ ArioCtrl::ArioCtrl(){
     currentVersion      = 0;
     currentCCT          = 0;
     currentLevel        = 0;
-    dawnSimDuration     = 0UL;
-    bedTimeDuration     = 0UL;
-    AMalarmFlag         = TRUE;
-    PMalarmFlag         = TRUE;
+    programTable        = NULL;
+    programLength       = 0;
+    programPhase        = 0;
+    programMarker       = 0;
+    programDuration     = 0;
+    alarmCount          = 0;
+    alarmCursor         = 0;
+    alarmLastMinute     = -1;
+    zoneStandard        = DEFAULT_TIME_ZONE;
+    dstRule             = DST_RULE_NONE;
+    dstActive           = FALSE;
+    dstWindowStart      = 0;
+    dstWindowLength     = 0xFFFFFFFF;
     amAlarmNow          = FALSE;
     pmAlarmNow          = FALSE;
-    rampRegCCTStep      = 0;
-    rampRegLevelStep    = 0;
-    rampRegCounter      = 0;
-    rampRegEndCounter   = 0;
+    resumeSaveMarker    = 0;
+    resumeDisabled      = FALSE;
+    bootTracked         = FALSE;
+    for(int i = 0; i < BOOT_PHASE_COUNT; i++) bootProfile[i] = 0;
+    rampCCT.active      = FALSE;
+    rampLevel.active    = FALSE;
+    rampFrameMarker     = 0;
+    pendingCCT          = -1;
+    pendingLevel        = -1;
+    pendingCCTDuration  = APP_ADJUST_FADE_TIME;
     rampRegNextMode     = MODE_DEFAULT;
     cloudReportFlag     = FALSE;
+    holdDirection       = 0;
+    holdAxis            = HOLD_AXIS_LEVEL;
+    holdStartTime       = 0;
+    holdStartPos        = 0;
+    ditherActive        = FALSE;
+    ditherMarker        = millis();
+    ditherSettleMarker  = millis();
+    alarmStoreHeld      = FALSE;
+    clockNow            = 0;
+    clockDayNumber      = 0;
+    clockHour           = 0;
+    clockMinute         = 0;
+    clockSecond         = 0;
+    clockWeekday        = 1;
+    i2cTraceEnabled     = FALSE;
+    i2cTraceLength      = 0;
+    i2cTraceMarker      = 0;
+    i2cResendPending    = FALSE;
+    i2cWrittenMask      = 0;
+    i2cFailMarker       = 0;
+    memset(&busStats, 0, sizeof(busStats));
+    memset(benchResult, 0, sizeof(benchResult));
+    memset(benchSchedulerCycles, 0, sizeof(benchSchedulerCycles));
+    memset(benchSchedulerPasses, 0, sizeof(benchSchedulerPasses));
+    benchMuted          = FALSE;
 }
 //<<destructor>>
 ArioCtrl::~ArioCtrl(){/*nothing to destruct*/}
 
 
 void ArioCtrl::Ario_Init(void){
+    Gamma_LUT_Init();
     EzI2Cs_Init();
+    if(Resume_Restore()){ // warm reset, lamp state and settings come from retained SRAM
+        Time_Zone_Apply();
+        UART_Init();
+        Boot_Mark(BOOT_PHASE_SETTINGS);
+        Output_Thread_Start();
+        PSoC_Load_LEDVal(currentCCT, currentLevel); // first frame continues where the last boot left off
+        PSoC_onOff(lightIsOn ? 0x01 : 0x00);
+        Boot_Mark(BOOT_PHASE_FRAME_QUEUED);
+        return;
+    }
+    // Read the PSoC first, the settings load while it settles instead of in a fixed delay
+    EzI2Cs_Read(PSOC_ADDR, 0, i2cRecvBuffer, NUM_BYTES_READ);
+    unsigned long psocReadAt = millis();
+    lightIsOn = i2cRecvBuffer[0];
+    Boot_Mark(BOOT_PHASE_PSOC_READ);
     Set_TimeZone();
     Load_RTC_Schedule();
     Load_Max_CCT();
     Load_Current_Version();
+    Alarm_Table_Load();
+#if SENSOR_PIR_AVAILABLE
+    Occupancy_Load();
+#endif
     UART_Init();
+    Boot_Mark(BOOT_PHASE_SETTINGS);
+    unsigned long settled = millis() - psocReadAt;
+    if(settled < PSOC_READ_SETTLE_TIME) delay(PSOC_READ_SETTLE_TIME - settled);
     PSoC_Init();
 }
 
 
 void ArioCtrl::Load_RTC_Schedule(void){
+    layerScheduleStamp = 0xFFFFFFFFUL; // re-read the tables on the next pass
     unsigned int select = EEPROM.read(SCHEDULE_SELECT_ADDR);
     if(1 == select){
         for(int i = 0; i < 24; i++){
@@ -129,25 +304,86 @@ void ArioCtrl::Load_Current_Version(void){
     currentVersion = EEPROM.read(CURRENT_VERSION_ADDR);
 }
 
+// Wire belongs to the output thread after this. The schedule layer is sampled here so the first frame is already correct.
 void ArioCtrl::PSoC_Init(void){
+    Output_Thread_Start();
+    Layer_Schedule_Update();
     Load_RTC_Val();
-    EzI2Cs_Read(PSOC_ADDR, 0, i2cRecvBuffer, NUM_BYTES_READ);
-    lightIsOn = i2cRecvBuffer[0];
+    Boot_Mark(BOOT_PHASE_FRAME_QUEUED);
 }
 
 
-void ArioCtrl::Set_TimeZone(void){
-    unsigned int offset = 0;
-    //if((EEPROM.read(DST_AUTO_CALC_ADDR) == TRUE) && IsDST(Time.day(), Time.month(), Time.weekday())){ // if DST enabled
-    if(EEPROM.read(DST_ENABLE_ADDR) == 1){ // if DST enabled
-        offset = 1;
+// DST rule sets, indexed by DST_RULE_* - 2. Transitions fall on the week-th Sunday of the month (DST_LAST_WEEK for the
+// last one) at minute of day, in local standard time for the start and local daylight time for the end unless utc is set.
+struct DSTRule {
+    uint8_t startMonth, startWeek, endMonth, endWeek;
+    uint16_t startMinute, endMinute;
+    bool utc;
+};
+static const DSTRule dstRules[] = {
+    {  3, 2,             11, 1,             120, 120, FALSE }, // DST_RULE_US, 2nd Sunday of March to 1st Sunday of November
+    {  3, DST_LAST_WEEK, 10, DST_LAST_WEEK,  60,  60, TRUE  }, // DST_RULE_EU, last Sunday of March to last Sunday of October, 01:00 UTC
+    { 10, 1,              4, 1,             120, 180, FALSE }, // DST_RULE_AU, 1st Sunday of October to 1st Sunday of April
+    {  9, DST_LAST_WEEK,  4, 1,             120, 180, FALSE }, // DST_RULE_NZ, last Sunday of September to 1st Sunday of April
+};
+
+// days since 01-01-1970 of a civil date
+static long Days_From_Civil(int year, int month, int day){
+    year -= (month <= 2);
+    long era = (year >= 0 ? year : year - 399)/400;
+    long yearOfEra = year - era*400;
+    long dayOfYear = (153*(month + (month > 2 ? -3 : 9)) + 2)/5 + day - 1;
+    long dayOfEra = yearOfEra*365 + yearOfEra/4 - yearOfEra/100 + dayOfYear;
+    return era*146097 + dayOfEra - 719468;
+}
+
+// days since 01-01-1970 of the week-th Sunday of a month, DST_LAST_WEEK for the last one
+static long Sunday_Of_Month(int year, int month, int week){
+    long day;
+    if(DST_LAST_WEEK == week){
+        day = Days_From_Civil(year + (month == 12), (month % 12) + 1, 1) - 1;
+        return day - (day + 4) % 7; // 01-01-1970 was a Thursday
+    }
+    day = Days_From_Civil(year, month, 1);
+    return day + (7 - (day + 4) % 7) % 7 + (week - 1)*7;
+}
+
+// Finds the DST state at utc and the window of time it stays valid. Only called when utc leaves the current window,
+// so the transition instants are worked out about twice a year.
+void ArioCtrl::DST_Window_Update(unsigned long utc){
+    dstActive = (DST_RULE_FIXED == dstRule);
+    dstWindowStart = 0;
+    dstWindowLength = 0xFFFFFFFF;
+    if((DST_RULE_FIXED >= dstRule) || (DST_RULE_FIXED + sizeof(dstRules)/sizeof(dstRules[0]) < dstRule)) return;
+
+    const DSTRule* rule = &dstRules[dstRule - DST_RULE_FIXED - 1];
+    long standard = rule->utc ? 0 : (long)(zoneStandard*3600);
+    long daylight = rule->utc ? 0 : standard + 3600;
+    long days = utc/86400;
+    int year = 1970 + days/366; // at most a year short
+    while(Days_From_Civil(year + 1, 1, 1) <= days) year++;
+
+    unsigned long last = 0, next = 0xFFFFFFFF;
+    for(int y = year - 1; y <= year + 1; y++){
+        unsigned long start = Sunday_Of_Month(y, rule->startMonth, rule->startWeek)*86400 + rule->startMinute*60 - standard;
+        unsigned long end = Sunday_Of_Month(y, rule->endMonth, rule->endWeek)*86400 + rule->endMinute*60 - daylight;
+        if((start <= utc) && (start >= last)){ last = start; dstActive = TRUE; }
+        if((end <= utc) && (end >= last)){ last = end; dstActive = FALSE; }
+        if((start > utc) && (start < next)) next = start;
+        if((end > utc) && (end < next)) next = end;
     }
+    dstWindowStart = last;
+    dstWindowLength = next - last;
+}
+
+// Decodes the stored zone and DST rule, the Scheduler only checks the DST window after this
+void ArioCtrl::Set_TimeZone(void){
     // convert time zone here
     //  to calculate zone, (x+12)*4
     //  to decode zone, (y-48)/4
     float zone = EEPROM.read(USER_TIME_ZONE);
     if((zone == 0xFF) || (zone > 104)){ // If user has not set a time zone
-        zone = -6;
+        zone = DEFAULT_TIME_ZONE;
     } else{
         if(zone >= 100){ // very special time zones UTC +13 and +14
             zone = zone/4 - 36;
@@ -155,32 +391,28 @@ void ArioCtrl::Set_TimeZone(void){
             zone = (zone - 48)/4;
         }
     }
-    Time.zone(zone + offset);
+    zoneStandard = zone;
+    dstRule = EEPROM.read(DST_ENABLE_ADDR); // unknown rules behave like DST_RULE_NONE
+    Time_Zone_Apply();
 }
 
+void ArioCtrl::Time_Zone_Apply(void){
+    DST_Window_Update(Time.now());
+    Time.zone(Local_Offset());
+    Clock_Sample();
+}
 
-/*
-bool ArioCtrl::IsDST(int dayOfMonth, int month, int dayOfWeek){
-  if(month < 3 || month > 11){
-    return false;
-  }
-  if(month > 3 && month < 11){
-    return true;
-  }
-  int previousSunday = dayOfMonth - (dayOfWeek - 1); // Spark Sunday = 1
-  //In march, we are DST if our previous sunday was on or after the 8th.
-  if(month == 3){
-    return previousSunday >= 8;
-  }
-  //In November we must be before the first sunday to be dst.
-  //That means the previous sunday must be before the 1st.
-  return previousSunday <= 0;
+float ArioCtrl::Zone_Standard(void){
+    return zoneStandard;
+}
+
+float ArioCtrl::Local_Offset(void){
+    return dstActive ? zoneStandard + 1 : zoneStandard;
 }
-*/
 
 
 void ArioCtrl::Turn_Lamp_On(byte interactionType){
-    String reportStr = "";
+    const char* reportStr = "";
     pirHoldTimeMarker = millis(); // resets this timer so the light won't automatically turn off when user turns it on with app
     PSoC_Load_LEDVal(currentCCT, 0);
     PSoC_onOff(0x01);
@@ -191,21 +423,22 @@ void ArioCtrl::Turn_Lamp_On(byte interactionType){
         reportStr = "true,web";
     } else if(INTERACTION_TYPE_PIR == interactionType){
         reportStr = "true,pir";
+    } else if(INTERACTION_TYPE_PREWARM == interactionType){
+        reportStr = "true,prewarm";
     }
     Report_to_Cloud("power", reportStr);
-    if((EEPROM.read(ALS_EN_ADDR) == TRUE) && (alsAdjustedLevel != -1)){
-        RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), alsAdjustedLevel, 500UL, MODE_DEFAULT);
-    } else {
-        RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), ValExtractor_LUT24(loaded_levelArry), 500UL, MODE_DEFAULT);
-    }
+    RampTo_Base((INTERACTION_TYPE_PREWARM == interactionType) ? PREWARM_RAMP_TIME : 500UL, RAMP_CURVE_PERCEPTUAL);
 }
 
 void ArioCtrl::Turn_Lamp_Off(byte interactionType){
-    String reportStr = "";
+    const char* reportStr = "";
     pirHoldTimeMarker = millis(); // resets this timer so the light won't automatically turn off when user turns it on with app
-    //RampTo_Linear_Setup(ValExtractor_LUT24(def_cctArry), 1, 500UL, MODE_DEFAULT); //cool feature but not sure how
+    //RampTo_Setup(ValExtractor_LUT24(def_cctArry), 1, 500UL, MODE_DEFAULT); //cool feature but not sure how
     PSoC_onOff(0x00);
     lightIsOn = FALSE;
+#if SENSOR_PIR_AVAILABLE
+    prewarmActive = FALSE;
+#endif
     if(INTERACTION_TYPE_BTN == interactionType){
         pirOffTimer = millis(); // When user turns off lamp, there is enough time to leave the room before pir turn lights on ~ 1minute
         reportStr = "false,btn";
@@ -237,7 +470,7 @@ void ArioCtrl::TopButton_Action(void){ // increase level
         Light_Switch();
         delay(500); // this is a porential bug that needs to change
     } else{
-        Increase_Level();
+        Hold_Adjust(1);
     }
     pirHoldTimeMarker = millis();
 }
@@ -247,11 +480,15 @@ void ArioCtrl::MidButton_Action(void){ // decrease level
         Light_Switch();
         delay(500); // potential bug here
     } else {
-        Decrease_Level();
+        Hold_Adjust(-1);
     }
     pirHoldTimeMarker = millis();
 }
 
+void ArioCtrl::Button_Release(void){ // ends the current hold adjust
+    holdDirection = 0;
+}
+
 
 void ArioCtrl::decode_cmd(int cmd){
     debugPrint("command receiveded!");
@@ -289,158 +526,161 @@ void ArioCtrl::decode_cmd(int cmd){
 /               Adjust Mode Code
 /
 *************************************************************************************************************/
-void ArioCtrl::Increase_Level(void){
-    if(MODE_ADJUST != operatingMode){
-        operatingMode = MODE_ADJUST;
-        marker = millis();
-    } // stops other non-default mode and grabs the color/brightness setting
-    if(cctMode){ // change CCT
-        if((millis() - marker) >= 15UL){
-            if(maxCCT > currentCCT){
-                currentCCT += 20;
-                PSoC_Load_LEDVal(currentCCT, currentLevel);
-                operatingMode = MODE_ADJUST;
-                cloudReportFlag = TRUE;
-                marker = millis();
-            }
-        }
-    } else{ // change brightness (default mode)
-        if((currentCCT < CCT_1800) && (currentLevel > 254)){
-            if((millis() - marker) >= 15UL){
-                if(CCT_1800 > currentCCT){
-                    currentCCT += 20;
-                    PSoC_Load_LEDVal(currentCCT, currentLevel);
-                    operatingMode = MODE_ADJUST;
-                    cloudReportFlag = TRUE;
-                    marker = millis();
-                }
-            }
-        } else{
-            if((millis() - marker) >= ((100 > currentLevel) ? 10UL : 5UL)){
-                if(MAX_BRIGHTNESS > currentLevel){
-                    PSoC_Load_LEDVal(currentCCT, ++currentLevel);
-                    operatingMode = MODE_ADJUST;
-                    cloudReportFlag = TRUE;
-                    marker = millis();
-                }
-            }
-        }
+// CIE 1976 lightness (0-1) of a brightness level, used so a held button dims in perceptually even steps
+static float Level_To_Lightness(float level){
+    float y = level/MAX_BRIGHTNESS;
+    float lightness = (y > 0.008856) ? (116*cbrtf(y) - 16) : (903.3*y);
+    return lightness/100;
+}
+
+static float Lightness_To_Level(float lightness){
+    float l = lightness*100;
+    float y = (l > 8) ? ((l + 16)/116)*((l + 16)/116)*((l + 16)/116) : (l/903.3);
+    return y*MAX_BRIGHTNESS;
+}
+
+// fraction of a full sweep covered after holding for elapsed ms, accelerating over HOLD_ADJUST_ACCEL_TIME
+static float Hold_Sweep(unsigned long elapsed, unsigned long sweepTime){
+    float rate = 1.0/(sweepTime - HOLD_ADJUST_ACCEL_TIME/2);
+    if(elapsed < HOLD_ADJUST_ACCEL_TIME){
+        return rate*elapsed*elapsed/(2*HOLD_ADJUST_ACCEL_TIME);
     }
+    return rate*(elapsed - HOLD_ADJUST_ACCEL_TIME/2);
 }
 
-void ArioCtrl::Decrease_Level(void){
+// Called every loop while the top (direction 1) or middle (direction -1) button is held. Output follows the elapsed
+// hold time, so the adjust speed does not depend on the loop rate and the PSoC is only written when the value changes.
+void ArioCtrl::Hold_Adjust(int direction){
+    unsigned long now = millis();
     if(MODE_ADJUST != operatingMode){
         operatingMode = MODE_ADJUST;
-        //marker = millis();
     } // stops other non-default mode and grabs the color/brightness setting
-    if(cctMode){ // change CCT
-        if((millis() - marker) >= 15UL){
-            if(MIN_CCT < currentCCT){
-                currentCCT -= 20;
-                PSoC_Load_LEDVal(currentCCT, currentLevel); // there is a bug here in which the decreased CCT could be 1699 instead of 1700
-                operatingMode = MODE_ADJUST;
-                cloudReportFlag = TRUE;
-                marker = millis();
-            }
-        }
-    } else{ // change brightness (default mode)
-        if((currentCCT <= (CCT_1800 + 1)) && (MIN_CCT < currentCCT)){
-            if((millis() - marker) >= 15UL){
-                if(MIN_CCT < currentCCT){
-                    currentCCT -= 20;
-                    PSoC_Load_LEDVal(currentCCT, currentLevel);
-                    operatingMode = MODE_ADJUST;
-                    cloudReportFlag = TRUE;
-                    marker = millis();
-                }
-            }
+    rampCCT.active = FALSE;
+    rampLevel.active = FALSE;
+    pendingCCT = -1;
+    pendingLevel = -1;
+    int axis;
+    float cctLimit = maxCCT;
+    if(nwMode == NW_MODE_SET_CCT){ // change CCT
+        axis = HOLD_AXIS_CCT;
+    } else if(direction > 0){ // below 1800K the warm end continues up to 1800K once brightness is maxed
+        axis = ((currentCCT < CCT_1800) && (currentLevel > 254)) ? HOLD_AXIS_CCT : HOLD_AXIS_LEVEL;
+        cctLimit = CCT_1800;
+    } else{ // at or below 1800K the warm end goes down first
+        axis = ((currentCCT <= (CCT_1800 + 1)) && (MIN_CCT < currentCCT)) ? HOLD_AXIS_CCT : HOLD_AXIS_LEVEL;
+    }
+
+    unsigned long sweepTime = (HOLD_AXIS_CCT == axis) ? HOLD_ADJUST_CCT_SWEEP_TIME : HOLD_ADJUST_SWEEP_TIME;
+    float range = (HOLD_AXIS_CCT == axis) ? (CCT_6500 - MIN_CCT) : 1;
+    if((direction != holdDirection) || (axis != holdAxis)){
+        holdStartPos = (HOLD_AXIS_CCT == axis) ? currentCCT : Level_To_Lightness(currentLevel);
+        if(direction == holdDirection){ // switched axis mid hold, carry on at full speed
+            holdStartTime = now - HOLD_ADJUST_ACCEL_TIME;
+            holdStartPos -= direction*range*Hold_Sweep(HOLD_ADJUST_ACCEL_TIME, sweepTime);
         } else{
-            if((millis() - marker) >= ((100 > currentLevel) ? 5UL : 10UL)){
-                if((MIN_BRIGHTNESS + 3) < currentLevel){
-                    PSoC_Load_LEDVal(currentCCT, --currentLevel);
-                    operatingMode = MODE_ADJUST;
-                    cloudReportFlag = TRUE;
-                    marker = millis();
-                }
-            }
+            holdStartTime = now;
         }
-
+        holdDirection = direction;
+        holdAxis = axis;
     }
+    float target = holdStartPos + direction*range*Hold_Sweep(now - holdStartTime, sweepTime);
+
+    if(HOLD_AXIS_CCT == axis){
+        target = constrain(target, MIN_CCT, cctLimit);
+        float newCCT = (direction > 0) ? floorf(target/HOLD_ADJUST_CCT_STEP) : ceilf(target/HOLD_ADJUST_CCT_STEP);
+        newCCT = constrain(newCCT*HOLD_ADJUST_CCT_STEP, MIN_CCT, cctLimit);
+        if((direction > 0) ? (newCCT <= currentCCT) : (newCCT >= currentCCT)) return;
+        PSoC_Load_LEDVal(newCCT, currentLevel);
+    } else{
+        float newLevel = Lightness_To_Level(target);
+        newLevel = (direction > 0) ? floorf(newLevel) : ceilf(newLevel);
+        newLevel = constrain(newLevel, (MIN_BRIGHTNESS + 3), MAX_BRIGHTNESS);
+        if((direction > 0) ? (newLevel <= currentLevel) : (newLevel >= currentLevel)) return;
+        PSoC_Load_LEDVal(currentCCT, newLevel);
+    }
+    cloudReportFlag = TRUE;
+    marker = millis();
 }
 
 void ArioCtrl::Increase_Brightness_App(void){
-    if(currentLevel < MAX_BRIGHTNESS){ // this might be redundant
+    float level = Level_Target();
+    if(level < MAX_BRIGHTNESS){ // this might be redundant
         float destLevel;
-        if(currentLevel > 200){
+        if(level > 200){
             destLevel = MAX_BRIGHTNESS;
-        } else if(currentLevel > 150){
-            destLevel = currentLevel + 70;
-        } else if(currentLevel > 80){
-            destLevel = currentLevel + 50;
-        } else if(currentLevel > 30){
-            destLevel = currentLevel + 30;
+        } else if(level > 150){
+            destLevel = level + 70;
+        } else if(level > 80){
+            destLevel = level + 50;
+        } else if(level > 30){
+            destLevel = level + 30;
         } else{
-            destLevel = currentLevel + 10;
+            destLevel = level + 10;
         }
         marker = millis();
         //cloudReportFlag = TRUE;//////////////////////////////////////////
-        RampTo_Linear_Setup(currentCCT, destLevel, 500UL, MODE_ADJUST);
+        pendingLevel = destLevel;
     }
 }
 
 void ArioCtrl::Decrease_Brightness_App(void){
-    if(currentLevel > (MIN_BRIGHTNESS + 2)){ // this might be redundant
+    float level = Level_Target();
+    if(level > (MIN_BRIGHTNESS + 2)){ // this might be redundant
         float destLevel;
-        if(currentLevel < 20){
+        if(level < 20){
             destLevel = (MIN_BRIGHTNESS + 2);
-        } else if(currentLevel < 50){
-            destLevel = currentLevel - 15;
-        } else if(currentLevel < 80){
-            destLevel = currentLevel - 30;
-        } else if(currentLevel < 170){
-            destLevel = currentLevel - 50;
+        } else if(level < 50){
+            destLevel = level - 15;
+        } else if(level < 80){
+            destLevel = level - 30;
+        } else if(level < 170){
+            destLevel = level - 50;
         } else{
-            destLevel = currentLevel - 70;
+            destLevel = level - 70;
         }
         marker = millis();
         //cloudReportFlag = TRUE;/////////////////////////////////////////////
-        RampTo_Linear_Setup(currentCCT, destLevel, 500UL, MODE_ADJUST);
+        pendingLevel = destLevel;
     }
 }
 
 void ArioCtrl::Increase_CCT_App(void){
-    if(currentCCT < maxCCT){ // this might be redundant
+    float cct = CCT_Target();
+    if(cct < maxCCT){ // this might be redundant
         float destCCT;
-        if(currentCCT > (maxCCT - 1500)){
+        if(cct > (maxCCT - 1500)){
             destCCT = maxCCT;
         } else{
-            destCCT = currentCCT + 1000;
+            destCCT = cct + 1000;
         }
         marker = millis();
         //cloudReportFlag = TRUE;/////////////////////////////////////////////
-        RampTo_Linear_Setup(destCCT, currentLevel, 500UL, MODE_ADJUST);
+        pendingCCT = destCCT;
+        pendingCCTDuration = APP_ADJUST_FADE_TIME;
     }
 }
 
 void ArioCtrl::Decrease_CCT_App(void){
-    if(currentCCT > MIN_CCT){ // this might be redundant
+    float cct = CCT_Target();
+    if(cct > MIN_CCT){ // this might be redundant
         float destCCT;
-        if(currentCCT < 500){
+        if(cct < 500){
             destCCT = MIN_CCT;
-        } else if(currentCCT < CCT_1800){
-            destCCT = currentCCT - 750;
-        } else if(currentCCT < 2100){
-            destCCT = currentCCT - 750;
-        } else if(currentCCT < 3000){
-            destCCT = currentCCT - 750;
-        } else if(currentCCT < 5000){
-            destCCT = currentCCT - 700;
+        } else if(cct < CCT_1800){
+            destCCT = cct - 750;
+        } else if(cct < 2100){
+            destCCT = cct - 750;
+        } else if(cct < 3000){
+            destCCT = cct - 750;
+        } else if(cct < 5000){
+            destCCT = cct - 700;
         } else{
-            destCCT = currentCCT - 700;
+            destCCT = cct - 700;
         }
         marker = millis();
         //cloudReportFlag = TRUE;/////////////////////////////////////////////
-        RampTo_Linear_Setup(destCCT, currentLevel, 500UL, MODE_ADJUST);
+        pendingCCT = destCCT;
+        pendingCCTDuration = APP_ADJUST_FADE_TIME;
     }
 }
 
@@ -451,17 +691,40 @@ void ArioCtrl::Set_Brightness(unsigned int brightness){
         brightness = 2;
     }
     marker = millis();
-    RampTo_Linear_Setup(currentCCT, brightness, 500UL, MODE_ADJUST);
+    pendingLevel = brightness;
 }
 
 void ArioCtrl::Set_CCT(unsigned int cct){
     cct = constrain(cct, MIN_CCT, maxCCT);
     unsigned long delayVal = 500UL;
-    int cctDiff = currentCCT - cct;
+    int cctDiff = CCT_Target() - cct;
     if(abs(cctDiff) > 2000){ delayVal = 1000UL; }
     if(abs(cctDiff) > 3000){ delayVal = 1500UL; }
     marker = millis();
-    RampTo_Linear_Setup(cct, currentLevel, delayVal, MODE_ADJUST);
+    pendingCCT = cct;
+    pendingCCTDuration = delayVal;
+}
+
+// where the lamp is heading, so relative app commands stack up instead of restarting from a mid-ramp value
+float ArioCtrl::CCT_Target(void){
+    if(-1 != pendingCCT) return pendingCCT;
+    return rampCCT.active ? rampCCT.dest : currentCCT;
+}
+
+float ArioCtrl::Level_Target(void){
+    if(-1 != pendingLevel) return pendingLevel;
+    return rampLevel.active ? rampLevel.dest : currentLevel;
+}
+
+// Drives the last app adjustment received, called once per Scheduler pass so a burst of commands becomes one retarget
+void ArioCtrl::App_Adjust_Apply(void){
+    if((-1 == pendingCCT) && (-1 == pendingLevel)) return;
+    rampRegNextMode = MODE_ADJUST;
+    operatingMode = MODE_RAMP;
+    if(-1 != pendingCCT) RampTo_CCT(pendingCCT, pendingCCTDuration, RAMP_CURVE_LINEAR, &ArioCtrl::Ramp_Mode_Done);
+    if(-1 != pendingLevel) RampTo_Level(pendingLevel, APP_ADJUST_FADE_TIME, RAMP_CURVE_LINEAR, &ArioCtrl::Ramp_Mode_Done);
+    pendingCCT = -1;
+    pendingLevel = -1;
 }
 
 
@@ -470,147 +733,298 @@ void ArioCtrl::Set_CCT(unsigned int cct){
 /               Different Lamp Programs Code
 /
 *************************************************************************************************************/
-void ArioCtrl::RampTo_Linear_Setup(float destCCT, float destLevel, unsigned long duration, int nextMode){
-    float stepSize = duration/RAMP_DELAY;
-    if(!((CCT_6500 < destCCT)||(MIN_CCT > destCCT))){ // if value not out of bound
-        rampRegCCTStep = (destCCT-currentCCT)/stepSize;
-    } else{
-        rampRegCCTStep = 0;
+// Ramp curve tables, 33 points of a 0-65535 output over 0-65535 progress, interpolated in between
+static const uint16_t rampExpLUT[33] = {     0,   395,   827,  1297,  1810,  2369,  2979,  3644,  4369,  5160,  6022,
+                                          6963,  7988,  9107, 10327, 11657, 13107, 14689, 16414, 18295, 20346, 22583,
+                                         25022, 27682, 30583, 33746, 37196, 40958, 45061, 49534, 54413, 59733, 65535 };
+
+// relative luminance of CIE lightness, so a lightness ramp needs no pow() per tick
+static const uint16_t rampLightnessLUT[33] = {   0,   227,   453,   686,   972,  1328,  1762,  2281,  2894,  3607,  4429,
+                                              5367,  6429,  7623,  8956, 10436, 12071, 13868, 15835, 17980, 20310, 22833,
+                                             25558, 28490, 31639, 35012, 38616, 42460, 46550, 50895, 55503, 60380, 65535 };
+
+static uint32_t Ramp_LUT(const uint16_t* lut, uint32_t x){
+    uint32_t idx = x >> 11;
+    uint32_t frac = x & 0x7FF;
+    return lut[idx] + (((lut[idx + 1] - lut[idx])*frac) >> 11);
+}
+
+// eased Q16 progress (0-65535) of linear Q16 progress p
+static uint32_t Ramp_Ease(int curve, uint32_t p){
+    if((RAMP_CURVE_EASE == curve) || (RAMP_CURVE_HERMITE == curve)){
+        return (uint32_t)(((uint64_t)p*p*(3*65536UL - 2*p)) >> 32); // 3p^2 - 2p^3
+    } else if(RAMP_CURVE_EXP == curve){
+        return Ramp_LUT(rampExpLUT, p);
+    }
+    return p;
+}
+
+// value of a channel after elapsed ms
+static float Ramp_Channel_Value(const RampChannel* ch, unsigned long elapsed){
+    if(elapsed >= ch->duration) return ch->dest;
+    if(RAMP_CURVE_LINEAR == ch->curve) return ch->start + ch->slope*elapsed; // one multiply and add, close to the old fixed step
+    uint32_t p = ((uint64_t)elapsed*ch->progressRecip) >> 16;
+    if(65535 < p) p = 65535;
+    float v = ch->start + ch->delta*Ramp_Ease(ch->curve, p)*(1.0f/65536);
+    if(RAMP_CURVE_HERMITE == ch->curve){ // cubic Hermite with end slope 0: smoothstep plus slope * t(1-t)^2
+        uint32_t q = 65536 - p;
+        v += ch->slope*(uint32_t)(((uint64_t)p*q*q) >> 32)*(1.0f/65536);
+    } else if(RAMP_CURVE_PERCEPTUAL == ch->curve){
+        uint32_t lightness = (v > 0) ? (uint32_t)v : 0;
+        if(65535 < lightness) lightness = 65535;
+        v = Ramp_LUT(rampLightnessLUT, lightness)*((float)MAX_BRIGHTNESS/65535);
+    }
+    return v;
+}
+
+// Starts a ramp from the current value. If the channel is already moving it keeps its velocity and blends into the
+// new target instead of restarting from rest, so bursts of app commands do not stutter.
+static void Ramp_Channel_Start(RampChannel* ch, float from, float to, unsigned long duration, int curve, RampDoneCallback done){
+    unsigned long now = millis();
+    float slope = 0;
+    if(ch->active && (0 != duration)){
+        unsigned long elapsed = now - ch->startTime;
+        from = Ramp_Channel_Value(ch, elapsed);
+        if((elapsed >= RAMP_RETARGET_SLOPE_TIME) && (elapsed < ch->duration)){
+            slope = (from - Ramp_Channel_Value(ch, elapsed - RAMP_RETARGET_SLOPE_TIME))*duration/RAMP_RETARGET_SLOPE_TIME;
+        }
+        float delta = to - from;
+        if(slope*delta < 0){ // reversing, start from rest rather than overshooting the start
+            slope = 0;
+        } else if(fabsf(slope) > fabsf(3*delta)){ // beyond 3x the curve overshoots the target
+            slope = 3*delta;
+        }
+        curve = RAMP_CURVE_HERMITE;
     }
-    if(!((MAX_BRIGHTNESS < destLevel)||(MIN_BRIGHTNESS > destLevel))){ // if value not out of bound
-        rampRegLevelStep = (destLevel-currentLevel)/stepSize;
+    ch->curve = curve;
+    ch->dest = to;
+    ch->slope = slope;
+    if(RAMP_CURVE_PERCEPTUAL == curve){ // level only, start and delta are Q16 lightness
+        ch->start = Level_To_Lightness(from)*65535;
+        ch->delta = Level_To_Lightness(to)*65535 - ch->start;
     } else{
-        rampRegLevelStep = 0;
+        ch->start = from;
+        ch->delta = to - from;
+    }
+    ch->startTime = now;
+    ch->duration = duration;
+    ch->progressRecip = duration ? 0xFFFFFFFFUL/duration : 0; // zero length ramps land on the next tick
+    if(RAMP_CURVE_LINEAR == curve) ch->slope = duration ? ch->delta/duration : 0;
+    ch->done = done;
+    ch->active = TRUE;
+}
+
+// Output is computed from the elapsed time, so a stalled loop skips frames instead of stretching the ramp.
+// Returns TRUE when the channel has just landed on its destination.
+static bool Ramp_Channel_Eval(RampChannel* ch, unsigned long now, float* value){
+    unsigned long elapsed = now - ch->startTime;
+    *value = Ramp_Channel_Value(ch, elapsed);
+    if(elapsed >= ch->duration){
+        ch->active = FALSE;
+        return TRUE;
     }
-    rampRegEndCounter = (int)stepSize;
+    return FALSE;
+}
+
+void ArioCtrl::RampTo_CCT(float destCCT, unsigned long duration, int curve, RampDoneCallback done){
+    if((CCT_6500 < destCCT)||(MIN_CCT > destCCT)) return;
+    if(RAMP_CURVE_PERCEPTUAL == curve) curve = RAMP_CURVE_LINEAR; // lightness only applies to level
+    Ramp_Channel_Start(&rampCCT, currentCCT, destCCT, duration, curve, done);
+}
+
+void ArioCtrl::RampTo_Level(float destLevel, unsigned long duration, int curve, RampDoneCallback done){
+    if((MAX_BRIGHTNESS < destLevel)||(MIN_BRIGHTNESS > destLevel)) return;
+    Ramp_Channel_Start(&rampLevel, currentLevel, destLevel, duration, curve, done);
+}
+
+// Ramps both channels over the same duration. An out of bound destination leaves that channel alone, a ramp already
+// running on it keeps its own timeline, an idle one holds its value for the duration so program segments keep their length.
+void ArioCtrl::RampTo_Setup(float destCCT, float destLevel, unsigned long duration, int nextMode, int curve){
+    RampDoneCallback done = NULL;
     if(-1 != nextMode){ // used specifically for special program
         rampRegNextMode = nextMode;
         operatingMode = MODE_RAMP;
+        done = &ArioCtrl::Ramp_Mode_Done;
+    }
+    if(!((CCT_6500 < destCCT)||(MIN_CCT > destCCT))){
+        RampTo_CCT(destCCT, duration, curve, done);
+    } else if(!rampCCT.active){ // idle, so this is a plain hold
+        Ramp_Channel_Start(&rampCCT, currentCCT, currentCCT, duration, RAMP_CURVE_LINEAR, done);
+    } else if(NULL != done){
+        rampCCT.done = done;
+    }
+    if(!((MAX_BRIGHTNESS < destLevel)||(MIN_BRIGHTNESS > destLevel))){
+        RampTo_Level(destLevel, duration, curve, done);
+    } else if(!rampLevel.active){
+        Ramp_Channel_Start(&rampLevel, currentLevel, currentLevel, duration, RAMP_CURVE_LINEAR, done);
+    } else if(NULL != done){
+        rampLevel.done = done;
     }
-    rampRegCounter = 0;
 }
 
-bool ArioCtrl::RampTo_Linear_Playing(void){
-    if(rampRegEndCounter == rampRegCounter){
-        return FALSE;
-    } else{
-        if(millis() - marker >= RAMP_DELAY){
-            PSoC_Load_LEDVal(currentCCT+=rampRegCCTStep, currentLevel+=rampRegLevelStep);
-            rampRegCounter ++;
-            marker = millis();
-        }
-        return TRUE;
+// bit 0 CCT ramp running, bit 1 level ramp running
+uint8_t ArioCtrl::Ramp_State(void){
+    return (rampCCT.active ? 0x01 : 0x00) | (rampLevel.active ? 0x02 : 0x00);
+}
+
+bool ArioCtrl::RampTo_Playing(void){
+    return rampCCT.active || rampLevel.active;
+}
+
+// Called every Scheduler pass, evaluates both channels and writes them to the PSoC as one frame
+void ArioCtrl::Ramp_Tick(void){
+    if(!RampTo_Playing()) return;
+    unsigned long now = millis();
+    bool landing = (rampCCT.active && (now - rampCCT.startTime >= rampCCT.duration)) ||
+                   (rampLevel.active && (now - rampLevel.startTime >= rampLevel.duration));
+    if(!landing && (now - rampFrameMarker < RAMP_DELAY)) return;
+    bool cctDone = rampCCT.active && Ramp_Channel_Eval(&rampCCT, now, &currentCCT);
+    bool levelDone = rampLevel.active && Ramp_Channel_Eval(&rampLevel, now, &currentLevel);
+    PSoC_Load_LEDVal(currentCCT, currentLevel);
+    rampFrameMarker = now;
+    marker = now;
+    if(cctDone && (NULL != rampCCT.done)) (this->*rampCCT.done)();
+    if(levelDone && (NULL != rampLevel.done)) (this->*rampLevel.done)();
+}
+
+void ArioCtrl::Ramp_Mode_Done(void){
+    if((MODE_RAMP == operatingMode) && !RampTo_Playing()){
+        operatingMode = rampRegNextMode;
     }
 }
 
 void ArioCtrl::Demo_Init(void){
     operatingMode = MODE_DEMO;
-    programCounter = 0;
     PSoC_Load_LEDVal(MIN_CCT, 0);
+    Program_Start(demoProgram, PROGRAM_LENGTH(demoProgram), 0);
 }
 
-bool ArioCtrl::Demo_Playing(void){
-    if(0 == programCounter){
-        RampTo_Linear_Setup((MIN_CCT+1), 0, 500UL, -1); programCounter++;
-    } else if(1 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, 100, 1500UL, -1); programCounter++; }
-    } else if(2 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(CCT_1800, 100, 2000UL, -1); programCounter++; }
-    } else if(3 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(CCT_6500, MAX_BRIGHTNESS, 7000UL, -1); programCounter++; } // For Demo don't use maxCCT
-    } else if(4 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(CCT_1800, MAX_BRIGHTNESS, 9000UL, -1); programCounter++; }
-    } else if(5 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, MAX_BRIGHTNESS, 4000UL, -1); programCounter++; }
-    } else if(6 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, MIN_BRIGHTNESS, 4000UL, -1); programCounter++; }
-    } else if(7 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup((MIN_CCT+1), MIN_BRIGHTNESS, 2000UL, -1); programCounter++; }
-    } else if(8 == programCounter){
-        if(!RampTo_Linear_Playing()) programCounter++;
-    }
-    if(8 < programCounter){
-        programCounter = 0;
-        return FALSE;
-    } else{
-        return TRUE;
-    }
-}
-
-void ArioCtrl::DawnSim_Init(void){
+void ArioCtrl::DawnSim_Init(unsigned int duration, uint8_t program){
     operatingMode = MODE_DAWNSIM;
-    dawnSimDuration = EEPROM.read(WAKEUP_ALARM_DURATION_BASE_ADDR + Time.weekday())*ONE_MINUTE;
     PSoC_Load_LEDVal(MIN_CCT, 1);
-    programCounter = 0;
+    Program_Start(dawnSimProgram, PROGRAM_LENGTH(dawnSimProgram), duration*ONE_MINUTE);
     PSoC_onOff(0x01);
     lightIsOn = TRUE;
+    if(ALARM_PROGRAM_CUSTOM == program) Program_Init(); // stays on the dawn simulation if nothing was uploaded
     Cloud_Debug_Print("Wake Up Alarm begins.");
     Report_to_Cloud("power", "true,alarm");
 }
 
-bool ArioCtrl::DawnSim_Playing(void){
-    if(0 == programCounter){
-        RampTo_Linear_Setup(0, MAX_BRIGHTNESS*0.375, dawnSimDuration*0.375, -1); programCounter++;
-    } else if(1 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(CCT_1800, MAX_BRIGHTNESS*0.5, dawnSimDuration*0.125, -1); programCounter++; }
-    } else if(2 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup((maxCCT - 1), MAX_BRIGHTNESS, dawnSimDuration*0.5, -1); programCounter++; }
-    } else if(3 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(maxCCT, MAX_BRIGHTNESS, HALF_HOUR, -1); programCounter++; } // One hour of max cct persistence
-    } else if(4 == programCounter){
-        if(!RampTo_Linear_Playing()) programCounter++;
-    }
-    if(4 < programCounter){
-        pirHoldTimeMarker = millis(); // so the lamp does not turn off abruptly right after the program ends
-        programCounter = 0;
+void ArioCtrl::BedTime_Init(unsigned int duration, uint8_t program){
+    operatingMode = MODE_BEDTIME;
+    Program_Start(bedTimeProgram, PROGRAM_LENGTH(bedTimeProgram), duration*ONE_MINUTE);
+    if(ALARM_PROGRAM_CUSTOM == program) Program_Init();
+    Cloud_Debug_Print("Bedtime Reminder begins.");
+}
+
+void ArioCtrl::BedTime_End(void){
+    //Turn_Lamp_Off();
+    PSoC_onOff(0x00);
+    lightIsOn = FALSE;
+    pirOffTimer = millis(); // When user turns off lamp, there is enough time to leave the room before pir turn lights on ~ 1minute
+    Report_to_Cloud("power", "false,bed");
+}
+
+// Starts the uploaded program, only works if light is turned on and a program has been uploaded
+bool ArioCtrl::Program_Init(void){
+    if(!lightIsOn || !Program_Load()){
         return FALSE;
-    } else{
-        return TRUE;
     }
+    operatingMode = MODE_PROGRAM;
+    Program_Start(customProgram, programLength, 0);
+    return TRUE;
 }
 
-void ArioCtrl::BedTime_Init(void){
-    operatingMode = MODE_BEDTIME;
-    bedTimeDuration = EEPROM.read(BEDTIME_ALARM_DURATION_BASE_ADDR + Time.weekday())*60;
-    programCounter = 0;
-    Cloud_Debug_Print("Bedtime Reminder begins.");
+// Reads the uploaded program into customProgram and programLength, FALSE if none was uploaded
+bool ArioCtrl::Program_Load(void){
+    unsigned int length = EEPROM.read(CUSTOM_PROGRAM_LENGTH_ADDR);
+    if((0 == length) || (PROGRAM_MAX_SEGMENTS < length)){
+        return FALSE;
+    }
+    for(unsigned int i = 0; i < length; i++){
+        int addr = CUSTOM_PROGRAM_BASE_ADDR + i*PROGRAM_SEGMENT_BYTES;
+        EEPROM.get(addr, customProgram[i].cct);
+        customProgram[i].level = EEPROM.read(addr + 2);
+        customProgram[i].flags = EEPROM.read(addr + 3);
+        EEPROM.get(addr + 4, customProgram[i].duration);
+        EEPROM.get(addr + 8, customProgram[i].hold);
+        EEPROM.get(addr + 12, customProgram[i].waitUntil);
+    }
+    programLength = length;
+    return TRUE;
 }
 
-bool ArioCtrl::BedTime_Playing(void){
-    if(0 == programCounter){
-        RampTo_Linear_Setup(MIN_CCT, MAX_BRIGHTNESS/2, 2000UL, -1); programCounter++; /*Serial.println("Bedtime alarm begins");*/
-    } else if(1 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, 5, 1000UL, -1); programCounter++; }
-    } else if(2 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, MAX_BRIGHTNESS/2, 1000UL, -1); programCounter++; }
-    } else if(3 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, 5, 1000UL, -1); programCounter++; }
-    } else if(4 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, MAX_BRIGHTNESS/2, 1000UL, -1); programCounter++; }
-    } else if(5 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, 5, 1000UL, -1); programCounter++; }
-    } else if(6 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, MAX_BRIGHTNESS/2, 1000UL, -1); programCounter++; }
-    } else if(7 == programCounter){
-        if(!RampTo_Linear_Playing()){ RampTo_Linear_Setup(MIN_CCT, MAX_BRIGHTNESS/10, 2000UL, -1); programCounter++; /*Serial.println("Bedtime Phase 2"); Serial.println(Time.timeStr());*/ }
-    } else if(8 == programCounter){
-        if(!RampTo_Linear_Playing()){ programEndTime = Time.now() + bedTimeDuration; programCounter++; /*Serial.println("Bedtime Phase 3"); Serial.println(Time.timeStr());*/ }
-    } else if(9 == programCounter){
-        if(Time.now() >= programEndTime){ RampTo_Linear_Setup(MIN_CCT, MIN_BRIGHTNESS, 2000UL, -1); programCounter++; /*Serial.println("Bedtime Phase 4"); Serial.println(Time.timeStr());*/ } //60000UL one minute
-    } else if(10 == programCounter){
-        if(!RampTo_Linear_Playing()) programCounter++;
-    }
-    if(10 < programCounter){
-        //Turn_Lamp_Off();
-        PSoC_onOff(0x00);
-        lightIsOn = FALSE;
-        pirOffTimer = millis(); // When user turns off lamp, there is enough time to leave the room before pir turn lights on ~ 1minute
-        programCounter = 0;
-        Report_to_Cloud("power", "false,bed");
+// Stores one segment of the uploaded program, hex is PROGRAM_SEGMENT_BYTES packed little endian as in LampSegment
+// decodes length bytes from 2*length hex digits, FALSE on a non hex digit
+static bool Hex_Decode(const char* hex, byte* out, unsigned int length){
+    for(unsigned int i = 0; i < length; i++){
+        char pair[3] = { hex[i*2], hex[i*2 + 1], 0 };
+        char* end;
+        out[i] = strtoul(pair, &end, 16);
+        if(*end != 0) return FALSE;
+    }
+    return TRUE;
+}
+
+bool ArioCtrl::Program_Upload_Segment(unsigned int index, const char* hex){
+    if((PROGRAM_MAX_SEGMENTS <= index) || (strlen(hex) != PROGRAM_SEGMENT_BYTES*2)){
         return FALSE;
-    } else{
-        return TRUE;
     }
+    byte segment[PROGRAM_SEGMENT_BYTES];
+    if(!Hex_Decode(hex, segment, PROGRAM_SEGMENT_BYTES)) return FALSE;
+    for(int i = 0; i < PROGRAM_SEGMENT_BYTES; i++){
+        Setting_Write(CUSTOM_PROGRAM_BASE_ADDR + index*PROGRAM_SEGMENT_BYTES + i, segment[i]);
+    }
+    return TRUE;
+}
+
+void ArioCtrl::Program_Set_Length(unsigned int length){
+    Setting_Write(CUSTOM_PROGRAM_LENGTH_ADDR, (PROGRAM_MAX_SEGMENTS < length) ? PROGRAM_MAX_SEGMENTS : length);
+}
+
+void ArioCtrl::Program_Start(const LampSegment* table, unsigned int length, unsigned long duration){
+    programTable = table;
+    programLength = length;
+    programDuration = duration;
+    programCounter = 0;
+    programPhase = PROGRAM_PHASE_SETUP;
+}
+
+unsigned long ArioCtrl::Segment_Time(uint32_t value, bool scaled){
+    return scaled ? (programDuration/1000)*value : value;
+}
+
+// Runs the active program table one segment at a time, returns FALSE once the last segment is done
+bool ArioCtrl::Program_Playing(void){
+    while(programCounter < programLength){
+        const LampSegment* seg = &programTable[programCounter];
+        if(PROGRAM_PHASE_SETUP == programPhase){
+            float destCCT = seg->cct;
+            if(SEG_CCT_MAX == seg->cct){
+                destCCT = maxCCT;
+            } else if(SEG_CCT_MAX_LESS_ONE == seg->cct){
+                destCCT = maxCCT - 1;
+            }
+            float destLevel = (seg->flags & SEG_LEVEL_KEEP) ? -1 : seg->level;
+            RampTo_Setup(destCCT, destLevel, Segment_Time(seg->duration, seg->flags & SEG_DURATION_SCALED), -1,
+                         (seg->flags & SEG_CURVE_MASK) >> SEG_CURVE_SHIFT);
+            programPhase = PROGRAM_PHASE_RAMP;
+            return TRUE;
+        } else if(PROGRAM_PHASE_RAMP == programPhase){
+            if(RampTo_Playing()) return TRUE;
+            programMarker = millis();
+            programPhase = PROGRAM_PHASE_HOLD;
+        } else if(PROGRAM_PHASE_HOLD == programPhase){
+            if(millis() - programMarker < Segment_Time(seg->hold, seg->flags & SEG_HOLD_SCALED)) return TRUE;
+            programPhase = PROGRAM_PHASE_WAIT;
+        } else{
+            if((seg->flags & SEG_WAIT_UNTIL) && ((clockHour*60 + clockMinute) != seg->waitUntil)) return TRUE;
+            programCounter++;
+            programPhase = PROGRAM_PHASE_SETUP;
+        }
+    }
+    programCounter = 0;
+    return FALSE;
 }
 
 /*************************************************************************************************************
@@ -619,20 +1033,28 @@ bool ArioCtrl::BedTime_Playing(void){
 /
 *************************************************************************************************************/
 void ArioCtrl::Scheduler(void){
+    uint32_t passStart = System.ticks();
+    int passMode = operatingMode;
+    Clock_Sample();
+    Layer_Schedule_Update();
     if(!lightIsOn){
         operatingMode = MODE_DEFAULT; programCounter = 0; // this might be important for AM Alarm, might not
     }
 
-    Check_Wake_Alarm();
-
-    Check_Bedtime_Reminder();
+    Check_Alarms();
 
     Check_PIR_Schedule();
+#if SENSOR_PIR_AVAILABLE
+    Occupancy_Tick();
+#endif
 
     //Check_WiFi_Schedule();
 
+    App_Adjust_Apply();
+    Ramp_Tick();
+
     if(MODE_RAMP == operatingMode){
-        if(!RampTo_Linear_Playing()){
+        if(!RampTo_Playing()){ // normally left through Ramp_Mode_Done, this catches a cancelled ramp
             operatingMode = rampRegNextMode;
         }
     }else if(MODE_ADJUST == operatingMode){
@@ -640,42 +1062,31 @@ void ArioCtrl::Scheduler(void){
         // Reports ONLY physical lamp adjustment to cloud (cloud initiated adjustments do not count)
         if((millis()-marker >= CLOUD_REPORT_DELAY) && cloudReportFlag){
             cloudReportFlag = FALSE;
-            char publishString1[20];
-            char publishString2[20];
-            sprintf(publishString1,"%d,btn", (int)currentLevel);
-            sprintf(publishString2,"%d,btn", (int)currentCCT);
-            Report_to_Cloud("brightness", publishString1);
-            Report_to_Cloud("color", publishString2);
+            FixedString<20> publishString1, publishString2;
+            publishString1.Append_Int(currentLevel).Append(",btn");
+            publishString2.Append_Int(currentCCT).Append(",btn");
+            Report_to_Cloud("brightness", publishString1.c_str());
+            Report_to_Cloud("color", publishString2.c_str());
         }
         // if user adjusted Max CCT, this needs to change if current CCT > Max CCT
         if(currentCCT > maxCCT){ PSoC_Load_LEDVal(maxCCT, currentLevel); }
         unsigned int holdTime = EEPROM.read(HOLD_TIME_DURTION_ADDR);
         if(holdTime == 0xFF){ holdTime = FACTORY_HOLD_TIME; }
         if(millis()-marker >= (ONE_MINUTE*holdTime)){
-            if((EEPROM.read(ALS_EN_ADDR) == TRUE) && (alsAdjustedLevel != -1)){
-                RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), alsAdjustedLevel, MODE_CHANGE_FADE_TIME, MODE_DEFAULT);
-            } else {
-                RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), ValExtractor_LUT24(loaded_levelArry), MODE_CHANGE_FADE_TIME, MODE_DEFAULT);
-            }
+            RampTo_Base(MODE_CHANGE_FADE_TIME);
         }
-    } else if(MODE_DEMO == operatingMode){
-        if(!Demo_Playing()){
-            if((EEPROM.read(ALS_EN_ADDR) == TRUE) && (alsAdjustedLevel != -1)){
-                RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), alsAdjustedLevel, 1000UL, MODE_DEFAULT);
-            } else {
-                RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), ValExtractor_LUT24(loaded_levelArry), 1000UL, MODE_DEFAULT);
-            }
+    } else if((MODE_DEMO == operatingMode) || (MODE_PROGRAM == operatingMode)){
+        if(!Program_Playing()){
+            RampTo_Base(1000UL);
         }
     } else if(MODE_DAWNSIM == operatingMode){
-        if(!DawnSim_Playing()){
-            if((EEPROM.read(ALS_EN_ADDR) == TRUE) && (alsAdjustedLevel != -1)){
-                RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), alsAdjustedLevel, MODE_CHANGE_FADE_TIME, MODE_DEFAULT);
-            } else {
-                RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), ValExtractor_LUT24(loaded_levelArry), MODE_CHANGE_FADE_TIME, MODE_DEFAULT);
-            }
+        if(!Program_Playing()){
+            pirHoldTimeMarker = millis(); // so the lamp does not turn off abruptly right after the program ends
+            RampTo_Base(MODE_CHANGE_FADE_TIME);
         }
     } else if(MODE_BEDTIME == operatingMode){
-        if(!BedTime_Playing()){
+        if(!Program_Playing()){
+            BedTime_End();
             operatingMode = MODE_DEFAULT;
         }
     } else{ // default case: operatingMode = MODE_DEFAULT or other unassigned modes
@@ -683,6 +1094,209 @@ void ArioCtrl::Scheduler(void){
         Load_RTC_Val();
         Daily_Subroutine();
     }
+
+    if(ditherActive && lightIsOn && (millis() - ditherMarker >= RAMP_DELAY)){
+        PSoC_Dither_Tick();
+    }
+
+    if(i2cResendPending.load(std::memory_order_acquire) && (millis() - i2cFailMarker >= I2C_RESEND_DELAY)){
+        PSoC_Resend_Frame();
+    }
+
+    if(!bootTracked && (0 != bootProfile[BOOT_PHASE_FIRST_LIGHT])){
+        Boot_Track();
+    }
+
+    if(!resumeDisabled && (millis() - resumeSaveMarker >= RESUME_SAVE_PERIOD)){
+        resumeSaveMarker = millis();
+        Resume_Save();
+    }
+
+    if(passMode < BENCH_MODE_COUNT){
+        benchSchedulerCycles[passMode] += System.ticks() - passStart;
+        benchSchedulerPasses[passMode]++;
+    }
+}
+
+
+/*************************************************************************************************************
+/
+/                                               Boot Profile
+/
+*************************************************************************************************************/
+// Time to first light over the boots since the last power loss
+struct BootStats {
+    uint32_t magic;
+    uint32_t boots, overBudget;
+    unsigned long last, best, worst; // us
+};
+retained BootStats bootStats;
+
+// first call for a phase wins
+void ArioCtrl::Boot_Mark(int phase){
+    if(0 == bootProfile[phase]) bootProfile[phase] = micros();
+}
+
+void ArioCtrl::Boot_Track(void){
+    bootTracked = TRUE;
+    unsigned long firstLight = bootProfile[BOOT_PHASE_FIRST_LIGHT];
+    if(BOOT_STATS_MAGIC != bootStats.magic){
+        memset(&bootStats, 0, sizeof(bootStats));
+        bootStats.magic = BOOT_STATS_MAGIC;
+        bootStats.best = 0xFFFFFFFF;
+    }
+    bootStats.boots++;
+    bootStats.last = firstLight;
+    if(firstLight < bootStats.best) bootStats.best = firstLight;
+    if(firstLight > bootStats.worst) bootStats.worst = firstLight;
+    if(firstLight > BOOT_LIGHT_BUDGET) bootStats.overBudget++;
+}
+
+// "first light us,boots,best,worst,over budget;phase 0 us,phase 1 us,..."
+void ArioCtrl::Boot_Report(char* buffer, size_t size){
+    int length = snprintf(buffer, size, "%lu,%lu,%lu,%lu,%lu;", bootProfile[BOOT_PHASE_FIRST_LIGHT], (unsigned long)bootStats.boots,
+                          bootStats.best, bootStats.worst, (unsigned long)bootStats.overBudget);
+    for(int i = 0; (i < BOOT_PHASE_COUNT) && (length < (int)size); i++){
+        length += snprintf(buffer + length, size - length, (0 == i) ? "%lu" : ",%lu", bootProfile[i]);
+    }
+}
+
+
+/*************************************************************************************************************
+/
+/                                               Fast Resume
+/
+*************************************************************************************************************/
+// CRC-32 (IEEE 802.3), four bits at a time to keep the table small
+static uint32_t Resume_CRC32(const uint8_t* data, size_t length){
+    static const uint32_t nibbleTable[16] = { 0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+                                              0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C };
+    uint32_t crc = 0xFFFFFFFF;
+    for(size_t i = 0; i < length; i++){
+        crc = (crc >> 4) ^ nibbleTable[(crc ^ data[i]) & 0x0F];
+        crc = (crc >> 4) ^ nibbleTable[(crc ^ (data[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+// Snapshot for a warm reset. A reset half way through leaves a bad CRC and the next boot starts cold.
+void ArioCtrl::Resume_Save(void){
+    ResumeState* rs = &resumeState;
+    rs->magic = RESUME_MAGIC;
+    rs->size = sizeof(ResumeState);
+    rs->savedAt = millis();
+    rs->savedTime = Time.now();
+    rs->lightIsOn = lightIsOn;
+    rs->layerAlsValid = layerAlsValid;
+    rs->operatingMode = operatingMode;
+    rs->rampRegNextMode = rampRegNextMode;
+    rs->currentVersion = currentVersion;
+    rs->maxCCT = maxCCT;
+    rs->alsBackgroundLevel = alsBackgroundLevel;
+    rs->holdDirection = holdDirection;
+    rs->holdAxis = holdAxis;
+    rs->currentCCT = currentCCT;
+    rs->currentLevel = currentLevel;
+    rs->layerAlsOffset = layerAlsOffset;
+    rs->holdStartPos = holdStartPos;
+    rs->zoneStandard = zoneStandard;
+    rs->dstRule = dstRule;
+    rs->rampCCT = rampCCT;
+    rs->rampLevel = rampLevel;
+    rs->rampCCT.done = NULL; // code addresses change with an OTA update
+    rs->rampLevel.done = NULL;
+    rs->rampCCTModeDone = (&ArioCtrl::Ramp_Mode_Done == rampCCT.done);
+    rs->rampLevelModeDone = (&ArioCtrl::Ramp_Mode_Done == rampLevel.done);
+    rs->marker = marker;
+    rs->holdStartTime = holdStartTime;
+    rs->pirHoldTimeMarker = pirHoldTimeMarker;
+    rs->programId = RESUME_PROGRAM_NONE;
+    if(demoProgram == programTable) rs->programId = RESUME_PROGRAM_DEMO;
+    else if(dawnSimProgram == programTable) rs->programId = RESUME_PROGRAM_DAWNSIM;
+    else if(bedTimeProgram == programTable) rs->programId = RESUME_PROGRAM_BEDTIME;
+    else if(customProgram == programTable) rs->programId = RESUME_PROGRAM_CUSTOM;
+    rs->programCounter = programCounter;
+    rs->programLength = programLength;
+    rs->programPhase = programPhase;
+    rs->programMarker = programMarker;
+    rs->programDuration = programDuration;
+    memcpy(rs->cctSchedule, loaded_cctArry, sizeof(rs->cctSchedule));
+    memcpy(rs->levelSchedule, loaded_levelArry, sizeof(rs->levelSchedule));
+    memcpy(rs->alarmTable, alarmTable, sizeof(rs->alarmTable));
+    rs->alarmCount = alarmCount;
+#if SENSOR_PIR_AVAILABLE
+    memcpy(rs->occupancyMap, occupancyMap, sizeof(rs->occupancyMap));
+#endif
+    rs->crc = Resume_CRC32((const uint8_t*)rs, offsetof(ResumeState, crc));
+}
+
+// Drops the snapshot, so a reset before the next Resume_Save() boots cold from EEPROM. untilReboot also stops the
+// snapshots for the rest of this boot, for when EEPROM was changed under settings that are still held in RAM.
+void ArioCtrl::Resume_Invalidate(bool untilReboot){
+    resumeState.magic = 0;
+    if(untilReboot) resumeDisabled = TRUE;
+}
+
+// TRUE if the snapshot is intact and recent, then the controller carries on from it. Without a valid clock its age is
+// unknown, so it is not used.
+bool ArioCtrl::Resume_Restore(void){
+    const ResumeState* rs = &resumeState;
+    if((RESUME_MAGIC != rs->magic) || (sizeof(ResumeState) != rs->size) ||
+       (rs->crc != Resume_CRC32((const uint8_t*)rs, offsetof(ResumeState, crc)))){
+        return FALSE; // power loss or different firmware
+    }
+    if(!Time.isValid() || (Time.now() - rs->savedTime > RESUME_MAX_AGE)){
+        return FALSE;
+    }
+    unsigned long rebase = millis() - rs->savedAt; // millis() restarted with this boot
+    lightIsOn = rs->lightIsOn;
+    layerAlsValid = rs->layerAlsValid;
+    operatingMode = rs->operatingMode;
+    rampRegNextMode = rs->rampRegNextMode;
+    currentVersion = rs->currentVersion;
+    maxCCT = rs->maxCCT;
+    alsBackgroundLevel = rs->alsBackgroundLevel;
+    holdDirection = rs->holdDirection;
+    holdAxis = rs->holdAxis;
+    currentCCT = rs->currentCCT;
+    currentLevel = rs->currentLevel;
+    layerAlsOffset = rs->layerAlsOffset;
+    holdStartPos = rs->holdStartPos;
+    zoneStandard = rs->zoneStandard;
+    dstRule = rs->dstRule;
+    rampCCT = rs->rampCCT;
+    rampLevel = rs->rampLevel;
+    rampCCT.startTime += rebase;
+    rampLevel.startTime += rebase;
+    rampCCT.done = rs->rampCCTModeDone ? &ArioCtrl::Ramp_Mode_Done : NULL;
+    rampLevel.done = rs->rampLevelModeDone ? &ArioCtrl::Ramp_Mode_Done : NULL;
+    marker = rs->marker + rebase;
+    holdStartTime = rs->holdStartTime + rebase;
+    pirHoldTimeMarker = rs->pirHoldTimeMarker + rebase;
+    programTable = NULL;
+    if(RESUME_PROGRAM_DEMO == rs->programId) programTable = demoProgram;
+    else if(RESUME_PROGRAM_DAWNSIM == rs->programId) programTable = dawnSimProgram;
+    else if(RESUME_PROGRAM_BEDTIME == rs->programId) programTable = bedTimeProgram;
+    else if((RESUME_PROGRAM_CUSTOM == rs->programId) && Program_Load()) programTable = customProgram;
+    programCounter = rs->programCounter;
+    programLength = rs->programLength;
+    programPhase = rs->programPhase;
+    programMarker = rs->programMarker + rebase;
+    programDuration = rs->programDuration;
+    if((NULL == programTable) && ((MODE_DEMO == operatingMode) || (MODE_PROGRAM == operatingMode))){
+        operatingMode = MODE_DEFAULT; // uploaded program is gone, fall back to the schedule
+    }
+    memcpy(loaded_cctArry, rs->cctSchedule, sizeof(loaded_cctArry));
+    memcpy(loaded_levelArry, rs->levelSchedule, sizeof(loaded_levelArry));
+    memcpy(alarmTable, rs->alarmTable, sizeof(alarmTable));
+    alarmCount = rs->alarmCount;
+    alarmLastMinute = -1;
+#if SENSOR_PIR_AVAILABLE
+    memcpy(occupancyMap, rs->occupancyMap, sizeof(occupancyMap));
+#endif
+    layersDirty = TRUE;
+    layerScheduleStamp = 0xFFFFFFFFUL;
+    return TRUE;
 }
 
 
@@ -692,26 +1306,185 @@ void ArioCtrl::Scheduler(void){
 /
 *************************************************************************************************************/
 //Time.weekday() retuens an integer:  1 = Sunday, 2 = Monday, 3 = Tuesday, 4 = Wednesday, 5 = Thursday, 6 = Friday, 7 = Saturday
-void ArioCtrl::Check_Wake_Alarm(void){
-    unsigned int weekday = Time.weekday();
-    if ((EEPROM.read(WAKEUP_ALARM_ENABLE_BASE_ADDR + weekday) == TRUE) && !lightIsOn && (MODE_DEMO != operatingMode) && (MODE_BEDTIME != operatingMode)){ // Dawn simulator alarm is set and the light is off
-        if((Time.hour() == EEPROM.read(WAKEUP_ALARM_HOUR_BASE_ADDR + weekday)) && (Time.minute() == EEPROM.read(WAKEUP_ALARM_MINUTE_BASE_ADDR + weekday)) && AMalarmFlag){
-            AMalarmFlag = FALSE;
-            DawnSim_Init();
+// Runs once per minute of day. The table is sorted by time, so only the alarms between the cursor and now are looked at.
+void ArioCtrl::Check_Alarms(void){
+    int minuteOfDay = clockHour*60 + clockMinute;
+    if(minuteOfDay == alarmLastMinute) return;
+    if(minuteOfDay != alarmLastMinute + 1){ // new day, clock change or table change
+        Alarm_Seek(minuteOfDay);
+    }
+    alarmLastMinute = minuteOfDay;
+    while((alarmCursor < alarmCount) && (alarmTable[alarmCursor].minuteOfDay <= minuteOfDay)){
+        if(alarmTable[alarmCursor].minuteOfDay == minuteOfDay) Alarm_Fire(&alarmTable[alarmCursor]);
+        alarmCursor++;
+    }
+}
+
+void ArioCtrl::Alarm_Seek(int minuteOfDay){
+    alarmCursor = 0;
+    while((alarmCursor < alarmCount) && (alarmTable[alarmCursor].minuteOfDay < minuteOfDay)) alarmCursor++;
+}
+
+void ArioCtrl::Alarm_Fire(const AlarmRecord* alarm){
+    if(!(alarm->type & ALARM_ENABLED) || !(alarm->dayMask & (1 << (clockWeekday - 1)))) return;
+    if(ALARM_TYPE_WAKE == (alarm->type & ALARM_TYPE_MASK)){
+        if(!lightIsOn && (MODE_DEMO != operatingMode) && (MODE_PROGRAM != operatingMode) && (MODE_BEDTIME != operatingMode)){ // Dawn simulator alarm is set and the light is off
+            DawnSim_Init(alarm->duration, alarm->program);
+        }
+    } else if(ALARM_TYPE_BED == (alarm->type & ALARM_TYPE_MASK)){
+        if(lightIsOn && (MODE_DEMO != operatingMode) && (MODE_PROGRAM != operatingMode) && (MODE_DAWNSIM != operatingMode)){ // Dusk simulator alarm is set and light is on
+            BedTime_Init(alarm->duration, alarm->program);
+        }
+    }
+}
+
+// Sets the time of an alarm. With replace, the days are taken out of every other alarm of that type first (one alarm of
+// each type per day, like the old per weekday settings), without it the alarm is added next to the existing ones.
+// A full table leaves the alarms as they were, so RAM keeps matching the stored table.
+bool ArioCtrl::Alarm_Set(uint8_t type, uint8_t dayMask, uint16_t minuteOfDay, uint8_t duration, uint8_t program, bool replace){
+    if((0 == (dayMask & ALARM_ALL_DAYS)) || (24*60 <= minuteOfDay)) return FALSE;
+    AlarmRecord saved[ALARM_TABLE_SIZE];
+    uint8_t savedCount = alarmCount;
+    memcpy(saved, alarmTable, sizeof(saved));
+    if(replace){
+        for(int i = 0; i < alarmCount; i++){
+            if((alarmTable[i].type & ALARM_TYPE_MASK) == type) alarmTable[i].dayMask &= ~dayMask;
+        }
+        Alarm_Table_Compact();
+    }
+    if(ALARM_TABLE_SIZE <= alarmCount){
+        memcpy(alarmTable, saved, sizeof(saved));
+        alarmCount = savedCount;
+        return FALSE;
+    }
+    AlarmRecord* alarm = &alarmTable[alarmCount++];
+    alarm->type = type | ALARM_ENABLED;
+    alarm->dayMask = dayMask & ALARM_ALL_DAYS;
+    alarm->minuteOfDay = minuteOfDay;
+    alarm->duration = duration;
+    alarm->program = program;
+    Alarm_Table_Compact();
+    Alarm_Table_Store();
+    return TRUE;
+}
+
+// Arms or disarms an alarm type on the given days, keeping the alarm times. Alarms shared with other days are split.
+bool ArioCtrl::Alarm_Set_Days(uint8_t type, uint8_t dayMask, bool enable){
+    uint8_t flags = enable ? (type | ALARM_ENABLED) : type;
+    uint8_t count = alarmCount;
+    AlarmRecord saved[ALARM_TABLE_SIZE];
+    memcpy(saved, alarmTable, sizeof(saved));
+    for(int i = 0; i < count; i++){
+        AlarmRecord* alarm = &alarmTable[i];
+        uint8_t days = alarm->dayMask & dayMask;
+        if(((alarm->type & ALARM_TYPE_MASK) != type) || (0 == days) || (flags == alarm->type)) continue;
+        if(days != alarm->dayMask){
+            if(ALARM_TABLE_SIZE <= alarmCount){ // no room to split, undo the alarms already changed
+                memcpy(alarmTable, saved, sizeof(saved));
+                alarmCount = count;
+                return FALSE;
+            }
+            alarmTable[alarmCount] = *alarm;
+            alarmTable[alarmCount].dayMask = alarm->dayMask & ~days; // the other days stay as they were
+            alarmCount++;
+            alarm->dayMask = days;
         }
-        if(Time.minute() != EEPROM.read(WAKEUP_ALARM_MINUTE_BASE_ADDR + weekday)) AMalarmFlag = TRUE; // This ensures alarm only triggers once per day
+        alarm->type = flags;
     }
+    Alarm_Table_Compact();
+    Alarm_Table_Store();
+    return TRUE;
 }
 
-void ArioCtrl::Check_Bedtime_Reminder(void){
-    unsigned int weekday = Time.weekday();
-    if ((EEPROM.read(BEDTIME_ALARM_ENABLE_BASE_ADDR + weekday) == TRUE) && lightIsOn && (MODE_DEMO != operatingMode) && (MODE_DAWNSIM != operatingMode)){ // Dusk simulator alarm is set and light is on
-        if((Time.hour() == EEPROM.read(BEDTIME_ALARM_HOUR_BASE_ADDR + weekday)) && (Time.minute() == EEPROM.read(BEDTIME_ALARM_MINUTE_BASE_ADDR + weekday)) && PMalarmFlag){
-            PMalarmFlag = FALSE;
-            BedTime_Init();
+bool ArioCtrl::Alarm_Lookup(uint8_t type, int weekday, AlarmRecord* out){
+    if((weekday < 1) || (7 < weekday)) return FALSE;
+    for(int i = 0; i < alarmCount; i++){
+        if(((alarmTable[i].type & ALARM_TYPE_MASK) == type) && (alarmTable[i].dayMask & (1 << (weekday - 1)))){
+            *out = alarmTable[i];
+            return TRUE;
         }
-        if(Time.minute() != EEPROM.read(BEDTIME_ALARM_MINUTE_BASE_ADDR + weekday)) PMalarmFlag = TRUE; // This ensures alarm only run once per day
     }
+    return FALSE;
+}
+
+void ArioCtrl::Alarm_Table_Clear(void){
+    alarmCount = 0;
+    Alarm_Table_Store();
+    alarmLastMinute = -1;
+}
+
+// Drops alarms without days, merges alarms that only differ in their days and sorts the table by time
+void ArioCtrl::Alarm_Table_Compact(void){
+    uint8_t count = 0;
+    for(int i = 0; i < alarmCount; i++){
+        AlarmRecord alarm = alarmTable[i];
+        if(0 == alarm.dayMask) continue;
+        int j = 0;
+        while((j < count) && !((alarmTable[j].type == alarm.type) && (alarmTable[j].minuteOfDay == alarm.minuteOfDay) &&
+                               (alarmTable[j].duration == alarm.duration) && (alarmTable[j].program == alarm.program))) j++;
+        if(j < count){
+            alarmTable[j].dayMask |= alarm.dayMask;
+            continue;
+        }
+        j = count++;
+        while((j > 0) && (alarmTable[j - 1].minuteOfDay > alarm.minuteOfDay)){
+            alarmTable[j] = alarmTable[j - 1];
+            j--;
+        }
+        alarmTable[j] = alarm;
+    }
+    alarmCount = count;
+    alarmLastMinute = -1; // re-seek the cursor on the next pass
+}
+
+void ArioCtrl::Alarm_Table_Store(void){
+    if(alarmStoreHeld) return;
+    Setting_Write(ALARM_TABLE_COUNT_ADDR, alarmCount);
+    for(int i = 0; i < alarmCount; i++){
+        int addr = ALARM_TABLE_BASE_ADDR + i*ALARM_RECORD_BYTES;
+        Setting_Write(addr, alarmTable[i].type);
+        Setting_Write(addr + 1, alarmTable[i].dayMask);
+        Setting_Write(addr + 2, alarmTable[i].minuteOfDay & 0xFF);
+        Setting_Write(addr + 3, alarmTable[i].minuteOfDay >> 8);
+        Setting_Write(addr + 4, alarmTable[i].duration);
+        Setting_Write(addr + 5, alarmTable[i].program);
+    }
+}
+
+// Loads the alarm table, building it once from the old per weekday arrays on the first boot after the update
+void ArioCtrl::Alarm_Table_Load(void){
+    unsigned int count = EEPROM.read(ALARM_TABLE_COUNT_ADDR);
+    alarmCount = 0;
+    if(0xFF == count){
+        const int bases[2][5] = { { ALARM_TYPE_WAKE, WAKEUP_ALARM_ENABLE_BASE_ADDR, WAKEUP_ALARM_HOUR_BASE_ADDR, WAKEUP_ALARM_MINUTE_BASE_ADDR, WAKEUP_ALARM_DURATION_BASE_ADDR },
+                                  { ALARM_TYPE_BED, BEDTIME_ALARM_ENABLE_BASE_ADDR, BEDTIME_ALARM_HOUR_BASE_ADDR, BEDTIME_ALARM_MINUTE_BASE_ADDR, BEDTIME_ALARM_DURATION_BASE_ADDR } };
+        for(int t = 0; t < 2; t++){
+            for(int weekday = 1; weekday <= 7; weekday++){
+                uint8_t hour = EEPROM.read(bases[t][2] + weekday);
+                uint8_t minute = EEPROM.read(bases[t][3] + weekday);
+                if((23 < hour) || (59 < minute)) continue; // never set
+                AlarmRecord* alarm = &alarmTable[alarmCount++];
+                alarm->type = bases[t][0] | ((TRUE == EEPROM.read(bases[t][1] + weekday)) ? ALARM_ENABLED : 0);
+                alarm->dayMask = 1 << (weekday - 1);
+                alarm->minuteOfDay = hour*60 + minute;
+                alarm->duration = EEPROM.read(bases[t][4] + weekday);
+                alarm->program = ALARM_PROGRAM_BUILTIN;
+            }
+        }
+        Alarm_Table_Compact();
+        Alarm_Table_Store();
+        return;
+    }
+    for(unsigned int i = 0; (i < count) && (i < ALARM_TABLE_SIZE); i++){
+        int addr = ALARM_TABLE_BASE_ADDR + i*ALARM_RECORD_BYTES;
+        AlarmRecord* alarm = &alarmTable[alarmCount++];
+        alarm->type = EEPROM.read(addr);
+        alarm->dayMask = EEPROM.read(addr + 1);
+        alarm->minuteOfDay = EEPROM.read(addr + 2) | (EEPROM.read(addr + 3) << 8);
+        alarm->duration = EEPROM.read(addr + 4);
+        alarm->program = EEPROM.read(addr + 5);
+    }
+    alarmLastMinute = -1;
 }
 
 void ArioCtrl::Check_PIR_Schedule(void){
@@ -723,7 +1496,7 @@ void ArioCtrl::Check_PIR_Schedule(void){
             if(EEPROM.read(PIR_SCHEDULE_EN_ADDR) == TRUE){ // enable with schedule (daily only)
                 int beginTime = EEPROM.read(PIR_BEGIN_HOUR_ADDR)*60 + EEPROM.read(PIR_BEGIN_MINUTE_ADDR);
                 int endTime = EEPROM.read(PIR_END_HOUR_ADDR)*60 + EEPROM.read(PIR_END_MINUTE_ADDR);
-                int now = Time.hour()*60 + Time.minute();
+                int now = clockHour*60 + clockMinute;
                 if (endTime > beginTime){
                     if((now >= beginTime) && (now < endTime)){
                         pirEnabled = TRUE;
@@ -752,58 +1525,237 @@ void ArioCtrl::Check_PIR_Schedule(void){
 /               Alarm & Timer Settings
 /
 *************************************************************************************************************/
-void ArioCtrl::Set_Wake_Alarm(String str){
-    unsigned int weekday = str.substring(0,1).toInt();
-    unsigned int enable = str.substring(2,3).toInt();
-    EEPROM.write((WAKEUP_ALARM_ENABLE_BASE_ADDR + weekday), enable);
-    if(1 == enable){
-        EEPROM.write((WAKEUP_ALARM_HOUR_BASE_ADDR + weekday), str.substring(4,6).toInt());
-        EEPROM.write((WAKEUP_ALARM_MINUTE_BASE_ADDR + weekday), str.substring(6,8).toInt());
-        EEPROM.write((WAKEUP_ALARM_DURATION_BASE_ADDR + weekday), str.substring(9).toInt());
-    }
+// the number in str[from, to), what String::substring(from, to).toInt() gave without the heap copy
+static long Field_Int(const char* str, unsigned int from, unsigned int to = 0xFFFF){
+    char field[12];
+    unsigned int length = strlen(str);
+    if(from >= length) return 0;
+    if(to > length) to = length;
+    unsigned int count = (to - from < sizeof(field) - 1) ? to - from : sizeof(field) - 1;
+    memcpy(field, str + from, count);
+    field[count] = 0;
+    return atol(field);
+}
+
+// "2,1,0630,120" => enable at Monday (day 2) 6:30 AM for 120 minutes, "4,0" => disable Wednesday (keeps its time)
+bool ArioCtrl::Set_Wake_Alarm(const char* str){
+    return Alarm_Command(ALARM_TYPE_WAKE, str);
 }
 
-void ArioCtrl::Set_Bedtime_Reminder(String str){
-    unsigned int weekday = str.substring(0,1).toInt();
-    unsigned int enable = str.substring(2,3).toInt();
-    EEPROM.write((BEDTIME_ALARM_ENABLE_BASE_ADDR + weekday), enable);
-    if(1 == enable){
-        EEPROM.write((BEDTIME_ALARM_HOUR_BASE_ADDR + weekday), str.substring(4,6).toInt());
-        EEPROM.write((BEDTIME_ALARM_MINUTE_BASE_ADDR + weekday), str.substring(6,8).toInt());
-        EEPROM.write((BEDTIME_ALARM_DURATION_BASE_ADDR + weekday), str.substring(9).toInt());
+bool ArioCtrl::Set_Bedtime_Reminder(const char* str){
+    return Alarm_Command(ALARM_TYPE_BED, str);
+}
+
+// "d,e" or "d,e,hhmm,duration" of a WAKE/BED command, minuteOfDay is -1 without a time
+struct AlarmText {
+    uint8_t dayMask, enable, duration;
+    int minuteOfDay;
+};
+
+// FALSE if the day is not 1-7 or the time is not a valid hhmm
+static bool Alarm_Text_Parse(const char* str, AlarmText* out){
+    if((str[0] < '1') || ('7' < str[0])) return FALSE;
+    out->dayMask = 1 << (str[0] - '1');
+    out->enable = Field_Int(str, 2, 3);
+    out->minuteOfDay = -1;
+    out->duration = 0;
+    if((strlen(str) > 3) && (',' == str[3])){
+        long hour = Field_Int(str, 4, 6), minute = Field_Int(str, 6, 8);
+        if((hour < 0) || (23 < hour) || (minute < 0) || (59 < minute)) return FALSE;
+        out->minuteOfDay = hour*60 + minute;
+        out->duration = Field_Int(str, 9);
     }
+    return TRUE;
+}
+
+// FALSE without changing anything on a malformed command
+bool ArioCtrl::Alarm_Command(uint8_t type, const char* str){
+    AlarmText cmd;
+    if(!Alarm_Text_Parse(str, &cmd)) return FALSE;
+#if ALARM_TIME_NEEDS_ENABLE
+    if(1 != cmd.enable) cmd.minuteOfDay = -1;
+#endif
+    if((-1 != cmd.minuteOfDay) && !Alarm_Set(type, cmd.dayMask, cmd.minuteOfDay, cmd.duration, ALARM_PROGRAM_BUILTIN, TRUE)) return FALSE;
+    return Alarm_Set_Days(type, cmd.dayMask, (1 == cmd.enable));
 }
 
-void ArioCtrl::Configure_Sensor_PIR(String str){
+void ArioCtrl::Configure_Sensor_PIR(const char* str){
     // first number is enable turn on, second is turn off, thrid is enable schedule, fourth is scheduled on time, fifth is scheduled off time
     // "1,1,060,1,1950,2010" "1,1,120,0" "0,1,015,1" (just enable schedule)
     pirHoldTimeMarker = millis();
     Cloud_Debug_Print("PIR Timer reset");
-    EEPROM.write(PIR_ON_SET_ADDR, str.substring(0,1).toInt());
-    EEPROM.write(PIR_OFF_SET_ADDR, str.substring(2,3).toInt());
-    EEPROM.write(PIR_ON_DURATION, str.substring(4,7).toInt());
-    EEPROM.write(PIR_SCHEDULE_EN_ADDR, str.substring(8,9).toInt());
-    if(str.substring(9).length() != 0){
+    Setting_Write(PIR_ON_SET_ADDR, Field_Int(str, 0, 1));
+    Setting_Write(PIR_OFF_SET_ADDR, Field_Int(str, 2, 3));
+    Setting_Write(PIR_ON_DURATION, Field_Int(str, 4, 7));
+    Setting_Write(PIR_SCHEDULE_EN_ADDR, Field_Int(str, 8, 9));
+    if(strlen(str) > 9){
         Cloud_Debug_Print("Setting PIR schedule time!");
-        EEPROM.write(PIR_BEGIN_HOUR_ADDR, str.substring(10,12).toInt());
-        EEPROM.write(PIR_BEGIN_MINUTE_ADDR, str.substring(12,14).toInt());
-        EEPROM.write(PIR_END_HOUR_ADDR, str.substring(15,17).toInt());
-        EEPROM.write(PIR_END_MINUTE_ADDR, str.substring(17,19).toInt());
+        Setting_Write(PIR_BEGIN_HOUR_ADDR, Field_Int(str, 10, 12));
+        Setting_Write(PIR_BEGIN_MINUTE_ADDR, Field_Int(str, 12, 14));
+        Setting_Write(PIR_END_HOUR_ADDR, Field_Int(str, 15, 17));
+        Setting_Write(PIR_END_MINUTE_ADDR, Field_Int(str, 17, 19));
     }
 }
 
-void ArioCtrl::Configure_Sensor_ALS(String str){
+void ArioCtrl::Configure_Sensor_ALS(const char* str){
+    ALS_Configure(Field_Int(str, 0, 1), Field_Int(str, 2));
+}
+
+void ArioCtrl::ALS_Configure(uint8_t enable, uint8_t sensitivity){
     bool preEnable = EEPROM.read(ALS_EN_ADDR);
-    EEPROM.write(ALS_EN_ADDR, str.substring(0,1).toInt());
-    uint8_t sensitivity = constrain(str.substring(2).toInt(), ALS_SENSITIVITY_LOW, ALS_SENSITIVITY_HIGH); // Range Limited. Default is 6500K.
-    EEPROM.write(ALS_SENSITIVITY_ADDR, sensitivity);
-    if(lightIsOn && (operatingMode == MODE_DEFAULT) && (alsAdjustedLevel != -1)){
-        if(!preEnable && (str.substring(0,1).toInt() == 1)){ //switch to enable
-            RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), alsAdjustedLevel, 500UL, MODE_DEFAULT);
-        } else if(preEnable && (str.substring(0,1).toInt() != 1)){ // switch to disable
-            RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), ValExtractor_LUT24(loaded_levelArry), 500UL, MODE_DEFAULT);
+    Setting_Write(ALS_EN_ADDR, enable);
+    Setting_Write(ALS_SENSITIVITY_ADDR, constrain(sensitivity, ALS_SENSITIVITY_LOW, ALS_SENSITIVITY_HIGH)); // Range Limited
+    layersDirty = TRUE;
+    if(lightIsOn && (operatingMode == MODE_DEFAULT) && layerAlsValid && (preEnable != (1 == enable))){
+        RampTo_Base(500UL); // ALS switched on or off
+    }
+}
+
+// Writes a setting only if it changed, so repeated commands do not wear the emulated EEPROM
+void ArioCtrl::Setting_Write(int addr, uint8_t value){
+    if(EEPROM.read(addr) == value) return;
+    EEPROM.write(addr, value);
+    Resume_Invalidate();
+}
+
+static int Command_Length(byte opcode){ // payload size of a batch command, -1 if unknown
+    switch(opcode){
+        case CMD_POWER:         return 1;
+        case CMD_LEVEL:         return 1;
+        case CMD_CCT:           return 2;
+        case CMD_WAKE_ENABLE:   return 2;
+        case CMD_WAKE_SET:      return 4;
+        case CMD_BED_ENABLE:    return 2;
+        case CMD_BED_SET:       return 4;
+        case CMD_PIR:           return 4;
+        case CMD_PIR_SCHEDULE:  return 4;
+        case CMD_ALS:           return 2;
+        case CMD_ZONE:          return 1;
+        case CMD_ALARM_ADD:     return 6;
+        case CMD_DST:           return 1;
+        default:                return -1;
+    }
+}
+
+static bool Time_Valid(byte hour, byte minute){
+    return (hour < 24) && (minute < 60);
+}
+
+// FALSE if a payload value is out of range, the same limits the text commands have
+static bool Command_Valid(byte opcode, const byte* p){
+    switch(opcode){
+        case CMD_WAKE_ENABLE:
+        case CMD_BED_ENABLE:    return (0 != (p[0] & ALARM_ALL_DAYS)) && (p[1] <= 1);
+        case CMD_WAKE_SET:
+        case CMD_BED_SET:       return (0 != (p[0] & ALARM_ALL_DAYS)) && Time_Valid(p[1], p[2]);
+        case CMD_ALARM_ADD:     return ((ALARM_TYPE_WAKE == p[0]) || (ALARM_TYPE_BED == p[0])) && (0 != (p[1] & ALARM_ALL_DAYS)) &&
+                                       Time_Valid(p[2], p[3]) && (p[5] <= ALARM_PROGRAM_CUSTOM);
+        case CMD_PIR:           return (p[0] <= 1) && (p[1] <= 1) && (p[3] <= 1);
+        case CMD_PIR_SCHEDULE:  return Time_Valid(p[0], p[1]) && Time_Valid(p[2], p[3]);
+        case CMD_ALS:           return (p[0] <= 1) && (ALS_SENSITIVITY_LOW <= p[1]) && (p[1] <= ALS_SENSITIVITY_HIGH);
+        case CMD_ZONE:          return p[0] <= 104;
+        case CMD_DST:           return p[0] <= DST_RULE_NZ;
+        default:                return TRUE;
+    }
+}
+
+// Applies a frame of binary commands (see CMD_* in globals.h). The whole frame is checked first, so a malformed frame or
+// a value out of range changes nothing. The alarm commands go first and are stored once at the end; if the table runs
+// full it is put back the way it was and the frame is rejected before anything else is applied. Settings are only written
+// when they change and follow-up work (time zone) runs once per frame.
+bool ArioCtrl::Command_Batch_Apply(const byte* frame, unsigned int length){
+    unsigned int i = 0;
+    while(i < length){
+        int payload = Command_Length(frame[i]);
+        if((payload < 0) || (i + 1 + payload > length) || !Command_Valid(frame[i], &frame[i + 1])) return FALSE;
+        i += 1 + payload;
+    }
+    AlarmRecord saved[ALARM_TABLE_SIZE];
+    uint8_t savedCount = alarmCount;
+    memcpy(saved, alarmTable, sizeof(saved));
+    bool applied = TRUE;
+    alarmStoreHeld = TRUE;
+    for(i = 0; applied && (i < length); i += 1 + Command_Length(frame[i])){
+        const byte* p = &frame[i + 1];
+        switch(frame[i]){
+            case CMD_WAKE_SET:
+                applied = Alarm_Set(ALARM_TYPE_WAKE, p[0], p[1]*60 + p[2], p[3], ALARM_PROGRAM_BUILTIN, TRUE);
+                break;
+            case CMD_WAKE_ENABLE:
+                applied = Alarm_Set_Days(ALARM_TYPE_WAKE, p[0], p[1]);
+                break;
+            case CMD_BED_SET:
+                applied = Alarm_Set(ALARM_TYPE_BED, p[0], p[1]*60 + p[2], p[3], ALARM_PROGRAM_BUILTIN, TRUE);
+                break;
+            case CMD_BED_ENABLE:
+                applied = Alarm_Set_Days(ALARM_TYPE_BED, p[0], p[1]);
+                break;
+            case CMD_ALARM_ADD:
+                applied = Alarm_Set(p[0], p[1], p[2]*60 + p[3], p[4], p[5], FALSE);
+                break;
         }
     }
+    alarmStoreHeld = FALSE;
+    if(!applied){
+        memcpy(alarmTable, saved, sizeof(saved));
+        alarmCount = savedCount;
+        return FALSE;
+    }
+    Alarm_Table_Store();
+    bool zoneChanged = FALSE;
+    for(i = 0; i < length; i += 1 + Command_Length(frame[i])){
+        const byte* p = &frame[i + 1];
+        switch(frame[i]){
+            case CMD_POWER:
+                if(p[0] && !lightIsOn){
+                    Turn_Lamp_On(INTERACTION_TYPE_WEB);
+                } else if(!p[0] && lightIsOn){
+                    Turn_Lamp_Off(INTERACTION_TYPE_WEB);
+                }
+                break;
+            case CMD_LEVEL:
+                Set_Brightness(p[0]);
+                break;
+            case CMD_CCT:
+                Set_CCT((p[0] << 8) | p[1]);
+                break;
+            case CMD_PIR:
+                pirHoldTimeMarker = millis();
+                Setting_Write(PIR_ON_SET_ADDR, p[0]);
+                Setting_Write(PIR_OFF_SET_ADDR, p[1]);
+                Setting_Write(PIR_ON_DURATION, p[2]);
+                Setting_Write(PIR_SCHEDULE_EN_ADDR, p[3]);
+                break;
+            case CMD_PIR_SCHEDULE:
+                Setting_Write(PIR_BEGIN_HOUR_ADDR, p[0]);
+                Setting_Write(PIR_BEGIN_MINUTE_ADDR, p[1]);
+                Setting_Write(PIR_END_HOUR_ADDR, p[2]);
+                Setting_Write(PIR_END_MINUTE_ADDR, p[3]);
+                break;
+            case CMD_ALS:
+                ALS_Configure(p[0], p[1]);
+                break;
+            case CMD_ZONE:
+                Setting_Write(USER_TIME_ZONE, p[0]);
+                zoneChanged = TRUE;
+                break;
+            case CMD_DST:
+                Setting_Write(DST_ENABLE_ADDR, p[0]);
+                zoneChanged = TRUE;
+                break;
+        }
+    }
+    if(zoneChanged) Set_TimeZone();
+    return TRUE;
+}
+
+// Cloud form of a batch frame, the bytes as hex digits
+bool ArioCtrl::Command_Batch_Hex(const char* hex){
+    unsigned int digits = strlen(hex);
+    if((digits % 2) || (digits > BATCH_MAX_BYTES*2)) return FALSE;
+    byte frame[BATCH_MAX_BYTES];
+    if(!Hex_Decode(hex, frame, digits/2)) return FALSE;
+    return Command_Batch_Apply(frame, digits/2);
 }
 
 
@@ -813,6 +1765,7 @@ void ArioCtrl::Configure_Sensor_ALS(String str){
 /
 *************************************************************************************************************/
 ///////////////////////// PIR /////////////////////////
+#if SENSOR_PIR_AVAILABLE
 void ArioCtrl::PIR_Routine(void){
     // reset the flag after time out to avoid false triggering
     if((millis() - pirDebounceTimer > 3000UL) && pirDebounceFlag){
@@ -826,6 +1779,8 @@ void ArioCtrl::PIR_Routine(void){
         if((millis() - pirDebounceTimer > 1600UL) && pirDebounceFlag){ // to avoid false triggering
             pirDebounceFlag = FALSE;
             pirHoldTimeMarker = millis();
+            occupancySeen = TRUE;
+            prewarmActive = FALSE; // someone arrived, from here on it behaves like any other PIR turn on
             // Report presence detection
             if(millis() - pirReportTimer > PIR_REPORT_PERIOD){
                 pirReportTimer = millis();
@@ -844,8 +1799,80 @@ void ArioCtrl::PIR_Routine(void){
     }
 }
 
+///////////////////////// Occupancy History /////////////////////////
+void ArioCtrl::Occupancy_Load(void){
+    if(0xFF == EEPROM.read(OCCUPANCY_VALID_ADDR)){ // never recorded, start from an empty week
+        for(int i = 0; i < OCCUPANCY_BYTES; i++) Setting_Write(OCCUPANCY_BASE_ADDR + i, 0);
+        Setting_Write(OCCUPANCY_VALID_ADDR, 0);
+    }
+    for(int i = 0; i < OCCUPANCY_BYTES; i++) occupancyMap[i] = EEPROM.read(OCCUPANCY_BASE_ADDR + i);
+}
+
+bool ArioCtrl::Occupancy_Bit(int slot){
+    return (occupancyMap[slot >> 3] >> (slot & 7)) & 0x01;
+}
+
+// Once per pass: stores the slot that just ended into the history, and pre-warms the lamp when the coming slot was
+// occupied last week but the current one was not, i.e. someone usually arrives then
+void ArioCtrl::Occupancy_Tick(void){
+    if(!Time.isValid()) return; // slots only mean something once the clock is set
+    int minuteOfDay = clockHour*60 + clockMinute;
+    int slot = (clockWeekday - 1)*OCCUPANCY_SLOTS_PER_DAY + minuteOfDay/OCCUPANCY_SLOT_MINUTES;
+    if(slot != occupancySlot){
+        if(-1 != occupancySlot){
+            uint8_t mask = 1 << (occupancySlot & 7);
+            uint8_t value = occupancySeen ? (occupancyMap[occupancySlot >> 3] | mask) : (occupancyMap[occupancySlot >> 3] & ~mask);
+            occupancyMap[occupancySlot >> 3] = value;
+            Setting_Write(OCCUPANCY_BASE_ADDR + (occupancySlot >> 3), value); // only writes when the bit changed
+        }
+        occupancySlot = slot;
+        occupancySeen = FALSE;
+    }
+
+    if(prewarmActive && lightIsOn && (millis() - prewarmMarker >= PREWARM_CONFIRM_TIME)){ // nobody came
+        Turn_Lamp_Off(INTERACTION_TYPE_PIR);
+    }
+
+    unsigned long slotSecond = (minuteOfDay % OCCUPANCY_SLOT_MINUTES)*60UL + clockSecond;
+    if(slotSecond < OCCUPANCY_SLOT_MINUTES*60UL - PREWARM_LEAD_TIME) return;
+    int nextSlot = (slot + 1) % (7*OCCUPANCY_SLOTS_PER_DAY);
+    if((nextSlot == prewarmSlot) || !Occupancy_Bit(nextSlot) || Occupancy_Bit(slot)) return;
+    prewarmSlot = nextSlot; // one attempt per slot
+    if(!lightIsOn && pirEnabled && (EEPROM.read(PIR_ON_SET_ADDR) == TRUE) && (MODE_DEFAULT == operatingMode) &&
+       (millis() - pirOffTimer > PIR_OFF_HOLD_DELAY)){
+        Turn_Lamp_On(INTERACTION_TYPE_PREWARM);
+        prewarmActive = TRUE;
+        prewarmMarker = millis();
+    }
+}
+
+// today's history as hex, bit 0 of the first byte is 00:00-00:15, then ",slot now"
+void ArioCtrl::Occupancy_Report(char* buffer, size_t size){
+    int first = (clockWeekday - 1)*OCCUPANCY_SLOTS_PER_DAY/8;
+    int length = 0;
+    for(int i = 0; (i < OCCUPANCY_SLOTS_PER_DAY/8) && (length < (int)size); i++){
+        length += snprintf(buffer + length, size - length, "%02X", occupancyMap[first + i]);
+    }
+    if(length < (int)size) snprintf(buffer + length, size - length, ",%d", occupancySlot);
+}
+#endif
+
 
 ///////////////////////// Ambient Light Sensor /////////////////////////
+#if SENSOR_ALS_AVAILABLE
+// level offset for an ambient background level at the stored sensitivity
+static float ALS_Level_Offset(float background, unsigned int sensitivity){
+    if((sensitivity != ALS_SENSITIVITY_LOW) && (sensitivity != ALS_SENSITIVITY_MEDIUM) && (sensitivity != ALS_SENSITIVITY_HIGH)){
+        sensitivity = ALS_SENSITIVITY_DEFAULT;
+    }
+    if(ALS_SENSITIVITY_MEDIUM == sensitivity){
+        if(background > 3060){ background = 3060; }
+    } else if(ALS_SENSITIVITY_LOW == sensitivity){
+        if(background > 2040){ background = 2040; }
+    }
+    return -background/sensitivity;
+}
+
 void ArioCtrl::ALS_Routine(void){
     // Key Parameter 1: ALS_EN_ADDR
     // Key Parameter 2: ALS_SENSITIVITY_RANGE_ADDR
@@ -864,51 +1891,40 @@ void ArioCtrl::ALS_Routine(void){
         } else{ // acquisition complete
             // alsMeasuredLevel: measured ambient level with lamp inteference
             // alsBackgroundLevel: ambient level without lamp inteference
-            // alsAdjustedLevel: adjusted level to run the lamp
+            // layerAlsOffset: offset added to the schedule level
             alsMeasuredLevel = alsRunningSum/ALS_SAMPLES_NUMBER;
             // Calculate background ambient level without self-interference of the lamp
             alsBackgroundLevel = alsMeasuredLevel;
             if(lightIsOn){
                 alsBackgroundLevel -= 6.95 + 0.38*currentLevel - 0.00065*currentLevel*currentLevel;
             }
-            float referenceLevel = ValExtractor_LUT24(loaded_levelArry);
-            unsigned int alsSensitivityScale = EEPROM.read(ALS_SENSITIVITY_ADDR);
-            if((alsSensitivityScale != ALS_SENSITIVITY_LOW) && (alsSensitivityScale != ALS_SENSITIVITY_MEDIUM) && (alsSensitivityScale != ALS_SENSITIVITY_HIGH)){
-                alsSensitivityScale = ALS_SENSITIVITY_DEFAULT;
-            }
-            float alsScaledLevel = alsBackgroundLevel;
-            if(ALS_SENSITIVITY_MEDIUM == alsSensitivityScale){
-                if(alsScaledLevel > 3060){ alsScaledLevel = 3060; }
-            } else if(ALS_SENSITIVITY_LOW == alsSensitivityScale){
-                if(alsScaledLevel > 2040){ alsScaledLevel = 2040; }
-            }
-
-            alsScaledLevel /= alsSensitivityScale;
-            alsAdjustedLevel = referenceLevel - alsScaledLevel;
-            alsAdjustedLevel = constrain(alsAdjustedLevel, 10, 255);
+            layerAlsOffset = ALS_Level_Offset(alsBackgroundLevel, EEPROM.read(ALS_SENSITIVITY_ADDR));
+            layerAlsValid = TRUE;
+            layersDirty = TRUE;
 
             alsMeasureFlag = FALSE;
             alsMeasureCount = 0;
             alsRunningSum = 0;
 
-            if((EEPROM.read(ALS_EN_ADDR) == TRUE) && lightIsOn && operatingMode == DEFAULT){ // Maybe lightIsOn doesn't matter
-                RampTo_Linear_Setup(ValExtractor_LUT24(loaded_cctArry), alsAdjustedLevel, 10000UL, MODE_DEFAULT);
+            if((EEPROM.read(ALS_EN_ADDR) == TRUE) && lightIsOn && operatingMode == MODE_DEFAULT){ // Maybe lightIsOn doesn't matter
+                Compose_Base();
+                RampTo_Level(baseLevel, 10000UL, RAMP_CURVE_PERCEPTUAL); // the schedule keeps driving CCT meanwhile
             }
         }
     }
     if((millis() - alsReportTimer > ALS_REPORT_PERIOD) && (alsBackgroundLevel != -1)){
         alsReportTimer = millis();
-        char alsStr[40];
-        int cctVal = currentCCT;
-        int levelVal = currentLevel;
-        sprintf(alsStr,"ambient,%d,%d,%d,%d,%d",alsBackgroundLevel,lightIsOn,cctVal,levelVal,operatingMode);
-        Report_to_Cloud("sensor", alsStr);
+        FixedString<40> alsStr("ambient,");
+        alsStr.Append_Int(alsBackgroundLevel).Append(',').Append_Int(lightIsOn).Append(',').Append_Int(currentCCT);
+        alsStr.Append(',').Append_Int(currentLevel).Append(',').Append_Int(operatingMode);
+        Report_to_Cloud("sensor", alsStr.c_str());
     }
 }
+#endif
 
 
 void ArioCtrl::Daily_Subroutine(void){ // Currently not used
-    currentDay = Time.day();
+    currentDay = clockDayNumber;
     if (currentDay != lastDay){
         // if(EEPROM.read(DST_AUTO_CALC_ADDR) == TRUE){ Set_TimeZone(); } // Check for Day Light Savings
         lastDay = currentDay;
@@ -923,21 +1939,43 @@ void ArioCtrl::Daily_Subroutine(void){ // Currently not used
 *************************************************************************************************************/
 ///////////////////////// I2C /////////////////////////
 void ArioCtrl::EzI2Cs_Init(void){
+    Wire.setSpeed(I2C_SPEED); // has to be set before begin()
     Wire.begin();
 }
 
 /*  Function Name:  EzI2Cs_Write
-    Description:    Write data to a PSoC EzI2Cs I2C slave device
+    Description:    Write data to a PSoC EzI2Cs I2C slave device, retried with a doubling backoff on failure
     byte slaveAddr      : Address of target I2C slave device
     byte subAddrValue   : Relative sub-address of the exposed I2C memory locations in PSoC 1
     byte* dataArray     : pointer to array of data bytes
     byte length         : number of bytes to write
+    returns             : TRUE if the slave acknowledged the write
 */
-void ArioCtrl::EzI2Cs_Write(byte slaveAddr, byte subAddrValue, byte* dataArray, byte length){
-    Wire.beginTransmission(slaveAddr); /* transmit to device at address */
-    Wire.write(subAddrValue);          /* sends sub address */
-    Wire.write(dataArray, length);     /* sends data bytes */
-    Wire.endTransmission();            /* stop transmitting */
+bool ArioCtrl::EzI2Cs_Write(byte slaveAddr, byte subAddrValue, byte* dataArray, byte length){
+    I2C_Record(subAddrValue, dataArray, length);
+    for(int attempt = 0; attempt <= I2C_MAX_RETRIES; attempt++){
+        if(0 != attempt){
+            busStats.retries++;
+            delayMicroseconds(I2C_RETRY_BACKOFF_US << (attempt - 1));
+        }
+        Wire.beginTransmission(slaveAddr); /* transmit to device at address */
+        Wire.write(subAddrValue);          /* sends sub address */
+        Wire.write(dataArray, length);     /* sends data bytes */
+        byte result = Wire.endTransmission(); /* stop transmitting */
+        if(0 == result){
+            if(subAddrValue < NUM_BYTES_WRITE){ i2cWrittenMask |= ((1 << length) - 1) << subAddrValue; }
+            return TRUE;
+        }
+        if(3 == result){ // address not acknowledged
+            busStats.nacks++;
+        } else{ // bus busy, start or data byte timeout
+            busStats.timeouts++;
+        }
+    }
+    busStats.failures++;
+    i2cFailMarker = millis();
+    i2cResendPending.store(TRUE, std::memory_order_release); // PSoC may now hold a stale frame
+    return FALSE;
 }
 
 void ArioCtrl::EzI2Cs_Read(byte slaveAddr, byte subAddrValue, byte* dataArray, byte length){
@@ -950,7 +1988,127 @@ void ArioCtrl::EzI2Cs_Read(byte slaveAddr, byte subAddrValue, byte* dataArray, b
       dataArray[index] = Wire.read(); // receive a byte as character
       index++;
     }
-    delay(30); // A delay here is ESSENTIAL!!
+    // The PSoC needs PSOC_READ_SETTLE_TIME before the next transaction, ESSENTIAL! Ario_Init waits it out.
+}
+
+// Every write to the PSoC goes through EzI2Cs_Write on the output thread, so traffic counters and the trace capture live here
+void ArioCtrl::I2C_Record(byte subAddrValue, byte* dataArray, byte length){
+    unsigned long now = millis();
+    SINGLE_THREADED_BLOCK(){ // Cloud_Print_Perf() copies the counters from the application thread
+        I2C_Stats_Roll(&busStats, now);
+        busStats.transactions++;
+        busStats.bytes += length + 1; // sub address + data
+        busStats.minuteTransactions++;
+        busStats.minuteBytes += length + 1;
+    }
+
+    uint8_t request = i2cTraceRequest.exchange(I2C_TRACE_REQUEST_NONE);
+    if(I2C_TRACE_REQUEST_START == request){
+        i2cTraceLength = 0;
+        i2cTraceMarker = now;
+        i2cTraceEnabled = TRUE;
+    } else if(I2C_TRACE_REQUEST_STOP == request){
+        i2cTraceEnabled = FALSE;
+    }
+    if(!i2cTraceEnabled) return;
+    unsigned int end = i2cTraceLength;
+    if(end + 4 + length > I2C_TRACE_SIZE){ // capture window full
+        i2cTraceEnabled = FALSE;
+        return;
+    }
+    unsigned long dt = now - i2cTraceMarker;
+    if(dt > 0xFFFF) dt = 0xFFFF;
+    i2cTraceMarker = now;
+    i2cTraceBuffer[end++] = dt & 0xFF;
+    i2cTraceBuffer[end++] = dt >> 8;
+    i2cTraceBuffer[end++] = subAddrValue;
+    i2cTraceBuffer[end++] = length;
+    memcpy(&i2cTraceBuffer[end], dataArray, length);
+    i2cTraceLength = end + length; // the record is complete before a dump can see it
+}
+
+void ArioCtrl::I2C_Stats_Roll(I2CBusStats* stats, unsigned long now){
+    if(now - stats->minuteMarker >= ONE_MINUTE){
+        bool idleMinute = (now - stats->minuteMarker >= 2*ONE_MINUTE); // nothing was sent in the last full minute
+        stats->lastMinuteTransactions = idleMinute ? 0 : stats->minuteTransactions;
+        stats->lastMinuteBytes = idleMinute ? 0 : stats->minuteBytes;
+        stats->minuteTransactions = 0;
+        stats->minuteBytes = 0;
+        stats->minuteMarker = now;
+    }
+}
+
+// Taken by the output thread with its next write
+void ArioCtrl::I2C_Trace_Start(void){
+    i2cTraceRequest = I2C_TRACE_REQUEST_START;
+}
+
+void ArioCtrl::I2C_Trace_Stop(void){
+    i2cTraceRequest = I2C_TRACE_REQUEST_STOP;
+}
+
+// Dumps the captured trace as hex over USB serial, to be diffed against a golden trace on the bench
+void ArioCtrl::I2C_Trace_Dump(void){
+    // records below the length are final, a capture only restarts from a request this thread has not posted yet
+    unsigned int length = (I2C_TRACE_REQUEST_START == i2cTraceRequest) ? 0 : i2cTraceLength;
+    Serial.printlnf("TRACE %u", length);
+    for(unsigned int i = 0; i < length; i++){
+        Serial.printf("%02X", i2cTraceBuffer[i]);
+        if((i % 32) == 31) Serial.println();
+    }
+    Serial.println();
+}
+
+// Hands a PSoC write to the output thread. A full queue marks the register image for a resend, which carries the
+// latest intended values, so nothing is lost beyond the intermediate frames.
+bool ArioCtrl::PSoC_Queue_Write(byte subAddr, byte* dataArray, byte length){
+    if(benchMuted) return TRUE;
+    uint8_t head = outputHead.load(std::memory_order_relaxed);
+    uint8_t next = (head + 1) & (OUTPUT_QUEUE_SIZE - 1);
+    if(next == outputTail.load(std::memory_order_acquire)){
+        i2cFailMarker = millis();
+        i2cResendPending.store(TRUE, std::memory_order_release);
+        return FALSE;
+    }
+    PSoCFrame* frame = &outputQueue[head];
+    frame->subAddr = subAddr;
+    frame->length = length;
+    memcpy(frame->data, dataArray, length);
+    outputHead.store(next, std::memory_order_release);
+    if(NULL != outputReady) os_semaphore_give(outputReady, FALSE);
+    return TRUE;
+}
+
+void ArioCtrl::Output_Thread_Start(void){
+    if(NULL == outputThread){
+        uint8_t queued = (outputHead - outputTail) & (OUTPUT_QUEUE_SIZE - 1); // frames queued before the thread existed
+        os_semaphore_create(&outputReady, OUTPUT_QUEUE_SIZE, queued);
+        outputThread = new Thread("output", Output_Thread_Entry, this, OUTPUT_THREAD_PRIORITY, OUTPUT_THREAD_STACK);
+    }
+}
+
+// Output thread: drains the frame queue onto the bus, so slow cloud handlers or delays on the application thread
+// do not hold back light output. Retries and their backoff also run here. Blocks on outputReady while idle.
+void ArioCtrl::Output_Thread_Entry(void* param){
+    ArioCtrl* ctrl = (ArioCtrl*)param;
+    while(TRUE){
+        os_semaphore_take(outputReady, CONCURRENT_WAIT_FOREVER, FALSE);
+        uint8_t tail = outputTail.load(std::memory_order_relaxed);
+        if(tail == outputHead.load(std::memory_order_acquire)) continue;
+        PSoCFrame* frame = &outputQueue[tail];
+        if(ctrl->EzI2Cs_Write(PSOC_ADDR, frame->subAddr, frame->data, frame->length) && (0 == ctrl->bootProfile[BOOT_PHASE_FIRST_LIGHT])){
+            ctrl->bootProfile[BOOT_PHASE_FIRST_LIGHT] = micros();
+        }
+        outputTail.store((tail + 1) & (OUTPUT_QUEUE_SIZE - 1), std::memory_order_release);
+    }
+}
+
+// Sends every register written since boot again from i2cSendBuffer, the latest intended frame
+void ArioCtrl::PSoC_Resend_Frame(void){
+    if(!i2cResendPending.exchange(FALSE)) return; // a failure from here on sets it again for the next resend
+    if(i2cWrittenMask & 0x01) PSoC_Queue_Write(0, &i2cSendBuffer[0], 1);
+    if(i2cWrittenMask & 0x02) PSoC_Queue_Write(1, &i2cSendBuffer[1], 1);
+    if(i2cWrittenMask & 0x3C) PSoC_Queue_Write(2, &i2cSendBuffer[2], NUM_LED_CH); // a failed write on the bus sets the flag again
 }
 
 /*
@@ -962,10 +2120,7 @@ PSOC I2C Registers
 
 // Writes a single byte to the PSoC EzI2C Register
 void ArioCtrl::PSoC_WriteSingle(byte subAddr, byte data){
-    Wire.beginTransmission(PSOC_ADDR);
-    Wire.write(subAddr);
-    Wire.write(data);
-    Wire.endTransmission();
+    PSoC_Queue_Write(subAddr, &data, 1);
 }
 
 void ArioCtrl::PSoC_LEDVal(byte val0, byte val1, byte val2, byte val3){
@@ -973,36 +2128,24 @@ void ArioCtrl::PSoC_LEDVal(byte val0, byte val1, byte val2, byte val3){
     i2cSendBuffer[3] = val1;
     i2cSendBuffer[4] = val2;
     i2cSendBuffer[5] = val3;
-    Wire.beginTransmission(PSOC_ADDR);
-    Wire.write(2);
-    Wire.write(val0);
-    Wire.write(val1);
-    Wire.write(val2);
-    Wire.write(val3);
-    Wire.endTransmission();
+    PSoC_Queue_Write(2, &i2cSendBuffer[2], NUM_LED_CH);
 }
 
 void ArioCtrl::PSoC_onOff(byte onOff){
     i2cSendBuffer[0] = onOff;
-    Wire.beginTransmission(PSOC_ADDR);
-    Wire.write(0);
-    Wire.write(onOff);
-    Wire.endTransmission();
+    PSoC_Queue_Write(0, &i2cSendBuffer[0], 1);
 }
 
 void ArioCtrl::PSoC_changeLevel(byte level){
     i2cSendBuffer[1] = level;
-    Wire.beginTransmission(PSOC_ADDR);
-    Wire.write(1);
-    Wire.write(level);
-    Wire.endTransmission();
+    PSoC_Queue_Write(1, &i2cSendBuffer[1], 1);
 }
 
 ///////////////////////// UART /////////////////////////
 void ArioCtrl::UART_Init(void){
     if(FALSE) Serial.begin(UART_BAUD);
 }
-void ArioCtrl::debugPrint(String debugMsg){
+void ArioCtrl::debugPrint(const char* debugMsg){
     if(FALSE){
         Serial.println(debugMsg);
     }
@@ -1013,24 +2156,75 @@ void ArioCtrl::debugPrint(String debugMsg){
 /               Color Mixing & Functions
 /
 *************************************************************************************************************/
+// Default mode output, only written when one of the base layers changed
 void ArioCtrl::Load_RTC_Val(void){
-    currentSecond = Time.second();
-    if (currentSecond != lastSecond){
-        if((EEPROM.read(ALS_EN_ADDR) == TRUE) && (alsAdjustedLevel != -1)){
-            PSoC_Load_LEDVal(ValExtractor_LUT24(loaded_cctArry), alsAdjustedLevel);
-        } else {
-            PSoC_Load_LEDVal(ValExtractor_LUT24(loaded_cctArry), ValExtractor_LUT24(loaded_levelArry));
-        }
-        lastSecond = currentSecond;
+    if(!Compose_Base()) return;
+    if(rampLevel.active){ // ambient level ramp in progress, only follow the CCT schedule
+        PSoC_Load_LEDVal(baseCCT, currentLevel);
+    } else{
+        PSoC_Load_LEDVal(baseCCT, baseLevel);
+    }
+}
+
+// Re-reads the time of day tables once per second and marks the layers dirty if the schedule moved
+void ArioCtrl::Layer_Schedule_Update(void){
+    if(clockNow == layerScheduleStamp) return;
+    layerScheduleStamp = clockNow;
+    float cct = ValExtractor_LUT24(loaded_cctArry);
+    float level = ValExtractor_LUT24(loaded_levelArry);
+    if((cct != layerScheduleCCT) || (level != layerScheduleLevel)){
+        layerScheduleCCT = cct;
+        layerScheduleLevel = level;
+        layersDirty = TRUE;
+    }
+}
+
+// Blends the base layers: the schedule, lowered by the ALS offset when the sensor is enabled and has measured.
+// Returns TRUE if the base changed.
+bool ArioCtrl::Compose_Base(void){
+    if(!layersDirty) return FALSE;
+    layersDirty = FALSE;
+    float cct = layerScheduleCCT;
+    float level = layerScheduleLevel;
+    if((EEPROM.read(ALS_EN_ADDR) == TRUE) && layerAlsValid){
+        level = constrain(level + layerAlsOffset, 10, 255);
     }
+    bool changed = (cct != baseCCT) || (level != baseLevel);
+    baseCCT = cct;
+    baseLevel = level;
+    return changed;
+}
+
+// Returns to the base layers, used whenever a user adjustment or program ends
+void ArioCtrl::RampTo_Base(unsigned long duration, int curve){
+    Layer_Schedule_Update();
+    Compose_Base();
+    RampTo_Setup(baseCCT, baseLevel, duration, MODE_DEFAULT, curve);
 }
 
 
+// Reads the RTC once and derives the local calendar fields from the epoch, instead of letting every check call
+// Time.hour()/minute()/weekday() (each a separate local time conversion). Keeping all wall clock reads here also
+// means a host build only has to fake Time.now()/Time.local() to run the lamp logic on a virtual clock.
+void ArioCtrl::Clock_Sample(void){
+    clockNow = Time.now();
+    if(clockNow - dstWindowStart >= dstWindowLength){ // crossed a DST transition or the clock was set
+        DST_Window_Update(clockNow);
+        Time.zone(Local_Offset());
+    }
+    unsigned long local = Time.local();
+    clockSecond = local % 60;
+    clockMinute = (local/60) % 60;
+    clockHour = (local/3600) % 24;
+    clockDayNumber = local/86400;
+    clockWeekday = (clockDayNumber + 4) % 7 + 1; // 01-01-1970 was a Thursday, Sunday = 1 like Time.weekday()
+}
+
 // returns corresponding CCT or brightness from the 24-value LUTs based on time of day
 float ArioCtrl::ValExtractor_LUT24(uint16_t* dataArray){
     int diff = 0;
-    int hour = Time.hour();
-    float perc = (float)(currentSecond+Time.minute()*60)/3600;
+    int hour = clockHour;
+    float perc = (float)(clockSecond+clockMinute*60)/3600;
     if(23 == hour){
         diff = dataArray[0] - dataArray[hour];
     } else {
@@ -1080,20 +2274,221 @@ void ArioCtrl::ColorDens_Calc(float cctTarget){
     }
 }
 
+void ArioCtrl::Gamma_LUT_Init(void){
+    for(int level = 0; level <= MAX_BRIGHTNESS; level++){
+        LED_Gamma_LUT[level] = powf((float)level/MAX_BRIGHTNESS, LED_GAMMA)*(MAX_BRIGHTNESS << 8) + 0.5;
+    }
+}
+
 void ArioCtrl::PSoC_Load_LEDVal(float cctVal, float brightnessVal){
     currentCCT = cctVal;
     currentLevel = brightnessVal;
     ColorDens_Calc(currentCCT);
+    float level = constrain(currentLevel, MIN_BRIGHTNESS, MAX_BRIGHTNESS);
+    int index = level;
+    float intensity = LED_Gamma_LUT[index];
+    if(index < MAX_BRIGHTNESS){
+        intensity += (level - index)*(LED_Gamma_LUT[index + 1] - LED_Gamma_LUT[index]);
+    }
     for(int ch = 0; ch < NUM_LED_CH; ch++){
-        LED_CH_Dens[ch] = LED_COLOR_Cramer[ch]*currentLevel; // convert to byte
-        i2cSendBuffer[ch+2] = LED_CH_Dens[ch]; // can be further optimized here
+        uint16_t target = LED_COLOR_Cramer[ch]*intensity;
+        if(target != LED_CH_Intensity[ch]) ditherSettleMarker = millis();
+        LED_CH_Intensity[ch] = target;
     }
-    Wire.beginTransmission(PSOC_ADDR);
-    Wire.write(2);
-    for(int i = 2; i < (NUM_LED_CH+2); i++){
-        Wire.write(i2cSendBuffer[i]);
+    PSoC_Dither_Tick();
+}
+
+// First order sigma-delta: low channels alternate between the two nearest register values so their average matches
+// the 8.8 intensity. The PSoC is only written when a register value actually changes. The dither is for fades, where
+// a whole step at a time is visible. Once the target has held for LED_DITHER_WINDOW the channels are rounded, which is
+// within half a step, and the dither stops instead of writing a frame every tick for as long as the lamp stays there.
+void ArioCtrl::PSoC_Dither_Tick(void){
+    bool changed = !ledFrameSent;
+    bool settled = (millis() - ditherSettleMarker >= LED_DITHER_WINDOW);
+    ditherActive = FALSE;
+    for(int ch = 0; ch < NUM_LED_CH; ch++){
+        uint16_t intensity = LED_CH_Intensity[ch];
+        if(((intensity >> 8) < LED_DITHER_CEILING) && !settled){
+            intensity &= ~((1 << (8 - LED_DITHER_BITS)) - 1); // drop the bits below the dither resolution
+            uint16_t acc = intensity + LED_CH_DitherErr[ch];
+            LED_CH_Dens[ch] = acc >> 8;
+            LED_CH_DitherErr[ch] = acc & 0xFF;
+            if(intensity & 0xFF) ditherActive = TRUE;
+        } else{
+            LED_CH_Dens[ch] = (intensity + 0x80) >> 8;
+            LED_CH_DitherErr[ch] = 0;
+        }
+        if(i2cSendBuffer[ch+2] != LED_CH_Dens[ch]){
+            i2cSendBuffer[ch+2] = LED_CH_Dens[ch];
+            changed = TRUE;
+        }
+    }
+    ditherMarker = millis();
+    if(!changed) return;
+    PSoC_Queue_Write(2, &i2cSendBuffer[2], NUM_LED_CH);
+    ledFrameSent = TRUE;
+}
+
+
+/*************************************************************************************************************
+/
+/               Benchmark
+/
+*************************************************************************************************************/
+// Cycle counts of the hot paths, measured on the lamp itself. The kernels run on copies or restore what they touch,
+// PSoC_Load_LEDVal runs with its frame write muted and the output state (mixing, dither accumulators, register image)
+// is put back afterwards, so a benchmark neither moves the dither nor queues frames. Scheduler() is not called here
+// since every mode has side effects, its passes are averaged as the lamp runs instead. ALS_Routine() is measured as
+// its per pass work, one sample and the level offset, since a whole acquisition spans ALS_SAMPLES_NUMBER passes.
+// The String dispatch of the cloud handlers in the .ino allocates and only runs on cloud requests, so it is not a
+// kernel here, the controller side text parsers are.
+void ArioCtrl::Benchmark_Run(void){
+    uint32_t best[BENCH_COUNT];
+    uint32_t overhead = 0xFFFFFFFFUL;
+    uint32_t start;
+    for(int i = 0; i < BENCH_COUNT; i++) best[i] = 0xFFFFFFFFUL;
+
+    RampChannel ramp;
+    memset(&ramp, 0, sizeof(ramp));
+    ramp.curve = RAMP_CURVE_PERCEPTUAL;
+    ramp.delta = 65535;
+    ramp.dest = MAX_BRIGHTNESS;
+    ramp.duration = 1000UL;
+    ramp.progressRecip = 0xFFFFFFFFUL/ramp.duration;
+    RampChannel linear = ramp;
+    linear.curve = RAMP_CURVE_LINEAR;
+    linear.delta = MAX_BRIGHTNESS;
+    linear.slope = linear.delta/linear.duration;
+    volatile float sink;
+
+    // every batch command with values in range and an unknown opcode at the end, so the frame is checked in full and
+    // nothing is applied
+    byte frame[64];
+    const byte opcodes[] = { CMD_POWER, CMD_LEVEL, CMD_CCT, CMD_WAKE_ENABLE, CMD_WAKE_SET, CMD_BED_ENABLE, CMD_BED_SET,
+                             CMD_PIR, CMD_PIR_SCHEDULE, CMD_ALS, CMD_ZONE, CMD_ALARM_ADD, CMD_DST };
+    unsigned int frameLength = 0;
+    memset(frame, 1, sizeof(frame)); // Sunday, 01:01, enabled, wake alarm, uploaded program
+    for(unsigned int i = 0; i < sizeof(opcodes); i++){
+        frame[frameLength] = opcodes[i];
+        if(CMD_ALS == opcodes[i]) frame[frameLength + 2] = ALS_SENSITIVITY_DEFAULT;
+        frameLength += 1 + Command_Length(opcodes[i]);
+    }
+    frame[frameLength++] = 0xFF;
+    AlarmText alarmText;
+    byte segment[PROGRAM_SEGMENT_BYTES];
+
+    // output state PSoC_Load_LEDVal moves
+    float savedCramer[NUM_LED_CH];
+    uint16_t savedIntensity[NUM_LED_CH], savedDitherErr[NUM_LED_CH];
+    byte savedDens[NUM_LED_CH], savedSend[NUM_BYTES_WRITE];
+    memcpy(savedCramer, LED_COLOR_Cramer, sizeof(savedCramer));
+    memcpy(savedIntensity, LED_CH_Intensity, sizeof(savedIntensity));
+    memcpy(savedDitherErr, LED_CH_DitherErr, sizeof(savedDitherErr));
+    memcpy(savedDens, LED_CH_Dens, sizeof(savedDens));
+    memcpy(savedSend, i2cSendBuffer, sizeof(savedSend));
+    bool savedFrameSent = ledFrameSent, savedDitherActive = ditherActive;
+    unsigned long savedDitherMarker = ditherMarker, savedSettleMarker = ditherSettleMarker;
+    float cct = currentCCT, level = currentLevel;
+    benchMuted = TRUE;
+
+    for(int n = 0; n < BENCH_ITERATIONS; n++){
+        uint32_t cycles;
+        start = System.ticks();
+        cycles = System.ticks() - start;
+        if(cycles < overhead) overhead = cycles;
+
+        start = System.ticks();
+        ColorDens_Calc(MIN_CCT + n*(CCT_6500 - MIN_CCT)/BENCH_ITERATIONS); // walks all mixing ranges
+        cycles = System.ticks() - start;
+        if(cycles < best[BENCH_COLOR_DENS]) best[BENCH_COLOR_DENS] = cycles;
+
+        start = System.ticks();
+        PSoC_Load_LEDVal(cct, level);
+        cycles = System.ticks() - start;
+        if(cycles < best[BENCH_LOAD_LEDVAL]) best[BENCH_LOAD_LEDVAL] = cycles;
+
+        start = System.ticks();
+        sink = ValExtractor_LUT24(loaded_cctArry);
+        cycles = System.ticks() - start;
+        if(cycles < best[BENCH_LUT24]) best[BENCH_LUT24] = cycles;
+
+        start = System.ticks();
+        sink = Ramp_Channel_Value(&ramp, n*ramp.duration/BENCH_ITERATIONS);
+        cycles = System.ticks() - start;
+        if(cycles < best[BENCH_RAMP_VALUE]) best[BENCH_RAMP_VALUE] = cycles;
+
+        start = System.ticks();
+        sink = Ramp_Channel_Value(&linear, n*linear.duration/BENCH_ITERATIONS);
+        cycles = System.ticks() - start;
+        if(cycles < best[BENCH_RAMP_LINEAR]) best[BENCH_RAMP_LINEAR] = cycles;
+
+        start = System.ticks();
+        Command_Batch_Apply(frame, frameLength);
+        cycles = System.ticks() - start;
+        if(cycles < best[BENCH_BATCH_PARSE]) best[BENCH_BATCH_PARSE] = cycles;
+
+#if SENSOR_ALS_AVAILABLE
+        start = System.ticks();
+        sink = ALS_Level_Offset(analogRead(PIN_SENSOR_ALS), ALS_SENSITIVITY_MEDIUM);
+        cycles = System.ticks() - start;
+        if(cycles < best[BENCH_ALS]) best[BENCH_ALS] = cycles;
+#endif
+
+        start = System.ticks();
+        Alarm_Text_Parse("2,1,0630,120", &alarmText);
+        Hex_Decode("A00FFF0130750000E80300000000", segment, PROGRAM_SEGMENT_BYTES);
+        cycles = System.ticks() - start;
+        if(cycles < best[BENCH_TEXT_PARSE]) best[BENCH_TEXT_PARSE] = cycles;
+    }
+    (void)sink;
+
+    benchMuted = FALSE;
+    memcpy(LED_COLOR_Cramer, savedCramer, sizeof(savedCramer));
+    memcpy(LED_CH_Intensity, savedIntensity, sizeof(savedIntensity));
+    memcpy(LED_CH_DitherErr, savedDitherErr, sizeof(savedDitherErr));
+    memcpy(LED_CH_Dens, savedDens, sizeof(savedDens));
+    memcpy(i2cSendBuffer, savedSend, sizeof(savedSend));
+    ledFrameSent = savedFrameSent;
+    ditherActive = savedDitherActive;
+    ditherMarker = savedDitherMarker;
+    ditherSettleMarker = savedSettleMarker;
+    currentCCT = cct;
+    currentLevel = level;
+
+    for(int i = 0; i < BENCH_COUNT; i++){
+        if((i >= BENCH_SCHEDULER) && (i < BENCH_SCHEDULER + BENCH_MODE_COUNT)) continue;
+        benchResult[i] = (0xFFFFFFFFUL == best[i]) ? 0 : best[i] - overhead; // 0 for a kernel compiled out
+    }
+    for(int mode = 0; mode < BENCH_MODE_COUNT; mode++){
+        benchResult[BENCH_SCHEDULER + mode] = benchSchedulerPasses[mode] ? benchSchedulerCycles[mode]/benchSchedulerPasses[mode] : 0;
+    }
+}
+
+void ArioCtrl::Benchmark_Save_Baseline(void){
+    for(int i = 0; i < BENCH_COUNT; i++){
+        for(int b = 0; b < 4; b++) Setting_Write(BENCH_BASELINE_ADDR + i*4 + b, (benchResult[i] >> (8*b)) & 0xFF);
+    }
+}
+
+// "name,cycles;..." from the last Benchmark_Run(), with compare "name,cycles,baseline,delta %;...", s0-s6 are the
+// Scheduler() modes and a mode that never ran reports 0
+void ArioCtrl::Benchmark_Report(char* buffer, size_t size, bool compare){
+    static const char* benchNames[BENCH_COUNT] = { "cd", "led", "lut", "ramp", "batch", "s0", "s1", "s2", "s3", "s4", "s5", "s6",
+                                                   "als", "text", "rlin" };
+    int length = 0;
+    buffer[0] = 0;
+    for(int i = 0; (i < BENCH_COUNT) && (length < (int)size); i++){
+        length += snprintf(buffer + length, size - length, "%s%s,%lu", (0 == i) ? "" : ";", benchNames[i], (unsigned long)benchResult[i]);
+        if(!compare || (length >= (int)size)) continue;
+        uint32_t baseline = 0;
+        for(int b = 0; b < 4; b++) baseline |= (uint32_t)EEPROM.read(BENCH_BASELINE_ADDR + i*4 + b) << (8*b);
+        if((BENCH_NO_BASELINE == baseline) || (0 == baseline)){
+            length += snprintf(buffer + length, size - length, ",-,-");
+        } else{
+            long delta = ((long)benchResult[i] - (long)baseline)*100L/(long)baseline;
+            length += snprintf(buffer + length, size - length, ",%lu,%+ld", (unsigned long)baseline, delta);
+        }
     }
-    Wire.endTransmission();
 }
 
 
@@ -1103,38 +2498,44 @@ void ArioCtrl::PSoC_Load_LEDVal(float cctVal, float brightnessVal){
 /
 *************************************************************************************************************/
 void ArioCtrl::Cloud_Print_Schedule(void){
-    String publishString1 = "";
-    for(int i = 0; i < 24; i++){
-        String smallString = String(loaded_cctArry[i]);
-        publishString1.concat(" ");
-        publishString1.concat(smallString);
-    }
-    Cloud_Debug_Print("CCT Schedule: ",publishString1);
-    String publishString2 = "";
+    FixedString<24*6> publishString1, publishString2; // " 65535" at most per hour
     for(int i = 0; i < 24; i++){
-        String smallString = String(loaded_levelArry[i]);
-        publishString2.concat(" ");
-        publishString2.concat(smallString);
+        publishString1.Append(' ').Append_Uint(loaded_cctArry[i]);
+        publishString2.Append(' ').Append_Uint(loaded_levelArry[i]);
     }
-    Cloud_Debug_Print("Brightness Schedule: ",publishString2);
+    Cloud_Debug_Print("CCT Schedule: ", publishString1.c_str());
+    Cloud_Debug_Print("Brightness Schedule: ", publishString2.c_str());
+}
+
+void ArioCtrl::Cloud_Print_Perf(void){
+    FixedString<100> publishString("i2c");
+    I2CBusStats snap;
+    SINGLE_THREADED_BLOCK(){ snap = busStats; }
+    I2C_Stats_Roll(&snap, millis()); // on the copy, the counters belong to the output thread
+    const unsigned long stats[] = { snap.lastMinuteTransactions, snap.lastMinuteBytes, snap.transactions, snap.bytes,
+                                    snap.nacks, snap.timeouts, snap.retries, snap.failures };
+    for(unsigned int i = 0; i < sizeof(stats)/sizeof(stats[0]); i++) publishString.Append(',').Append_Uint(stats[i]);
+    Cloud_Debug_Print("Perf: ", publishString.c_str());
 }
 
-void ArioCtrl::Cloud_Debug_Print(String str){
+void ArioCtrl::Cloud_Debug_Print(const char* str){
     if((EEPROM.read(CLOUD_DEBUG_ADDR) == TRUE) && Particle.connected()){
         Particle.publish(str);
     }
 }
 
-void ArioCtrl::Cloud_Debug_Print(String msgType, String payload){
+void ArioCtrl::Cloud_Debug_Print(const char* msgType, const char* payload){
     if((EEPROM.read(CLOUD_DEBUG_ADDR) == TRUE) && Particle.connected()){
         Particle.publish(msgType, payload);
     }
 }
 
-void ArioCtrl::Report_to_Cloud(String msgType, String payload){
+void ArioCtrl::Report_to_Cloud(const char* msgType, const char* payload){
+#if CLOUD_REPORT_ENABLED
     if(Particle.connected()){
         Particle.publish(msgType, payload);
     }else{
         //record everything if not connected to cloud, wait for reconnection or reboot then push data
     }
+#endif
 }
@@ -0,0 +1,109 @@
+// Generated from ArioLamp_0-2-6-15nw/ario_latency.cpp by tools/generate_fw15.cmake, do not edit
+/************************************************************************************************************************************/
+/** @file       ario_latency.cpp
+ *  @brief      worst case loop stage latency recorder that survives a watchdog reset
+ *  @details    loop() is split into stages. Each stage is timed with micros() and the LATENCY_TOP_N slowest ones are kept,
+ *              with the lamp context, in retained backup SRAM. The stage in progress is marked there too, so when the
+ *              watchdog resets a stalled loop the next boot still knows which stage never finished. Begin() copies the
+ *              retained log aside before this boot starts recording, to be reported over the cloud or USB serial.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "ario_latency.h"
+
+LatencyMonitor::LatencyMonitor(LatencyLog* log){
+    this->log       = log;
+    previousValid   = FALSE;
+    resetReason     = RESET_REASON_NONE;
+    mode            = 0;
+    nwMode          = 0;
+    ramp            = 0;
+    stageStart      = 0;
+}
+
+// Call first thing in setup(), before any stage is timed
+void LatencyMonitor::Begin(void){
+    resetReason = System.resetReason();
+    previousValid = (LATENCY_LOG_MAGIC == log->magic); // backup SRAM holds garbage after a power loss
+    if(previousValid){
+        previous = *log;
+    }
+    memset(log, 0, sizeof(LatencyLog));
+    log->magic = LATENCY_LOG_MAGIC;
+    log->boots = previousValid ? previous.boots + 1 : 0;
+    log->open.stage = LATENCY_STAGE_NONE;
+}
+
+void LatencyMonitor::Set_Context(uint8_t mode, uint8_t nwMode, uint8_t ramp){
+    this->mode = mode;
+    this->nwMode = nwMode;
+    this->ramp = ramp;
+}
+
+void LatencyMonitor::Stage_Begin(uint8_t stage){
+    stageStart = micros();
+    log->open.stage = stage;
+    log->open.uptime = millis();
+    log->open.mode = mode;
+    log->open.nwMode = nwMode;
+    log->open.ramp = ramp;
+}
+
+// ends the running stage and starts the next one
+void LatencyMonitor::Stage_Next(uint8_t stage){
+    uint32_t now = micros();
+    uint32_t duration = now - stageStart;
+    if((LATENCY_STAGE_NONE != log->open.stage) && (duration > log->top[LATENCY_TOP_N - 1].duration)){ // only slower than the current top N costs anything
+        Record(log->open.stage, duration);
+    }
+    Stage_Begin(stage);
+}
+
+// last stage of loop(), whatever runs until the next pass is counted as LATENCY_STAGE_SYSTEM
+void LatencyMonitor::Loop_End(void){
+    Stage_Next(LATENCY_STAGE_SYSTEM);
+}
+
+void LatencyMonitor::Record(uint8_t stage, uint32_t duration){
+    int i = LATENCY_TOP_N - 1;
+    while((i > 0) && (log->top[i - 1].duration < duration)){
+        log->top[i] = log->top[i - 1];
+        i--;
+    }
+    LatencyRecord* rec = &log->top[i];
+    rec->duration = duration;
+    rec->time = Time.isValid() ? Time.now() : 0;
+    rec->uptime = millis();
+    rec->stage = stage;
+    rec->mode = mode;
+    rec->nwMode = nwMode;
+    rec->ramp = ramp;
+}
+
+// "boots,reset reason of this boot,open stage,open uptime s;stage,us,mode,nwMode,ramp,uptime s;..." slowest first, open stage 255 if none
+void LatencyMonitor::Report(char* buffer, size_t size, bool previousBoot){
+    const LatencyLog* src = previousBoot ? &previous : log;
+    if(previousBoot && !previousValid){
+        snprintf(buffer, size, "none");
+        return;
+    }
+    int length = snprintf(buffer, size, "%lu,%d,%u,%lu", (unsigned long)src->boots, resetReason,
+                          src->open.stage, (unsigned long)src->open.uptime/1000);
+    for(int i = 0; (i < LATENCY_TOP_N) && (0 != src->top[i].duration) && (length < (int)size); i++){
+        const LatencyRecord* rec = &src->top[i];
+        length += snprintf(buffer + length, size - length, ";%u,%lu,%u,%u,%u,%lu", rec->stage, (unsigned long)rec->duration,
+                           rec->mode, rec->nwMode, rec->ramp, (unsigned long)rec->uptime/1000);
+    }
+}
+
+// offline path, the previous boot's log over USB serial
+void LatencyMonitor::Serial_Dump(void){
+    char buffer[256];
+    Report(buffer, sizeof(buffer), TRUE);
+    Serial.print("latency,");
+    Serial.println(buffer);
+}
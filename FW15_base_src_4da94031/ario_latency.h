@@ -0,0 +1,75 @@
+// Generated from ArioLamp_0-2-6-15nw/ario_latency.h by tools/generate_fw15.cmake, do not edit
+/************************************************************************************************************************************/
+/** @file       ario_latency.h
+ *  @brief      see ario_latency.cpp for description
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef ario_latency_h
+#define ario_latency_h
+
+#include "application.h"
+
+#define LATENCY_TOP_N               8
+#define LATENCY_LOG_MAGIC           0x4C41540AUL // changes whenever LatencyLog changes layout
+
+#define LATENCY_STAGE_STATE         0 // stateVarConstructor
+#define LATENCY_STAGE_SCHEDULER     1
+#define LATENCY_STAGE_BUTTONS       2
+#define LATENCY_STAGE_STATUS_LED    3
+#define LATENCY_STAGE_PIR           4
+#define LATENCY_STAGE_ALS           5
+#define LATENCY_STAGE_TIME          6 // timeCheck
+#define LATENCY_STAGE_SYSTEM        7 // between two loop() passes, system and cloud processing
+#define LATENCY_STAGE_MEMORY        8 // heap and stack telemetry sample
+#define LATENCY_STAGE_NONE          0xFF
+
+// One slow stage and what the lamp was doing at the time
+struct LatencyRecord {
+    uint32_t duration;      // us, 0 for an empty slot
+    uint32_t time;          // UTC seconds, 0 if the clock was not set yet
+    uint32_t uptime;        // ms since boot
+    uint8_t stage;          // LATENCY_STAGE_*
+    uint8_t mode;           // operatingMode
+    uint8_t nwMode;
+    uint8_t ramp;           // bit 0 CCT ramp running, bit 1 level ramp running
+};
+
+// Kept in retained backup SRAM. open is the stage running right now, so after a watchdog reset it names the stage that stalled.
+struct LatencyLog {
+    uint32_t magic;
+    uint32_t boots;
+    LatencyRecord top[LATENCY_TOP_N]; // slowest first
+    LatencyRecord open;               // duration unused
+};
+
+class LatencyMonitor
+{
+    public:
+        LatencyMonitor(LatencyLog* log);
+
+        void Begin(void);
+        void Set_Context(uint8_t mode, uint8_t nwMode, uint8_t ramp);
+        void Stage_Begin(uint8_t stage);
+        void Stage_Next(uint8_t stage);
+        void Loop_End(void);
+        void Report(char* buffer, size_t size, bool previousBoot);
+        void Serial_Dump(void);
+
+        bool previousValid;         // the log of the boot before this one survived the reset
+        int resetReason;            // System.resetReason() of this boot
+        LatencyLog previous;        // copy of the retained log from before this boot
+
+    private:
+        LatencyLog* log;
+        uint8_t mode, nwMode, ramp;
+        uint32_t stageStart;
+
+        void Record(uint8_t stage, uint32_t duration);
+};
+
+#endif
@@ -0,0 +1,165 @@
+// Generated from ArioLamp_0-2-6-15nw/ario_memory.cpp by tools/generate_fw15.cmake, do not edit
+/************************************************************************************************************************************/
+/** @file       ario_memory.cpp
+ *  @brief      heap and stack telemetry to catch slow fragmentation before it resets the lamp
+ *  @details    Every MEMORY_SAMPLE_PERIOD the free heap, the largest block that can still be allocated, the number of free
+ *              fragments, the untouched application stack and the most allocations one loop() pass made are sampled into
+ *              a ring in retained backup SRAM, together with the worst value of each seen this boot. The stack between
+ *              its real bottom (os_thread_current_stack()) and setup()'s frame is painted with MEMORY_STACK_PATTERN in
+ *              Begin() and the high-water mark is where the pattern stops; the largest block is found by a binary search of
+ *              trial allocations that are released right away. The search stops at MEMORY_PROBE_LIMIT, so a probe never
+ *              takes the heap anywhere near empty, and it only runs from the periodic sample.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "ario_memory.h"
+#include <malloc.h>
+
+volatile uint32_t memoryAllocations = 0;
+
+// Weak, so a build without --wrap still links. The wrappers are only ever called when the wrap is in place.
+extern "C" void* __real_malloc(size_t size) __attribute__((weak));
+extern "C" void* __real_calloc(size_t count, size_t size) __attribute__((weak));
+extern "C" void* __real_realloc(void* block, size_t size) __attribute__((weak));
+
+// Stack bounds of the calling thread from the platform, weak as well: without it nothing is painted and stackFree reads 0
+int os_thread_current_stack(void** bottom, void** top) __attribute__((weak));
+
+extern "C" void* __wrap_malloc(size_t size){
+    memoryAllocations++;
+    return __real_malloc(size);
+}
+
+extern "C" void* __wrap_calloc(size_t count, size_t size){
+    memoryAllocations++;
+    return __real_calloc(count, size);
+}
+
+extern "C" void* __wrap_realloc(void* block, size_t size){
+    memoryAllocations++;
+    return __real_realloc(block, size);
+}
+
+MemoryMonitor::MemoryMonitor(MemoryLog* log){
+    this->log       = log;
+    stackBottom     = NULL;
+    stackPainted    = 0;
+    loopMarker      = 0;
+    loopAllocsMax   = 0;
+    sampleMarker    = 0;
+}
+
+// Call from setup(), while the application thread stack is still shallow. Paints from just under this frame down to the
+// bottom of the thread's stack, or MEMORY_STACK_PAINT bytes if the stack is deeper than that.
+void MemoryMonitor::Begin(void){
+    if(MEMORY_LOG_MAGIC != log->magic){ // backup SRAM holds garbage after a power loss
+        memset(log, 0, sizeof(MemoryLog));
+        log->magic = MEMORY_LOG_MAGIC;
+    }
+    memset(&log->worst, 0xFF, sizeof(log->worst));
+    log->worst.freeChunks = 0;
+    log->worst.loopAllocs = 0;
+    void* bottom;
+    void* top;
+    uint8_t here;
+    uintptr_t end = (uintptr_t)&here - MEMORY_STACK_GUARD;
+    if((NULL != os_thread_current_stack) && (0 == os_thread_current_stack(&bottom, &top)) && ((uintptr_t)bottom < end) && ((uintptr_t)&here < (uintptr_t)top)){
+        uintptr_t start = (end - (uintptr_t)bottom > MEMORY_STACK_PAINT) ? end - MEMORY_STACK_PAINT : (uintptr_t)bottom;
+        stackBottom = (uint8_t*)start;
+        stackPainted = end - start;
+        memset(stackBottom, MEMORY_STACK_PATTERN, stackPainted);
+    }
+    loopMarker = memoryAllocations;
+    sampleMarker = millis() - MEMORY_SAMPLE_PERIOD; // first sample on the first loop
+}
+
+void MemoryMonitor::Loop(void){
+    uint32_t allocations = memoryAllocations - loopMarker;
+    if(allocations > loopAllocsMax) loopAllocsMax = (allocations < 0xFFFF) ? allocations : 0xFFFF;
+    if(millis() - sampleMarker >= MEMORY_SAMPLE_PERIOD){
+        sampleMarker = millis();
+        MemoryRecord* rec = &log->ring[log->head];
+        Sample(rec, TRUE);
+        loopAllocsMax = 0;
+        log->head = (log->head + 1) % MEMORY_RING_SIZE;
+        if(log->count < MEMORY_RING_SIZE) log->count++;
+        if(rec->freeHeap < log->worst.freeHeap) log->worst.freeHeap = rec->freeHeap;
+        if(rec->largestBlock < log->worst.largestBlock) log->worst.largestBlock = rec->largestBlock;
+        if(rec->freeChunks > log->worst.freeChunks) log->worst.freeChunks = rec->freeChunks;
+        if(rec->stackFree < log->worst.stackFree) log->worst.stackFree = rec->stackFree;
+        if(rec->loopAllocs > log->worst.loopAllocs) log->worst.loopAllocs = rec->loopAllocs;
+    }
+    loopMarker = memoryAllocations; // the probe's own allocations are not the next pass's
+}
+
+// Without probe the largest block is the one found by the last periodic sample
+void MemoryMonitor::Sample(MemoryRecord* rec, bool probe){
+    struct mallinfo heap = mallinfo();
+    rec->uptime = millis()/1000;
+    rec->freeHeap = System.freeMemory();
+    if(probe){
+        rec->largestBlock = Largest_Block((rec->freeHeap < MEMORY_PROBE_LIMIT) ? rec->freeHeap : MEMORY_PROBE_LIMIT);
+    } else{
+        rec->largestBlock = log->count ? log->ring[(log->head + MEMORY_RING_SIZE - 1) % MEMORY_RING_SIZE].largestBlock : 0;
+    }
+    rec->freeChunks = heap.ordblks;
+    rec->stackFree = Stack_Free();
+    rec->loopAllocs = loopAllocsMax;
+}
+
+uint32_t MemoryMonitor::Largest_Block(uint32_t limit){
+    void* block = malloc(limit); // the common case, a healthy heap answers with one allocation
+    if(NULL != block){
+        free(block);
+        return limit;
+    }
+    uint32_t low = 0, high = limit;
+    while(high - low > MEMORY_PROBE_GRANULE){
+        uint32_t size = (low + high)/2;
+        block = malloc(size);
+        if(NULL != block){
+            free(block);
+            low = size;
+        } else{
+            high = size;
+        }
+    }
+    return low;
+}
+
+uint16_t MemoryMonitor::Stack_Free(void){
+    if(NULL == stackBottom) return 0;
+    uint16_t untouched = 0;
+    while((untouched < stackPainted) && (MEMORY_STACK_PATTERN == stackBottom[untouched])) untouched++;
+    return untouched;
+}
+
+// "free,largest,chunks,stack,allocs;worst free,worst largest,most chunks,least stack,most allocs" right now (largest
+// from the last periodic sample, a cloud request does not probe the heap, allocs of the busiest pass since then), or with ring
+// "uptime s,free,largest,chunks,stack,allocs;..." newest first, as many as fit
+void MemoryMonitor::Report(char* buffer, size_t size, bool ring){
+    int length = 0;
+    buffer[0] = 0;
+    if(!ring){
+        MemoryRecord now;
+        Sample(&now, FALSE);
+        snprintf(buffer, size, "%lu,%lu,%u,%u,%u;%lu,%lu,%u,%u,%u", (unsigned long)now.freeHeap, (unsigned long)now.largestBlock,
+                 now.freeChunks, now.stackFree, now.loopAllocs, (unsigned long)log->worst.freeHeap,
+                 (unsigned long)log->worst.largestBlock, log->worst.freeChunks, log->worst.stackFree, log->worst.loopAllocs);
+        return;
+    }
+    for(int i = 1; i <= log->count; i++){
+        const MemoryRecord* rec = &log->ring[(log->head + MEMORY_RING_SIZE - i) % MEMORY_RING_SIZE];
+        char entry[56];
+        int entryLength = snprintf(entry, sizeof(entry), "%s%lu,%lu,%lu,%u,%u,%u", (1 == i) ? "" : ";", (unsigned long)rec->uptime,
+                                   (unsigned long)rec->freeHeap, (unsigned long)rec->largestBlock, rec->freeChunks, rec->stackFree,
+                                   rec->loopAllocs);
+        if(length + entryLength >= (int)size) break;
+        memcpy(buffer + length, entry, entryLength + 1);
+        length += entryLength;
+    }
+}
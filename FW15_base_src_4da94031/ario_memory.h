@@ -0,0 +1,71 @@
+// Generated from ArioLamp_0-2-6-15nw/ario_memory.h by tools/generate_fw15.cmake, do not edit
+/************************************************************************************************************************************/
+/** @file       ario_memory.h
+ *  @brief      see ario_memory.cpp for description
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef ario_memory_h
+#define ario_memory_h
+
+#include "application.h"
+
+#define MEMORY_RING_SIZE            16
+#define MEMORY_SAMPLE_PERIOD        60000UL // ms, the ring covers the last 16 minutes
+#define MEMORY_LOG_MAGIC            0x4D454D02UL // changes whenever MemoryLog changes layout
+#define MEMORY_STACK_PAINT          4096    // bytes painted below setup()'s frame at most, the application thread has 6 KB
+#define MEMORY_STACK_GUARD          256     // left unpainted under the painting function's own frame
+#define MEMORY_STACK_PATTERN        0xA5
+#define MEMORY_PROBE_GRANULE        16      // largest free block is found to this many bytes
+#define MEMORY_PROBE_LIMIT          4096    // trial allocations stop here, a larger block is reported as this size
+
+// One heap and stack sample
+struct MemoryRecord {
+    uint32_t uptime;        // s since boot
+    uint32_t freeHeap;      // System.freeMemory()
+    uint32_t largestBlock;  // largest single allocation that would succeed, up to MEMORY_PROBE_LIMIT
+    uint16_t freeChunks;    // free fragments in the heap, grows with fragmentation
+    uint16_t stackFree;     // painted application stack never touched so far
+    uint16_t loopAllocs;    // most allocations a single loop() pass made since the previous sample
+};
+
+// Kept in retained backup SRAM and not cleared on boot, so the trend up to a reset can still be read after it. A reset
+// shows up as uptime going back to a small value.
+struct MemoryLog {
+    uint32_t magic;
+    uint8_t head, count;              // next slot to write, valid records
+    MemoryRecord ring[MEMORY_RING_SIZE];
+    MemoryRecord worst;               // watermarks of this boot, most fragments and allocations and least of everything else
+};
+
+// malloc, calloc and realloc calls so far. Counted by wrappers the linker puts in front of them
+// (-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc), stays 0 in a build without the wrap.
+extern volatile uint32_t memoryAllocations;
+
+class MemoryMonitor
+{
+    public:
+        MemoryMonitor(MemoryLog* log);
+
+        void Begin(void);
+        void Loop(void);
+        void Sample(MemoryRecord* rec, bool probe);
+        void Report(char* buffer, size_t size, bool ring);
+
+    private:
+        MemoryLog* log;
+        uint8_t* stackBottom;       // lowest painted stack byte
+        uint16_t stackPainted;      // bytes painted from stackBottom up
+        uint32_t loopMarker;        // memoryAllocations at the end of the previous Loop()
+        uint16_t loopAllocsMax;     // most allocations of one pass since the previous sample
+        unsigned long sampleMarker;
+
+        uint32_t Largest_Block(uint32_t limit);
+        uint16_t Stack_Free(void);
+};
+
+#endif
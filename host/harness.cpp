@@ -0,0 +1,114 @@
+/************************************************************************************************************************************/
+/** @file       harness.cpp
+ *  @brief      see harness.h
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+
+LampHarness::LampHarness(){
+    activeStep  = HARNESS_ACTIVE_STEP;
+    idleStep    = HARNESS_IDLE_STEP;
+    beforePass  = NULL;
+    afterPass   = NULL;
+    passes      = 0;
+    inputMarker = 0;
+}
+
+// Power on with the clock already synced and the factory test done. An offline lamp never waits for the cloud.
+void LampHarness::Boot(time_t utc, bool offline){
+    Host_Device_Reset();
+    hostDevice.eeprom[FACTORY_TEST_MODE_ADDR] = 1;
+    if(offline) hostDevice.eeprom[OFFLINE_MODE_ADDR] = 1;
+    hostDevice.cloudConnected = !offline;
+    Host_Time_Set(utc);
+    setup();
+    passes = 0;
+}
+
+void LampHarness::Run_For(unsigned long ms){
+    Run_Until(hostDevice.clockUs + (uint64_t)ms*1000);
+}
+
+void LampHarness::Run_To(time_t utc){
+    if(utc <= Time.now()) return;
+    Run_Until((uint64_t)(utc - hostDevice.utcBase)*1000000);
+}
+
+void LampHarness::Pin_Set(uint16_t pin, int32_t level){
+    if(hostDevice.pins[pin] != level) inputMarker = millis();
+    hostDevice.pins[pin] = level;
+}
+
+void LampHarness::Press(uint16_t pin, unsigned long ms){
+    Pin_Set(pin, HIGH);
+    Run_For(ms);
+    Pin_Set(pin, LOW);
+}
+
+int LampHarness::Cloud(const char* name, const char* arg){
+    return Host_Cloud_Call(name, arg);
+}
+
+// Uploads a custom program segment by segment the way the app does it ("PROG,<n>,<hex>", then "PROG,LEN,<length>")
+bool LampHarness::Program_Upload(const LampSegment* segments, unsigned int length){
+    for(unsigned int i = 0; i < length; i++){
+        const LampSegment* seg = &segments[i];
+        uint8_t packed[PROGRAM_SEGMENT_BYTES] = { (uint8_t)seg->cct, (uint8_t)(seg->cct >> 8), seg->level, seg->flags };
+        for(int b = 0; b < 4; b++){
+            packed[4 + b] = seg->duration >> (8*b);
+            packed[8 + b] = seg->hold >> (8*b);
+        }
+        packed[12] = seg->waitUntil;
+        packed[13] = seg->waitUntil >> 8;
+        char command[16 + 2*PROGRAM_SEGMENT_BYTES];
+        int n = snprintf(command, sizeof(command), "PROG,%u,", i);
+        for(int b = 0; b < PROGRAM_SEGMENT_BYTES; b++) n += snprintf(command + n, sizeof(command) - n, "%02X", packed[b]);
+        if(200 != Cloud("arioSet", command)) return FALSE;
+    }
+    char command[16];
+    snprintf(command, sizeof(command), "PROG,LEN,%u", length);
+    return 200 == Cloud("arioSet", command);
+}
+
+// Anything that changes output between two idle steps
+bool LampHarness::Busy(void){
+    if(aCtrl.Ramp_State()) return TRUE;
+    if((MODE_DEFAULT != aCtrl.operatingMode) && (MODE_ADJUST != aCtrl.operatingMode)) return TRUE;
+    return millis() - inputMarker < HARNESS_INPUT_SETTLE;
+}
+
+void LampHarness::Run_Until(uint64_t deadlineUs){
+    while(hostDevice.clockUs < deadlineUs){
+        if(NULL != beforePass) beforePass();
+        loop();
+        passes++;
+        if(NULL != afterPass) afterPass();
+        uint64_t next = hostDevice.clockUs + (uint64_t)(Busy() ? activeStep : idleStep)*1000;
+        if(next > deadlineUs) next = deadlineUs;
+        if(next > hostDevice.clockUs) Host_Clock_Advance(next - hostDevice.clockUs); // delay() in loop() may have gone past
+    }
+}
+
+static int harnessFailures = 0;
+
+bool Harness_Expect(bool condition, const char* format, ...){
+    if(condition) return TRUE;
+    va_list args;
+    va_start(args, format);
+    printf("FAIL: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    harnessFailures++;
+    return FALSE;
+}
+
+int Harness_Result(void){
+    printf("%s, %d failure%s\n", harnessFailures ? "FAILED" : "PASSED", harnessFailures, (1 == harnessFailures) ? "" : "s");
+    return harnessFailures ? 1 : 0;
+}
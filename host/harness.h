@@ -0,0 +1,62 @@
+/************************************************************************************************************************************/
+/** @file       harness.h
+ *  @brief      drives the lamp firmware on the host against the virtual clock
+ *  @details    LampHarness boots the sketch (setup()) and then calls loop() over and over, moving the virtual clock between
+ *              passes. While something is moving (a ramp, a program, a pressed button or a sensor edge) the clock steps by
+ *              activeStep, otherwise it jumps by idleStep, and never past the deadline Run_For/Run_To was given. Everything
+ *              that has to happen at a time is a deadline: a test runs to it, changes an input or calls a cloud function,
+ *              and runs on. beforePass/afterPass are called around every loop() for inputs that follow the clock and for
+ *              observing the lamp.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef harness_h
+#define harness_h
+
+#include "application.h"
+#include "globals.h"
+#include "ario_ctrlG.h"
+
+// the sketch
+void setup();
+void loop();
+extern ArioCtrl aCtrl;
+
+#define HARNESS_ACTIVE_STEP     RAMP_DELAY  // ms, every ramp tick gets its own pass
+#define HARNESS_IDLE_STEP       1000UL      // ms, the schedule and alarms resolve to the second
+#define HARNESS_INPUT_SETTLE    2000UL      // ms of active steps after an input changed, covers debounce and click windows
+
+typedef void (*HarnessHook)(void);
+
+class LampHarness
+{
+    public:
+        LampHarness();
+
+        unsigned long activeStep, idleStep;
+        HarnessHook beforePass, afterPass;
+        unsigned long passes;           // loop() calls since Boot
+
+        void Boot(time_t utc, bool offline);
+        void Run_For(unsigned long ms);
+        void Run_To(time_t utc);
+        void Pin_Set(uint16_t pin, int32_t level);
+        void Press(uint16_t pin, unsigned long ms);
+        int Cloud(const char* name, const char* arg);
+        bool Program_Upload(const LampSegment* segments, unsigned int length);
+        bool Busy(void);
+
+    private:
+        unsigned long inputMarker;
+        void Run_Until(uint64_t deadlineUs);
+};
+
+// Prints "FAIL: ..." and counts the failure when condition is false, a test exits with Harness_Result()
+bool Harness_Expect(bool condition, const char* format, ...) __attribute__((format(printf, 2, 3)));
+int Harness_Result(void);
+
+#endif
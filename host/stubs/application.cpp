@@ -0,0 +1,506 @@
+/************************************************************************************************************************************/
+/** @file       application.cpp (host)
+ *  @brief      Particle Device OS stand-in, see application.h
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "application.h"
+#include <chrono>
+#include <new>
+#include <pthread.h>
+#include <time.h>
+#include <ucontext.h>
+#if HOST_STD_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+HostDevice hostDevice;
+TimeClass Time;
+SystemClass System;
+CloudClass Particle;
+WiFiClass WiFi;
+RGBClass RGB;
+SerialClass Serial;
+EEPROMClass EEPROM;
+TwoWire Wire;
+
+void Host_Device_Reset(void){
+    hostDevice.clockUs = 0;
+    hostDevice.utcBase = 0;
+    hostDevice.timeValid = FALSE;
+    hostDevice.zone = 0;
+    memset(hostDevice.pins, 0, sizeof(hostDevice.pins));
+    memset(hostDevice.eeprom, 0xFF, sizeof(hostDevice.eeprom));
+    hostDevice.eepromWrites = 0;
+    hostDevice.functions.clear();
+    hostDevice.publishes.clear();
+    hostDevice.cloudConnected = FALSE;
+    hostDevice.serial.clear();
+    hostDevice.resetRequested = FALSE;
+    memset(hostDevice.psoc, 0, sizeof(hostDevice.psoc));
+    hostDevice.psocPointer = 0;
+    hostDevice.psocTrace.clear();
+    hostDevice.psocTraceMarker = 0;
+    hostDevice.psocTransactions = 0;
+    hostDevice.psocBytes = 0;
+    hostDevice.wireFailures = 0;
+    hostDevice.psocWritten = NULL;
+}
+
+void Host_Clock_Advance(uint64_t us){
+    hostDevice.clockUs += us;
+}
+
+void Host_Time_Set(time_t utc){
+    hostDevice.utcBase = utc - (time_t)(hostDevice.clockUs/1000000);
+    hostDevice.timeValid = TRUE;
+}
+
+void Host_Trace_Start(void){
+    hostDevice.psocTrace.clear();
+    hostDevice.psocTraceMarker = millis();
+    const uint8_t header[4] = { 0, 0, 0, HOST_PSOC_REGISTERS };
+    hostDevice.psocTrace.insert(hostDevice.psocTrace.end(), header, header + sizeof(header));
+    hostDevice.psocTrace.insert(hostDevice.psocTrace.end(), hostDevice.psoc, hostDevice.psoc + HOST_PSOC_REGISTERS);
+}
+
+int Host_Cloud_Call(const char* name, const char* arg){
+    std::map<std::string, cloud_function_t>::iterator handler = hostDevice.functions.find(name);
+    if(hostDevice.functions.end() == handler) return -1;
+    return handler->second(String(arg));
+}
+
+
+///////////////////////// pins and clock /////////////////////////
+void pinMode(uint16_t pin, PinMode mode){}
+
+int32_t digitalRead(uint16_t pin){
+    return (pin < HOST_PIN_COUNT) && hostDevice.pins[pin] ? HIGH : LOW;
+}
+
+int32_t analogRead(uint16_t pin){
+    return (pin < HOST_PIN_COUNT) ? hostDevice.pins[pin] : 0;
+}
+
+unsigned long millis(void){
+    return hostDevice.clockUs/1000;
+}
+
+unsigned long micros(void){
+    return hostDevice.clockUs;
+}
+
+// A blocking wait is time passing for everything else, the harness sees the clock jump when loop() returns
+void delay(unsigned long ms){
+    Host_Clock_Advance((uint64_t)ms*1000);
+}
+
+void delayMicroseconds(unsigned int us){
+    Host_Clock_Advance(us);
+}
+
+
+///////////////////////// threads /////////////////////////
+#if HOST_STD_THREADS
+// Each Thread is a detached std::thread, the host scheduler decides when it runs. Semaphores are a count under a mutex.
+struct Host_Semaphore {
+    std::mutex lock;
+    std::condition_variable given;
+    unsigned count, max;
+};
+
+static std::recursive_mutex hostBlockLock;
+
+Host_Block::Host_Block() : once(TRUE){
+    hostBlockLock.lock();
+}
+
+Host_Block::~Host_Block(){
+    hostBlockLock.unlock();
+}
+
+// A thread above OS_THREAD_PRIORITY_DEFAULT gets a real time priority where the host allows it (root or CAP_SYS_NICE),
+// so it preempts the application thread like on the device, otherwise it shares the CPU by the host's rules
+Thread::Thread(const char* name, os_thread_fn_t function, void* param, os_thread_prio_t priority, size_t stackSize){
+    std::thread thread(function, param);
+    if(priority > OS_THREAD_PRIORITY_DEFAULT){
+        struct sched_param schedule;
+        schedule.sched_priority = sched_get_priority_min(SCHED_FIFO) + priority - OS_THREAD_PRIORITY_DEFAULT;
+        pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &schedule);
+    }
+    thread.detach();
+}
+
+int os_thread_current_stack(void** bottom, void** top){
+    pthread_attr_t attr;
+    size_t size;
+    if(0 != pthread_getattr_np(pthread_self(), &attr)) return 1;
+    int result = pthread_attr_getstack(&attr, bottom, &size);
+    pthread_attr_destroy(&attr);
+    *top = (char*)*bottom + size;
+    return result;
+}
+
+int os_semaphore_create(os_semaphore_t* semaphore, unsigned max, unsigned initial){
+    *semaphore = new Host_Semaphore;
+    (*semaphore)->count = initial;
+    (*semaphore)->max = max;
+    return 0;
+}
+
+int os_semaphore_take(os_semaphore_t semaphore, system_tick_t timeout, bool reserved){
+    std::unique_lock<std::mutex> lock(semaphore->lock);
+    if(CONCURRENT_WAIT_FOREVER == timeout){
+        semaphore->given.wait(lock, [semaphore]{ return 0 != semaphore->count; });
+    } else if(!semaphore->given.wait_for(lock, std::chrono::milliseconds(timeout), [semaphore]{ return 0 != semaphore->count; })){
+        return 1;
+    }
+    semaphore->count--;
+    return 0;
+}
+
+int os_semaphore_give(os_semaphore_t semaphore, bool reserved){
+    {
+        std::lock_guard<std::mutex> lock(semaphore->lock);
+        if(semaphore->count < semaphore->max) semaphore->count++;
+    }
+    semaphore->given.notify_one();
+    return 0;
+}
+
+#else
+// Each Thread is a coroutine on its own stack. It runs until it takes an empty semaphore, a give from the application
+// thread resumes it right there, as the RTOS would switch to the higher priority thread.
+struct Host_Thread {
+    ucontext_t context;
+    os_thread_fn_t function;
+    void* param;
+    char* stack;
+};
+
+struct Host_Semaphore {
+    unsigned count, max;
+    Host_Thread* waiter;
+};
+
+#define HOST_THREAD_STACK (256*1024) // the firmware's stack size is for the ARM build, printf on the host wants more
+
+static ucontext_t hostMainContext;
+static Host_Thread* hostCurrent = NULL;
+static Host_Thread* hostStarting = NULL;
+
+static void Host_Thread_Run(Host_Thread* thread){
+    hostCurrent = thread;
+    swapcontext(&hostMainContext, &thread->context);
+    hostCurrent = NULL;
+}
+
+static void Host_Thread_Entry(void){
+    Host_Thread* thread = hostStarting;
+    thread->function(thread->param);
+}
+
+Thread::Thread(const char* name, os_thread_fn_t function, void* param, os_thread_prio_t priority, size_t stackSize){
+    Host_Thread* thread = new Host_Thread;
+    thread->function = function;
+    thread->param = param;
+    thread->stack = new char[HOST_THREAD_STACK];
+    getcontext(&thread->context);
+    thread->context.uc_stack.ss_sp = thread->stack;
+    thread->context.uc_stack.ss_size = HOST_THREAD_STACK;
+    thread->context.uc_link = &hostMainContext;
+    makecontext(&thread->context, Host_Thread_Entry, 0);
+    hostStarting = thread;
+    Host_Thread_Run(thread);
+}
+
+int os_thread_current_stack(void** bottom, void** top){
+    if(NULL != hostCurrent){
+        *bottom = hostCurrent->stack;
+        *top = hostCurrent->stack + HOST_THREAD_STACK;
+        return 0;
+    }
+    pthread_attr_t attr;
+    size_t size;
+    if(0 != pthread_getattr_np(pthread_self(), &attr)) return 1;
+    int result = pthread_attr_getstack(&attr, bottom, &size);
+    pthread_attr_destroy(&attr);
+    *top = (char*)*bottom + size;
+    return result;
+}
+
+int os_semaphore_create(os_semaphore_t* semaphore, unsigned max, unsigned initial){
+    *semaphore = new Host_Semaphore;
+    (*semaphore)->count = initial;
+    (*semaphore)->max = max;
+    (*semaphore)->waiter = NULL;
+    return 0;
+}
+
+int os_semaphore_take(os_semaphore_t semaphore, system_tick_t timeout, bool reserved){
+    if(0 == semaphore->count){
+        if((NULL == hostCurrent) || (0 == timeout)) return 1; // nothing else could ever give it
+        semaphore->waiter = hostCurrent;
+        while(0 == semaphore->count) swapcontext(&hostCurrent->context, &hostMainContext);
+        semaphore->waiter = NULL;
+    }
+    semaphore->count--;
+    return 0;
+}
+
+int os_semaphore_give(os_semaphore_t semaphore, bool reserved){
+    if(semaphore->count < semaphore->max) semaphore->count++;
+    if((NULL != semaphore->waiter) && (NULL == hostCurrent)) Host_Thread_Run(semaphore->waiter);
+    return 0;
+}
+#endif
+
+
+///////////////////////// Time /////////////////////////
+time_t TimeClass::now(void){
+    time_t uptime = hostDevice.clockUs/1000000;
+    return hostDevice.timeValid ? hostDevice.utcBase + uptime : uptime;
+}
+
+time_t TimeClass::local(void){
+    return now() + (time_t)(hostDevice.zone*3600);
+}
+
+void TimeClass::zone(float offset){
+    hostDevice.zone = offset;
+}
+
+float TimeClass::zone(void){
+    return hostDevice.zone;
+}
+
+bool TimeClass::isValid(void){
+    return hostDevice.timeValid;
+}
+
+void TimeClass::setTime(time_t utc){
+    Host_Time_Set(utc);
+}
+
+static struct tm Host_Local_Tm(void){
+    time_t local = Time.local();
+    struct tm fields;
+    gmtime_r(&local, &fields);
+    return fields;
+}
+
+int TimeClass::hour(void){ return Host_Local_Tm().tm_hour; }
+int TimeClass::minute(void){ return Host_Local_Tm().tm_min; }
+int TimeClass::second(void){ return Host_Local_Tm().tm_sec; }
+int TimeClass::weekday(void){ return Host_Local_Tm().tm_wday + 1; }
+
+// "Wed May 21 01:08:47 2014"
+String TimeClass::timeStr(void){
+    struct tm fields = Host_Local_Tm();
+    char text[32];
+    strftime(text, sizeof(text), "%a %b %e %H:%M:%S %Y", &fields);
+    return String(text);
+}
+
+
+///////////////////////// heap /////////////////////////
+// On the device String allocates with malloc. The host String holds a std::string, so operator new goes through malloc
+// here too and the firmware's allocation count (see memoryAllocations) sees the same churn.
+void* operator new(size_t size){
+    void* block = malloc(size ? size : 1);
+    if(NULL == block) throw std::bad_alloc();
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+
+///////////////////////// System and cloud /////////////////////////
+void SystemClass::reset(void){
+    hostDevice.resetRequested = TRUE;
+}
+
+int SystemClass::resetReason(void){
+    return RESET_REASON_POWER_DOWN;
+}
+
+uint32_t SystemClass::freeMemory(void){
+    return 48*1024;
+}
+
+static int ticksCounter = -1;   // perf event counting the instructions of this thread, while ticks() returns them
+
+bool Host_Ticks_Instructions(bool on){
+    if(!on){
+        if(ticksCounter >= 0) close(ticksCounter);
+        ticksCounter = -1;
+        return TRUE;
+    }
+    if(ticksCounter >= 0) return TRUE;
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    ticksCounter = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    return ticksCounter >= 0;
+}
+
+uint32_t SystemClass::ticks(void){
+    uint64_t instructions;
+    if((ticksCounter >= 0) && (sizeof(instructions) == read(ticksCounter, &instructions, sizeof(instructions)))) return instructions;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool CloudClass::function(const char* name, cloud_function_t handler){
+    hostDevice.functions[name] = handler;
+    return TRUE;
+}
+
+bool CloudClass::publish(const char* name, const char* data){
+    if(!hostDevice.cloudConnected) return FALSE;
+    hostDevice.publishes.push_back(std::string(name) + " " + (data ? data : ""));
+    return TRUE;
+}
+
+bool CloudClass::connected(void){
+    return hostDevice.cloudConnected;
+}
+
+
+///////////////////////// Serial /////////////////////////
+size_t SerialClass::write(const char* str){
+    hostDevice.serial += str;
+    return strlen(str);
+}
+
+size_t SerialClass::println(const char* str){
+    return write(str) + write("\r\n");
+}
+
+size_t SerialClass::printf(const char* format, ...){
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return write(text);
+}
+
+size_t SerialClass::printlnf(const char* format, ...){
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return println(text);
+}
+
+
+///////////////////////// EEPROM /////////////////////////
+uint8_t* EEPROMClass::Cell(int addr, size_t size){
+    if((addr < 0) || (addr + size > HOST_EEPROM_SIZE)){
+        fprintf(stderr, "EEPROM access out of range at 0x%03X\n", addr);
+        abort();
+    }
+    return &hostDevice.eeprom[addr];
+}
+
+uint8_t EEPROMClass::read(int addr){
+    return *Cell(addr, 1);
+}
+
+void EEPROMClass::write(int addr, uint8_t value){
+    uint8_t* cell = Cell(addr, 1);
+    if(*cell != value) hostDevice.eepromWrites++;
+    *cell = value;
+}
+
+void EEPROMClass::clear(void){
+    memset(hostDevice.eeprom, 0xFF, sizeof(hostDevice.eeprom));
+}
+
+
+///////////////////////// Wire and the PSoC /////////////////////////
+static int wireAddress;
+static std::vector<uint8_t> wireTx;
+static std::vector<uint8_t> wireRx;
+static size_t wireRxIndex;
+
+void TwoWire::beginTransmission(int address){
+    wireAddress = address;
+    wireTx.clear();
+}
+
+size_t TwoWire::write(uint8_t data){
+    wireTx.push_back(data);
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t length){
+    wireTx.insert(wireTx.end(), data, data + length);
+    return length;
+}
+
+// A lone sub address only moves the read pointer, anything longer is a register write and goes into the trace
+uint8_t TwoWire::endTransmission(bool stop){
+    if((HOST_PSOC_ADDR != wireAddress) || wireTx.empty()) return HOST_WIRE_NACK;
+    if((wireTx.size() > 1) && (hostDevice.wireFailures > 0)){
+        hostDevice.wireFailures--;
+        return HOST_WIRE_NACK;
+    }
+    uint8_t sub = wireTx[0];
+    hostDevice.psocPointer = sub;
+    if(1 == wireTx.size()) return 0;
+    uint8_t length = wireTx.size() - 1;
+    for(uint8_t i = 0; (i < length) && (sub + i < HOST_PSOC_REGISTERS); i++) hostDevice.psoc[sub + i] = wireTx[1 + i];
+    hostDevice.psocTransactions++;
+    hostDevice.psocBytes += wireTx.size();
+
+    unsigned long now = millis();
+    unsigned long dt = now - hostDevice.psocTraceMarker;
+    hostDevice.psocTraceMarker = now;
+    std::vector<uint8_t>& trace = hostDevice.psocTrace;
+    for(; dt > 0xFFFF; dt -= 0xFFFF){ // longer gaps as empty records, the timeline stays exact over hours of idle
+        const uint8_t gap[4] = { 0xFF, 0xFF, 0, 0 };
+        trace.insert(trace.end(), gap, gap + sizeof(gap));
+    }
+    trace.push_back(dt & 0xFF);
+    trace.push_back(dt >> 8);
+    trace.push_back(sub);
+    trace.push_back(length);
+    trace.insert(trace.end(), wireTx.begin() + 1, wireTx.end());
+    if(NULL != hostDevice.psocWritten) hostDevice.psocWritten();
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(int address, int quantity){
+    wireRx.clear();
+    wireRxIndex = 0;
+    if(HOST_PSOC_ADDR != address) return 0;
+    for(int i = 0; (i < quantity) && (hostDevice.psocPointer + i < HOST_PSOC_REGISTERS); i++){
+        wireRx.push_back(hostDevice.psoc[hostDevice.psocPointer + i]);
+    }
+    return wireRx.size();
+}
+
+int TwoWire::available(void){
+    return wireRx.size() - wireRxIndex;
+}
+
+int TwoWire::read(void){
+    return (wireRxIndex < wireRx.size()) ? wireRx[wireRxIndex++] : -1;
+}
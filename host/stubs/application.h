@@ -0,0 +1,317 @@
+/************************************************************************************************************************************/
+/** @file       application.h (host)
+ *  @brief      Particle Device OS stand-in for building the lamp firmware on a PC
+ *  @details    Declares just the part of the Particle API the lamp firmware uses. Time comes from a virtual clock that the
+ *              harness advances (host_device.h), so millis(), micros(), delay() and Time all read the same simulated
+ *              instant and a day of lamp behavior runs in well under a second. Threads are cooperative: a Thread runs
+ *              right away until it blocks on a semaphore and a give from the application thread switches straight into
+ *              the waiting thread, like the higher priority output thread on the device. Traces come out the same on
+ *              every run. Built with HOST_STD_THREADS (ario_host_stubs_threads), a Thread is a std::thread and runs
+ *              alongside the application thread instead, for measuring output timing in real time.
+ *
+ *              Host longs are 64 bits, so an unsigned long only wraps after a few hundred million years of millis();
+ *              everything the firmware stores in EEPROM with a fixed size uses explicit width types.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef application_h
+#define application_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef uint32_t system_tick_t;
+
+#define TRUE    1
+#define FALSE   0
+#define HIGH    0x1
+#define LOW     0x0
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// Photon pin numbers
+#define D0  0
+#define D1  1
+#define D2  2
+#define D3  3
+#define D4  4
+#define D5  5
+#define D6  6
+#define D7  7
+#define A0  10
+#define A1  11
+#define A2  12
+#define A3  13
+#define A4  14
+#define A5  15
+#define HOST_PIN_COUNT 16
+
+enum PinMode { INPUT, OUTPUT, INPUT_PULLUP, INPUT_PULLDOWN };
+
+void pinMode(uint16_t pin, PinMode mode);
+int32_t digitalRead(uint16_t pin);
+int32_t analogRead(uint16_t pin);
+
+// Virtual clock
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Backup SRAM is ordinary memory on the host, a simulated warm reset keeps it simply by not touching it
+#define retained
+
+#define STARTUP(code) namespace { struct Host_Startup { Host_Startup(){ code; } } hostStartup; }
+#define SYSTEM_MODE(mode)
+#define SYSTEM_THREAD(state)
+#define PRODUCT_ID(id)
+#define PRODUCT_VERSION(version)
+
+#if HOST_STD_THREADS
+// Threads really run at the same time, blocks exclude each other the way they exclude thread switches on the device
+struct Host_Block {
+    Host_Block();
+    ~Host_Block();
+    bool once;
+};
+#define SINGLE_THREADED_BLOCK() for(Host_Block hostBlock; hostBlock.once; hostBlock.once = FALSE)
+#else
+// The output thread only ever runs while the application thread waits for it, nothing to lock
+#define SINGLE_THREADED_BLOCK() for(bool hostBlockOnce = TRUE; hostBlockOnce; hostBlockOnce = FALSE)
+#endif
+
+
+// String---------------------------------------------------------------------------------------------------------------------------//
+// Only what the cloud handlers use, with the Wiring semantics (substring clamps to the length, toInt() is atol())
+class String
+{
+    public:
+        String(void){}
+        String(const char* str) : text(str ? str : "") {}
+        String(const std::string& str) : text(str) {}
+
+        String substring(unsigned int from) const { return substring(from, text.length()); }
+        String substring(unsigned int from, unsigned int to) const {
+            if(from > to){ unsigned int swap = from; from = to; to = swap; }
+            if(from >= text.length()) return String();
+            if(to > text.length()) to = text.length();
+            return String(text.substr(from, to - from));
+        }
+        long toInt(void) const { return atol(text.c_str()); }
+        char charAt(unsigned int index) const { return (index < text.length()) ? text[index] : 0; }
+        int indexOf(char c, unsigned int from = 0) const {
+            size_t found = text.find(c, from);
+            return (std::string::npos == found) ? -1 : (int)found;
+        }
+        unsigned int length(void) const { return text.length(); }
+        const char* c_str(void) const { return text.c_str(); }
+        bool operator==(const String& other) const { return text == other.text; }
+        bool operator==(const char* other) const { return text == other; }
+        bool operator!=(const char* other) const { return text != other; }
+
+    private:
+        std::string text;
+};
+
+
+// Threads--------------------------------------------------------------------------------------------------------------------------//
+typedef void (*os_thread_fn_t)(void* param);
+typedef uint8_t os_thread_prio_t;
+struct Host_Semaphore;
+typedef Host_Semaphore* os_semaphore_t;
+
+#define OS_THREAD_PRIORITY_DEFAULT  2
+#define OS_THREAD_STACK_SIZE_DEFAULT 3072
+#define CONCURRENT_WAIT_FOREVER     ((system_tick_t)-1)
+
+int os_semaphore_create(os_semaphore_t* semaphore, unsigned max, unsigned initial);
+int os_semaphore_take(os_semaphore_t semaphore, system_tick_t timeout, bool reserved);
+int os_semaphore_give(os_semaphore_t semaphore, bool reserved);
+
+// Lowest and one past the highest address of the calling thread's stack, 0 on success. A Thread gets the stack it was
+// created with, the application thread (the host's main thread) the one pthread_getattr_np() reports.
+int os_thread_current_stack(void** bottom, void** top);
+
+class Thread
+{
+    public:
+        Thread(const char* name, os_thread_fn_t function, void* param = NULL, os_thread_prio_t priority = OS_THREAD_PRIORITY_DEFAULT,
+               size_t stackSize = OS_THREAD_STACK_SIZE_DEFAULT);
+};
+
+
+// Time-----------------------------------------------------------------------------------------------------------------------------//
+class TimeClass
+{
+    public:
+        time_t now(void);
+        time_t local(void);
+        void zone(float offset);
+        float zone(void);
+        bool isValid(void);
+        void setTime(time_t utc);
+        void beginDST(void){}
+        void endDST(void){}
+        int hour(void);
+        int minute(void);
+        int second(void);
+        int weekday(void);  // 1 = Sunday
+        String timeStr(void);
+};
+extern TimeClass Time;
+
+
+// System---------------------------------------------------------------------------------------------------------------------------//
+typedef uint64_t system_event_t;
+static const system_event_t firmware_update_pending = 0x0100;
+typedef void (*system_event_handler_t)(system_event_t event, int param);
+
+#define FEATURE_RETAINED_MEMORY     1
+#define FEATURE_RESET_INFO          2
+#define SYSTEM_CONFIG_SOFTAP_PREFIX 1
+#define RESET_REASON_NONE           0
+#define RESET_REASON_PIN_RESET      10
+#define RESET_REASON_POWER_DOWN     30
+#define RESET_REASON_WATCHDOG       40
+#define RESET_REASON_USER           130
+
+class SystemClass
+{
+    public:
+        void enableFeature(int feature){}
+        void on(system_event_t event, system_event_handler_t handler){}
+        void set(int config, const char* value){}
+        void enableUpdates(void){}
+        void reset(void);
+        int resetReason(void);
+        uint32_t freeMemory(void);
+        uint32_t ticks(void);           // real ns on the host (or instructions, Host_Ticks_Instructions), only ever compared with itself
+};
+extern SystemClass System;
+
+
+// Cloud----------------------------------------------------------------------------------------------------------------------------//
+typedef int (*cloud_function_t)(String arg);
+typedef String (*cloud_variable_fn_t)(void);
+
+class CloudClass
+{
+    public:
+        bool function(const char* name, cloud_function_t handler);
+        template <typename T> bool variable(const char* name, const T& value){ return TRUE; }
+        bool publish(const char* name, const char* data = NULL);
+        bool connected(void);
+        void connect(void){}
+        void disconnect(void){}
+};
+extern CloudClass Particle;
+
+class IPAddress
+{
+    public:
+        IPAddress(void){ memset(octets, 0, sizeof(octets)); }
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d){ octets[0] = a; octets[1] = b; octets[2] = c; octets[3] = d; }
+    private:
+        uint8_t octets[4];
+};
+
+class WiFiClass
+{
+    public:
+        void on(void){ powered = TRUE; }
+        void off(void){ powered = FALSE; listeningMode = FALSE; }
+        void connect(void){}
+        void disconnect(void){}
+        void listen(void){ listeningMode = TRUE; }
+        bool listening(void){ return listeningMode; }
+        bool connecting(void){ return FALSE; }
+        bool ready(void){ return FALSE; }
+        void clearCredentials(void){}
+        void macAddress(byte* mac){ static const byte host[6] = { 0xE0, 0x4F, 0x43, 0x00, 0x00, 0x01 }; memcpy(mac, host, 6); }
+        int ping(IPAddress address, int count = 1){ return 0; }
+        IPAddress resolve(const char* host){ return IPAddress(); }
+    private:
+        bool powered = FALSE, listeningMode = FALSE;
+};
+extern WiFiClass WiFi;
+
+
+// Peripherals----------------------------------------------------------------------------------------------------------------------//
+class RGBClass
+{
+    public:
+        void control(bool take){ controlledFlag = take; }
+        bool controlled(void){ return controlledFlag; }
+        void color(int red, int green, int blue){ rgb = (red << 16) | (green << 8) | blue; }
+        void brightness(uint8_t value){}
+        uint32_t rgb = 0;
+    private:
+        bool controlledFlag = FALSE;
+};
+extern RGBClass RGB;
+
+// Everything printed is kept in hostDevice.serial
+class SerialClass
+{
+    public:
+        void begin(unsigned long baud){}
+        size_t write(const char* str);
+        size_t print(const char* str){ return write(str); }
+        size_t println(const char* str = "");
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+        size_t printlnf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+extern SerialClass Serial;
+
+// 2047 bytes of emulated EEPROM like the Photon, erased to 0xFF
+#define HOST_EEPROM_SIZE 2047
+class EEPROMClass
+{
+    public:
+        uint8_t read(int addr);
+        void write(int addr, uint8_t value);
+        template <typename T> T& get(int addr, T& value){
+            memcpy(&value, Cell(addr, sizeof(T)), sizeof(T));
+            return value;
+        }
+        template <typename T> const T& put(int addr, const T& value){
+            for(size_t i = 0; i < sizeof(T); i++) write(addr + i, ((const uint8_t*)&value)[i]);
+            return value;
+        }
+        void clear(void);
+        size_t length(void){ return HOST_EEPROM_SIZE; }
+    private:
+        uint8_t* Cell(int addr, size_t size);
+};
+extern EEPROMClass EEPROM;
+
+// I2C master, talks to the PSoC model in host_device.h
+class TwoWire
+{
+    public:
+        void setSpeed(uint32_t clock){}
+        void begin(void){}
+        void beginTransmission(int address);
+        size_t write(uint8_t data);
+        size_t write(const uint8_t* data, size_t length);
+        uint8_t endTransmission(bool stop = TRUE);
+        uint8_t requestFrom(int address, int quantity);
+        int available(void);
+        int read(void);
+};
+extern TwoWire Wire;
+
+#include "host_device.h"
+
+#endif
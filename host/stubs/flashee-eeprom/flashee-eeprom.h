@@ -0,0 +1,26 @@
+/************************************************************************************************************************************/
+/** @file       flashee-eeprom.h (host)
+ *  @brief      stand-in for the flashee-eeprom library, the lamp firmware only creates the device
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef flashee_eeprom_h
+#define flashee_eeprom_h
+
+namespace Flashee {
+
+class FlashDevice {};
+
+class Devices
+{
+    public:
+        static FlashDevice* createAddressErase(void){ static FlashDevice device; return &device; }
+};
+
+}
+
+#endif
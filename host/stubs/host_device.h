@@ -0,0 +1,78 @@
+/************************************************************************************************************************************/
+/** @file       host_device.h
+ *  @brief      simulated Photon and PSoC behind the host application.h
+ *  @details    hostDevice is the whole simulated hardware: the virtual clock, pin levels, EEPROM, the cloud function
+ *              table, captured serial output and publishes, and the PSoC on the I2C bus. The firmware only reaches it
+ *              through the Particle API, the harness reads and drives it directly.
+ *
+ *              The PSoC model keeps the register image (on flag, brightness, four LED values) and logs every register
+ *              write in the record layout of the firmware's own I2C trace: dt since the previous record in ms (2 bytes,
+ *              little endian), sub address, length, data. Unlike the on-device capture it has no size limit, and a gap longer
+ *              than 0xFFFF ms is written as empty records (length 0) instead of saturating.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef host_device_h
+#define host_device_h
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#define HOST_PSOC_ADDR          1
+#define HOST_PSOC_REGISTERS     6
+#define HOST_WIRE_NACK          3       // endTransmission() result of an address nack
+
+struct HostDevice {
+    // Virtual clock, micros since power on. Time.now() is utcBase plus the clock once the time was set. Atomic for
+    // HOST_STD_THREADS, where the output thread reads it and its retry backoff moves it.
+    std::atomic<uint64_t> clockUs;
+    time_t utcBase;
+    bool timeValid;
+    float zone;
+
+    int32_t pins[HOST_PIN_COUNT];       // digital level or 12 bit analog reading
+    uint8_t eeprom[HOST_EEPROM_SIZE];
+    unsigned long eepromWrites;         // writes that changed a byte, the wear an emulated page sees
+
+    std::map<std::string, cloud_function_t> functions;
+    std::vector<std::string> publishes; // "name data"
+    bool cloudConnected;
+    std::string serial;
+    bool resetRequested;
+
+    // PSoC on the bus
+    uint8_t psoc[HOST_PSOC_REGISTERS];
+    uint8_t psocPointer;                // sub address of the next read
+    std::vector<uint8_t> psocTrace;
+    unsigned long psocTraceMarker;      // millis() of the last trace record
+    unsigned long psocTransactions, psocBytes;
+    unsigned int wireFailures;          // this many writes are nacked before the bus recovers
+    void (*psocWritten)(void);          // called after every register write, on the thread that wrote it, NULL if none
+};
+extern HostDevice hostDevice;
+
+// Power on state: clock at 0 and no time set, EEPROM erased, all pins low, PSoC off
+void Host_Device_Reset(void);
+
+// Moves the virtual clock forward
+void Host_Clock_Advance(uint64_t us);
+
+// Sets the wall clock the way a cloud time sync would
+void Host_Time_Set(time_t utc);
+
+// Starts a new PSoC trace with the register image as it is now, written as one record that is not bus traffic
+void Host_Trace_Start(void);
+
+// Calls a registered Particle.function, -1 if there is none by that name
+int Host_Cloud_Call(const char* name, const char* arg);
+
+// Switches System.ticks() from ns to instructions retired by this thread, FALSE (and ns) where the host cannot count them
+bool Host_Ticks_Instructions(bool on);
+
+#endif
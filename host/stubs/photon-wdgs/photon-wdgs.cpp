@@ -0,0 +1,15 @@
+/************************************************************************************************************************************/
+/** @file       photon-wdgs.cpp (host)
+ *  @brief      see photon-wdgs.h
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "photon-wdgs.h"
+
+bool PhotonWdgs::_wwdgRunning = false;
+HostWatchdogTimer PhotonWdgs::_wdgTimer;
+unsigned long PhotonWdgs::tickles = 0;
@@ -0,0 +1,34 @@
+/************************************************************************************************************************************/
+/** @file       photon-wdgs.h (host)
+ *  @brief      stand-in for the photon-wdgs watchdog library, tickle() counts so a test can see loop() kept it fed
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef photon_wdgs_h
+#define photon_wdgs_h
+
+#define TIMER7 7
+
+class HostWatchdogTimer
+{
+    public:
+        void end(void){}
+};
+
+class PhotonWdgs
+{
+    public:
+        static void begin(bool independent, bool window, unsigned long timeout, int timer){ _wwdgRunning = window; }
+        static void tickle(void){ tickles++; }
+        static bool _wwdgRunning;
+        static HostWatchdogTimer _wdgTimer;
+        static unsigned long tickles;
+};
+
+inline void WWDG_DeInit(void){}
+
+#endif
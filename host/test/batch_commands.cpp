@@ -0,0 +1,93 @@
+/************************************************************************************************************************************/
+/** @file       batch_commands.cpp
+ *  @brief      a batch frame is applied whole or not at all
+ *  @details    Frames with one value out of range (an hour of 24, a minute of 60, an alarm type that is neither wake nor
+ *              bed, a PIR or ALS byte the text commands would not take) sit next to a power on command, and have to come
+ *              back 404 with the lamp still off and not one EEPROM byte changed. Then the alarm table is filled up to one
+ *              free record and a frame that adds two alarms has to be rejected the same way, with the table as it was.
+ *              A frame with every command in range has to be applied. The "ALARM" text command gets the same range
+ *              checks as the CMD_ALARM_ADD it mirrors.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+
+struct BatchCase {
+    const char* name;
+    const char* frame;              // hex, as the app sends it to arioBatch, or the arioSet command
+};
+
+// power on first, then the command that is out of range
+static const BatchCase rejected[] = {
+    { "wake hour 24",       "0101" "05021800" "1E" },
+    { "wake minute 60",     "0101" "0502063C" "1E" },
+    { "bed hour 24",        "0101" "07021800" "1E" },
+    { "bed no days",        "0101" "07001600" "1E" },
+    { "alarm type 3",       "0101" "0C033E0630" "1E00" },
+    { "alarm minute 60",    "0101" "0C013E063C" "1E00" },
+    { "alarm program 2",    "0101" "0C013E0630" "1E02" },
+    { "pir enable 2",       "0101" "0802013C00" },
+    { "pir schedule 24:00", "0101" "0913001800" },
+    { "als enable 2",       "0101" "0A0210" },
+    { "als sensitivity 0",  "0101" "0A0100" },
+    { "zone 105",           "0101" "0B69" },
+    { "dst rule 6",         "0101" "0D06" },
+};
+
+static LampHarness lamp;
+
+// the text form of CMD_ALARM_ADD takes the same limits
+static const BatchCase rejectedText[] = {
+    { "text alarm hour 24",     "ALARM,1,3E,2400,30,0" },
+    { "text alarm minute 60",   "ALARM,2,3E,0660,30,0" },
+    { "text alarm type 3",      "ALARM,3,3E,0630,30,0" },
+    { "text alarm type 0",      "ALARM,0,3E,0630,30,0" },
+};
+
+// 404 and nothing changed
+static void Expect_Rejected(const char* name, const char* function, const char* command){
+    uint8_t before[HOST_EEPROM_SIZE];
+    memcpy(before, hostDevice.eeprom, sizeof(before));
+    int result = lamp.Cloud(function, command);
+    Harness_Expect(404 == result, "%s: returned %d", name, result);
+    Harness_Expect(!aCtrl.lightIsOn, "%s: the power on before it was applied", name);
+    Harness_Expect(0 == memcmp(before, hostDevice.eeprom, sizeof(before)), "%s: EEPROM changed", name);
+    lamp.Run_For(1000);
+}
+
+int main(){
+    lamp.Boot(1767643200L, TRUE); // Monday 2026-01-05 12:00 Pacific
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,0"), "PWR,0");
+    lamp.Run_For(5000);
+
+    for(unsigned int i = 0; i < sizeof(rejected)/sizeof(rejected[0]); i++){
+        Expect_Rejected(rejected[i].name, "arioBatch", rejected[i].frame);
+    }
+    for(unsigned int i = 0; i < sizeof(rejectedText)/sizeof(rejectedText[0]); i++){
+        Expect_Rejected(rejectedText[i].name, "arioSet", rejectedText[i].frame);
+    }
+
+    // all but one record taken, then two more alarms in one frame
+    Harness_Expect(200 == lamp.Cloud("arioSet", "ALARM,CLR"), "ALARM,CLR");
+    for(int i = 0; i < ALARM_TABLE_SIZE - 1; i++){
+        char command[32];
+        snprintf(command, sizeof(command), "ALARM,1,3E,05%02d,30,0", i);
+        Harness_Expect(200 == lamp.Cloud("arioSet", command), "%s", command);
+    }
+    lamp.Run_For(1000);
+    Expect_Rejected("table full", "arioBatch", "0101" "0C027F1400" "1E00" "0C017F1600" "1E00");
+    AlarmRecord alarm;
+    Harness_Expect(!aCtrl.Alarm_Lookup(ALARM_TYPE_BED, 1, &alarm), "table full: the first alarm of the frame was kept");
+
+    Harness_Expect(200 == lamp.Cloud("arioSet", "ALARM,CLR"), "ALARM,CLR");
+    Harness_Expect(200 == lamp.Cloud("arioBatch", "0101" "0502172D" "1E" "0A010C" "0D02"), "in range: rejected");
+    Harness_Expect(aCtrl.lightIsOn, "in range: the lamp did not turn on");
+    Harness_Expect(aCtrl.Alarm_Lookup(ALARM_TYPE_WAKE, 2, &alarm) && (23*60 + 45 == alarm.minuteOfDay), "in range: no 23:45 wake alarm");
+    Harness_Expect((1 == EEPROM.read(ALS_EN_ADDR)) && (ALS_SENSITIVITY_MEDIUM == EEPROM.read(ALS_SENSITIVITY_ADDR)), "in range: ALS");
+    Harness_Expect(DST_RULE_US == EEPROM.read(DST_ENABLE_ADDR), "in range: DST");
+    return Harness_Result();
+}
@@ -0,0 +1,203 @@
+/************************************************************************************************************************************/
+/** @file       bench.cpp
+ *  @brief      the firmware's hot paths timed on the host, against the baseline in host/bench_baseline.txt
+ *  @details    One boot runs the lamp through every operating mode (a dawn simulation, app ramps, a held button, the demo,
+ *              an uploaded program, a bedtime reminder) so the Scheduler() pass of each mode has its mean, then the
+ *              "BENCH" kernels run BENCH_RUNS times through aCtrl.Benchmark_Run() and every kernel reports its median.
+ *              Prints one CSV line per kernel: name, ns, baseline ns, change in percent, and a Cortex-M3 cycle estimate
+ *              when the host can count instructions (System.ticks() switched to instructions, times BENCH_M3_CPI), "-"
+ *              otherwise. The estimate is rough, the Photon has no FPU and its soft float costs more than the host's.
+ *
+ *              tick_old is the linear ramp tick before the ramp curves (two float adds and PSoC_Load_LEDVal), timed
+ *              from a copy of that code here. tick_lin is the linear tick now (two Ramp_Channel_Value and
+ *              PSoC_Load_LEDVal) and may not cost more than BENCH_TICK_MARGIN times it.
+ *
+ *              bench                   prints the CSV
+ *              bench --compare         also fails on a kernel slower than BENCH_REGRESSION times its baseline
+ *              bench --update          writes the measurement as the new baseline
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+#include <algorithm>
+#include <map>
+#include <string>
+
+#define BENCH_DAY           1767600000L // Monday 2026-01-05 00:00 Pacific Standard Time
+#define BENCH_RUNS          9           // Benchmark_Run() calls, every kernel reports the median
+#define BENCH_REGRESSION    2.0         // --compare fails above this times the baseline
+#define BENCH_NOISE_NS      50          // plus this, timer and scheduling noise on a kernel of a few ns
+#define BENCH_TICK_MARGIN   1.25        // tick_lin over tick_old, an int to float conversion and a multiply more per channel
+#define BENCH_TICK_NOISE_NS 10
+#define BENCH_M3_CPI        1.3         // Cortex-M3 cycles per host instruction, single issue with flash wait states
+
+static LampHarness lamp;
+
+static time_t Local(int hour, int minute){
+    return BENCH_DAY + hour*3600L + minute*60L;
+}
+
+// Every operating mode runs for a while, Scheduler() averages its passes per mode
+static void Modes_Run(void){
+    lamp.Boot(Local(6, 0), TRUE);
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,0"), "PWR,0");
+    Harness_Expect(200 == lamp.Cloud("arioSet", "WAKE,2,1,0602,1"), "WAKE");
+    lamp.Run_To(Local(6, 4));                                           // MODE_DAWNSIM
+
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,1"), "PWR,1");
+    lamp.Run_For(5000);                                                 // MODE_DEFAULT
+    Harness_Expect(200 == lamp.Cloud("arioDo", "BRI,60"), "BRI,60");
+    lamp.Run_For(3000);                                                 // MODE_RAMP
+    lamp.Press(PIN_BUTTON_TOP, 3000);                                   // MODE_ADJUST
+    lamp.Run_For(5000);
+    Harness_Expect(200 == lamp.Cloud("arioDo", "DEMO"), "DEMO");
+    lamp.Run_For(40000);                                                // MODE_DEMO
+
+    const LampSegment program[] = {
+        { 2000, 10,  SEG_CURVE(RAMP_CURVE_LINEAR), 0,     1000, 0 },
+        { 6000, 250, SEG_CURVE(RAMP_CURVE_LINEAR), 8000,  1000, 0 },
+    };
+    Harness_Expect(lamp.Program_Upload(program, sizeof(program)/sizeof(program[0])), "program upload");
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PROG"), "PROG");
+    lamp.Run_For(15000);                                                // MODE_PROGRAM
+
+    Harness_Expect(200 == lamp.Cloud("arioSet", "BED,2,1,0701,2"), "BED");
+    lamp.Run_To(Local(7, 5));                                           // MODE_BEDTIME
+}
+
+// The pre-curve linear ramp tick, PSoC_Load_LEDVal(currentCCT += rampRegCCTStep, currentLevel += rampRegLevelStep),
+// without the load, which tick_old takes from the "led" kernel
+static volatile float oldCCT = 2700, oldLevel = 10, oldCCTStep = 0.5, oldLevelStep = 0.25;
+
+static uint32_t Old_Step_Run(void){
+    uint32_t best = 0xFFFFFFFFUL, overhead = 0xFFFFFFFFUL;
+    for(int n = 0; n < BENCH_ITERATIONS; n++){
+        uint32_t start = System.ticks();
+        uint32_t cycles = System.ticks() - start;
+        if(cycles < overhead) overhead = cycles;
+
+        start = System.ticks();
+        oldCCT = oldCCT + oldCCTStep;
+        oldLevel = oldLevel + oldLevelStep;
+        cycles = System.ticks() - start;
+        if(cycles < best) best = cycles;
+    }
+    return best - overhead;
+}
+
+// BENCH_RUNS Benchmark_Run() reports and the old step, every kernel's median
+static std::map<std::string, double> Kernels_Run(void){
+    std::map<std::string, std::vector<uint32_t> > runs;
+    for(int r = 0; r < BENCH_RUNS; r++){
+        char report[512];
+        aCtrl.Benchmark_Run();
+        aCtrl.Benchmark_Report(report, sizeof(report), FALSE);
+        for(char* entry = strtok(report, ";"); NULL != entry; entry = strtok(NULL, ";")){
+            char* comma = strchr(entry, ',');
+            if(NULL == comma) continue;
+            *comma = 0;
+            runs[entry].push_back(strtoul(comma + 1, NULL, 10));
+        }
+        runs["old_step"].push_back(Old_Step_Run());
+    }
+    std::map<std::string, double> kernels;
+    for(std::map<std::string, std::vector<uint32_t> >::iterator i = runs.begin(); i != runs.end(); ++i){
+        std::sort(i->second.begin(), i->second.end());
+        kernels[i->first] = i->second[i->second.size()/2];
+    }
+    kernels["tick_old"] = kernels["old_step"] + kernels["led"];
+    kernels["tick_lin"] = 2*kernels["rlin"] + kernels["led"];
+    kernels.erase("old_step");
+    return kernels;
+}
+
+static bool Baseline_Load(const char* path, std::map<std::string, double>* baseline){
+    FILE* file = fopen(path, "r");
+    if(NULL == file) return FALSE;
+    char line[128], name[32];
+    double ns;
+    while(NULL != fgets(line, sizeof(line), file)){
+        if(('#' != line[0]) && (2 == sscanf(line, "%31s %lf", name, &ns))) (*baseline)[name] = ns;
+    }
+    fclose(file);
+    return TRUE;
+}
+
+static bool Baseline_Save(const char* path, const std::map<std::string, double>& kernels){
+    FILE* file = fopen(path, "w");
+    if(NULL == file) return FALSE;
+    fprintf(file, "# bench --update, median ns per kernel on the host\n");
+    for(std::map<std::string, double>::const_iterator i = kernels.begin(); i != kernels.end(); ++i){
+        fprintf(file, "%s %.0f\n", i->first.c_str(), i->second);
+    }
+    fclose(file);
+    return TRUE;
+}
+
+int main(int argc, char* argv[]){
+    bool compare = (argc > 1) && (0 == strcmp(argv[1], "--compare"));
+    bool update = (argc > 1) && (0 == strcmp(argv[1], "--update"));
+    if((argc > 1) && !compare && !update){
+        printf("usage: bench [--compare|--update]\n");
+        return 2;
+    }
+
+    Modes_Run();
+    char report[512];
+    aCtrl.Benchmark_Run();
+    aCtrl.Benchmark_Report(report, sizeof(report), FALSE);
+    for(int mode = 0; mode < BENCH_MODE_COUNT; mode++){
+        char name[8];
+        snprintf(name, sizeof(name), "s%d,", mode);
+        const char* entry = strstr(report, name);
+        Harness_Expect((NULL != entry) && (0 != strtoul(entry + strlen(name), NULL, 10)), "mode %d never ran", mode);
+    }
+
+    std::map<std::string, double> kernels = Kernels_Run();
+    std::map<std::string, double> cycles;
+    if(Host_Ticks_Instructions(TRUE)){
+        cycles = Kernels_Run(); // the s0-s6 means are still in ns, they were taken while the modes ran
+        Host_Ticks_Instructions(FALSE);
+    }
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/bench_baseline.txt", BENCH_DIR);
+    std::map<std::string, double> baseline;
+    bool haveBaseline = Baseline_Load(path, &baseline);
+    if(compare) Harness_Expect(haveBaseline, "no baseline %s, run with --update", path);
+
+    printf("kernel,ns,baseline_ns,change_pct,m3_cycles\n");
+    for(std::map<std::string, double>::iterator i = kernels.begin(); i != kernels.end(); ++i){
+        const char* name = i->first.c_str();
+        printf("%s,%.0f", name, i->second);
+        if(baseline.count(i->first) && (baseline[i->first] > 0)){
+            printf(",%.0f,%+.0f", baseline[i->first], (i->second - baseline[i->first])*100.0/baseline[i->first]);
+        } else{
+            printf(",-,-");
+        }
+        bool counted = cycles.count(i->first) && ('s' != name[0] || !isdigit(name[1]));
+        if(counted){
+            printf(",%.0f\n", cycles[i->first]*BENCH_M3_CPI);
+        } else{
+            printf(",-\n");
+        }
+        if(compare && baseline.count(i->first)){
+            Harness_Expect(i->second <= baseline[i->first]*BENCH_REGRESSION + BENCH_NOISE_NS, "%s: %.0f ns, baseline %.0f ns", name,
+                           i->second, baseline[i->first]);
+        }
+    }
+    if(cycles.empty()) printf("# no instruction counter on this host, m3_cycles not estimated\n");
+
+    Harness_Expect(kernels["tick_lin"] <= kernels["tick_old"]*BENCH_TICK_MARGIN + BENCH_TICK_NOISE_NS,
+                   "linear ramp tick %.0f ns, the pre-curve tick %.0f ns", kernels["tick_lin"], kernels["tick_old"]);
+    if(!cycles.empty()){
+        Harness_Expect(cycles["tick_lin"] <= cycles["tick_old"]*BENCH_TICK_MARGIN, "linear ramp tick %.0f instructions, the pre-curve tick %.0f",
+                       cycles["tick_lin"], cycles["tick_old"]);
+    }
+    if(update) Harness_Expect(Baseline_Save(path, kernels), "cannot write %s", path);
+    return Harness_Result();
+}
@@ -0,0 +1,81 @@
+/************************************************************************************************************************************/
+/** @file       boot_time.cpp
+ *  @brief      time from setup() to the first LED frame on the PSoC, on the virtual clock
+ *  @details    boot_time <scenario> powers the lamp up from a fresh device and takes the time from setup() entering to
+ *              the first write of the dimValue registers (sub address 2) the PSoC sees, from the host's own PSoC trace.
+ *              It has to stay under the scenario's stored limit, the time this boot order reached plus a margin, so a
+ *              change that pushes work in front of first light fails here before it costs BOOT_LIGHT_BUDGET on a lamp.
+ *              The firmware's own first light stamp (bootProfile[BOOT_PHASE_FIRST_LIGHT]) has to agree with the trace.
+ *              Prints every boot phase.
+ *
+ *              The virtual clock only moves where the firmware waits (delay(), delayMicroseconds() and the bus retry
+ *              backoff), so the time is the boot's waits, which is what the boot order decides, not its compute.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+
+#define BOOT_TRACE_SLACK    1000UL      // us, the PSoC trace has ms resolution
+
+struct BootScenario {
+    const char* name;
+    bool offline;
+    unsigned long limit;            // us from setup() to the first LED frame
+};
+
+// Both wait out only the PSoC read settle time (30 ms) before the first frame, the cloud comes after first light
+static const BootScenario scenarios[] = {
+    { "offline",    TRUE,   35000 },
+    { "online",     FALSE,  35000 },
+};
+
+static const char* phaseNames[BOOT_PHASE_COUNT] = { "setup", "psoc read", "settings", "frame queued", "first light", "watchdog",
+                                                    "cloud", "flash", "setup done", "first loop" };
+
+static LampHarness lamp;
+
+// us of the first dimValue write in the PSoC trace since the device powered up, 0 if there is none
+static unsigned long First_LED_Write(void){
+    const std::vector<uint8_t>& trace = hostDevice.psocTrace;
+    unsigned long ms = 0;
+    for(size_t i = 0; i + 4 <= trace.size(); i += 4 + trace[i + 3]){
+        ms += trace[i] | (trace[i + 1] << 8);
+        if((2 == trace[i + 2]) && (trace[i + 3] > 0)) return ms*1000;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    const BootScenario* scenario = NULL;
+    for(unsigned int i = 0; (argc > 1) && (i < sizeof(scenarios)/sizeof(scenarios[0])); i++){
+        if(0 == strcmp(argv[1], scenarios[i].name)) scenario = &scenarios[i];
+    }
+    if(NULL == scenario){
+        printf("usage: boot_time <offline|online>\n");
+        return 2;
+    }
+
+    lamp.Boot(1767643200L, scenario->offline); // Monday 2026-01-05 12:00 Pacific
+    lamp.Run_For(1000);
+    const volatile unsigned long* profile = aCtrl.bootProfile;
+    for(int phase = 0; phase < BOOT_PHASE_COUNT; phase++){
+        printf("%-12s %8lu us\n", phaseNames[phase], profile[phase] - profile[BOOT_PHASE_SETUP]);
+    }
+
+    unsigned long written = First_LED_Write();
+    Harness_Expect(0 != written, "%s: no LED frame reached the PSoC", scenario->name);
+    long light = (long)(written - profile[BOOT_PHASE_SETUP]);
+    long stamped = (long)(profile[BOOT_PHASE_FIRST_LIGHT] - profile[BOOT_PHASE_SETUP]);
+    printf("%s: first LED frame %ld us after setup(), limit %lu us, budget %lu us\n", scenario->name, light, scenario->limit,
+           BOOT_LIGHT_BUDGET);
+    Harness_Expect((0 != profile[BOOT_PHASE_FIRST_LIGHT]) && (labs(stamped - light) <= (long)BOOT_TRACE_SLACK),
+                   "%s: first light stamped at %ld us, the trace has %ld us", scenario->name, stamped, light);
+    Harness_Expect(light <= (long)scenario->limit, "%s: first LED frame %ld us after setup(), limit %lu us", scenario->name, light,
+                   scenario->limit);
+    Harness_Expect(light <= (long)BOOT_LIGHT_BUDGET, "%s: over BOOT_LIGHT_BUDGET", scenario->name);
+    return Harness_Result();
+}
@@ -0,0 +1,138 @@
+/************************************************************************************************************************************/
+/** @file       dither_cost.cpp
+ *  @brief      the output dither against plain rounding: average error and bus frames
+ *  @details    Every loop() pass the four dimValue registers the PSoC holds are sampled next to the 8.8 intensity the
+ *              firmware aims for (LED_CH_Intensity). Over windows of DITHER_WINDOW_PASSES the mean register value of
+ *              each channel is compared with the mean target, in register steps. The same targets rounded per pass
+ *              give the error and the frames plain rounding would have cost. Cases are the night levels the lamp
+ *              sits at, where the dither has to stop once LED_DITHER_WINDOW is over (no frames, error under one step),
+ *              and a slow fade across them, where it has to beat rounding. Prints error and frames/s of both per case.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+
+#define DITHER_WINDOW_PASSES    20      // 100 ms of RAMP_DELAY passes, well above the flicker fusion rate
+#define DITHER_STATIC_TIME      10000UL // ms sampled at a held level, after LED_DITHER_WINDOW
+#define DITHER_FADE_TIME        60000UL // ms of the slow fade
+#define DITHER_FADE_ERROR       0.25    // steps, worst window of the fade
+
+extern uint16_t LED_CH_Intensity[NUM_LED_CH];
+
+struct DitherSample {
+    float target[NUM_LED_CH];       // register steps
+    uint8_t output[NUM_LED_CH];
+};
+
+struct DitherCost {
+    float meanError, worstError;    // steps, over all windows and channels
+    float framesPerSecond;
+};
+
+static LampHarness lamp;
+static std::vector<DitherSample> samples;
+
+static void Sample(void){
+    DitherSample sample;
+    for(int ch = 0; ch < NUM_LED_CH; ch++){
+        sample.target[ch] = LED_CH_Intensity[ch]/256.0;
+        sample.output[ch] = hostDevice.psoc[2 + ch];
+    }
+    samples.push_back(sample);
+}
+
+// rounded TRUE for what plain rounding of the same targets would have put out
+static DitherCost Cost(bool rounded){
+    DitherCost cost = { 0, 0, 0 };
+    int windows = 0;
+    for(size_t start = 0; start + DITHER_WINDOW_PASSES <= samples.size(); start += DITHER_WINDOW_PASSES){
+        for(int ch = 0; ch < NUM_LED_CH; ch++){
+            float target = 0, output = 0;
+            for(size_t i = start; i < start + DITHER_WINDOW_PASSES; i++){
+                target += samples[i].target[ch];
+                output += rounded ? floorf(samples[i].target[ch] + 0.5) : samples[i].output[ch];
+            }
+            float error = fabsf(output - target)/DITHER_WINDOW_PASSES;
+            cost.meanError += error;
+            if(error > cost.worstError) cost.worstError = error;
+            windows++;
+        }
+    }
+    if(windows) cost.meanError /= windows;
+    unsigned long frames = 0;
+    for(size_t i = 1; i < samples.size(); i++){
+        for(int ch = 0; ch < NUM_LED_CH; ch++){
+            uint8_t before = rounded ? floorf(samples[i - 1].target[ch] + 0.5) : samples[i - 1].output[ch];
+            uint8_t after = rounded ? floorf(samples[i].target[ch] + 0.5) : samples[i].output[ch];
+            if(before != after){
+                frames++;
+                break;
+            }
+        }
+    }
+    cost.framesPerSecond = samples.size() ? frames*1000.0/(samples.size()*lamp.activeStep) : 0;
+    return cost;
+}
+
+static void Report(const char* name, const DitherCost& dithered, const DitherCost& rounded){
+    printf("%-10s dither: error %.3f mean %.3f worst, %5.1f frames/s   rounding: error %.3f mean %.3f worst, %5.1f frames/s\n", name,
+           dithered.meanError, dithered.worstError, dithered.framesPerSecond, rounded.meanError, rounded.worstError,
+           rounded.framesPerSecond);
+}
+
+// A level held from the app, sampled once the dither window is over
+static void Static_Check(int level){
+    char command[16];
+    snprintf(command, sizeof(command), "BRI,%d", level);
+    Harness_Expect(200 == lamp.Cloud("arioDo", command), "%s", command);
+    lamp.Run_For(APP_ADJUST_FADE_TIME + LED_DITHER_WINDOW + 1000);
+    unsigned long transactions = hostDevice.psocTransactions;
+    samples.clear();
+    lamp.afterPass = Sample;
+    lamp.Run_For(DITHER_STATIC_TIME);
+    lamp.afterPass = NULL;
+
+    char name[16];
+    snprintf(name, sizeof(name), "level %d", level);
+    DitherCost dithered = Cost(FALSE), rounded = Cost(TRUE);
+    Report(name, dithered, rounded);
+    Harness_Expect(hostDevice.psocTransactions == transactions, "%s: %lu PSoC writes while the level held", name,
+                   hostDevice.psocTransactions - transactions);
+    Harness_Expect(dithered.worstError < 1, "%s: error %.3f steps", name, dithered.worstError);
+}
+
+int main(){
+    lamp.Boot(1767643200L, TRUE); // Monday 2026-01-05 12:00 Pacific
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,1"), "PWR,1");
+    Harness_Expect(200 == lamp.Cloud("arioDo", "CCT,2700"), "CCT,2700");
+    lamp.Run_For(5000);
+    lamp.idleStep = lamp.activeStep; // the dither runs from Scheduler() every RAMP_DELAY, every pass is sampled
+
+    // MIN_BRIGHTNESS + 2, the bedtime and demo floor, the ALS floor
+    Static_Check(MIN_BRIGHTNESS + 2);
+    Static_Check(5);
+    Static_Check(10);
+
+    // a slow fade from 5 to 15
+    const LampSegment fade[] = {
+        { 2700, 5,  SEG_CURVE(RAMP_CURVE_LINEAR), 0,                1000, 0 },
+        { 2700, 15, SEG_CURVE(RAMP_CURVE_LINEAR), DITHER_FADE_TIME, 1000, 0 },
+    };
+    Harness_Expect(lamp.Program_Upload(fade, sizeof(fade)/sizeof(fade[0])), "fade upload");
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PROG"), "PROG");
+    lamp.Run_For(2000);
+    samples.clear();
+    lamp.afterPass = Sample;
+    lamp.Run_For(DITHER_FADE_TIME - 1000);
+    lamp.afterPass = NULL;
+    DitherCost dithered = Cost(FALSE), rounded = Cost(TRUE);
+    Report("fade 5-15", dithered, rounded);
+    Harness_Expect(dithered.worstError <= DITHER_FADE_ERROR, "fade: error %.3f steps", dithered.worstError);
+    Harness_Expect(dithered.meanError < rounded.meanError, "fade: error %.3f steps, rounding %.3f", dithered.meanError, rounded.meanError);
+    Harness_Expect(dithered.framesPerSecond <= 1000.0/RAMP_DELAY, "fade: %.1f frames/s", dithered.framesPerSecond);
+    return Harness_Result();
+}
@@ -0,0 +1,107 @@
+/************************************************************************************************************************************/
+/** @file       dst_sweep.cpp
+ *  @brief      the DST rules against the tz database, 2026 through 2031
+ *  @details    For every rule set a zone that follows it is configured the way the app does it ("ZONE,n", "DST,n") and
+ *              the clock runs through six years in DST_SWEEP_STEP steps, which lands on every transition instant. After
+ *              every loop() pass the firmware's local offset has to match what the host C library says for the
+ *              matching tz database zone. Every case starts with the clock set back to the start, the way a cloud time
+ *              sync moves it. Needs the tz database in /usr/share/zoneinfo, and is skipped without it.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+#include <time.h>
+
+#define DST_SWEEP_START     1767225600L // 2026-01-01 00:00 UTC
+#define DST_SWEEP_END       1956528000L // 2032-01-01 00:00 UTC
+#define DST_SWEEP_STEP      (30*ONE_MINUTE)
+#define DST_REPORT_LIMIT    5
+#define DST_SKIPPED         77          // ctest SKIP_RETURN_CODE
+
+struct DSTCase {
+    const char* tz;                 // tz database zone, NULL for a fixed offset of zone + 1
+    int zone;                       // hours from UTC, standard time
+    int rule;                       // DST_RULE_*
+    int transitions;                // expected over the sweep
+};
+
+static const DSTCase cases[] = {
+    { "America/New_York",       -5, DST_RULE_US,    12 },
+    { "America/Los_Angeles",    -8, DST_RULE_US,    12 },
+    { "America/Phoenix",        -7, DST_RULE_NONE,  0 },
+    { "Europe/London",          0,  DST_RULE_EU,    12 },
+    { "Europe/Paris",           1,  DST_RULE_EU,    12 },
+    { "Europe/Helsinki",        2,  DST_RULE_EU,    12 },
+    { "Australia/Sydney",       10, DST_RULE_AU,    12 },
+    { "Pacific/Auckland",       12, DST_RULE_NZ,    12 },
+    { NULL,                     3,  DST_RULE_FIXED, 0 },
+};
+
+static LampHarness lamp;
+static const DSTCase* sweep;
+static bool firstPass;
+static long lastOffset;
+static int transitions, mismatches;
+
+static void Check(void){
+    time_t utc = Time.now();
+    long offset = Time.local() - utc;
+    long expected = (sweep->zone + 1)*3600L;
+    if(NULL != sweep->tz){
+        struct tm local;
+        localtime_r(&utc, &local);
+        expected = local.tm_gmtoff;
+    }
+    if((offset != expected) && (mismatches++ < DST_REPORT_LIMIT)){
+        Harness_Expect(FALSE, "%s at %ld: offset %ld s, expected %ld s", sweep->tz ? sweep->tz : "fixed", (long)utc, offset, expected);
+    }
+    if(firstPass){
+        firstPass = FALSE;
+    } else if(offset != lastOffset){
+        transitions++;
+    }
+    lastOffset = offset;
+}
+
+int main(){
+    for(unsigned int i = 0; i < sizeof(cases)/sizeof(cases[0]); i++){
+        char path[64];
+        snprintf(path, sizeof(path), "/usr/share/zoneinfo/%s", cases[i].tz ? cases[i].tz : "UTC");
+        FILE* file = fopen(path, "rb");
+        if(NULL == file){
+            printf("SKIPPED, no tz database (%s)\n", path);
+            return DST_SKIPPED;
+        }
+        fclose(file);
+    }
+
+    lamp.Boot(DST_SWEEP_START, TRUE);
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,0"), "PWR,0");
+    lamp.Run_For(5000);
+    lamp.idleStep = DST_SWEEP_STEP;
+    lamp.afterPass = Check;
+    for(unsigned int i = 0; i < sizeof(cases)/sizeof(cases[0]); i++){
+        sweep = &cases[i];
+        setenv("TZ", sweep->tz ? sweep->tz : "UTC", 1);
+        tzset();
+        char command[16];
+        snprintf(command, sizeof(command), "ZONE,%d", (sweep->zone + 12)*4);
+        Harness_Expect(200 == lamp.Cloud("arioSet", command), "%s", command);
+        snprintf(command, sizeof(command), "DST,%d", sweep->rule);
+        Harness_Expect(200 == lamp.Cloud("arioSet", command), "%s", command);
+
+        Host_Time_Set(DST_SWEEP_START); // back to the start, like a cloud time sync
+        firstPass = TRUE;
+        transitions = mismatches = 0;
+        lamp.Run_To(DST_SWEEP_END);
+        printf("%-20s UTC%+d rule %d: %d transitions, %d mismatches\n", sweep->tz ? sweep->tz : "fixed", sweep->zone, sweep->rule,
+               transitions, mismatches);
+        Harness_Expect(sweep->transitions == transitions, "%s: %d transitions, expected %d", sweep->tz ? sweep->tz : "fixed",
+                       transitions, sweep->transitions);
+    }
+    return Harness_Result();
+}
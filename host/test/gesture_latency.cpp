@@ -0,0 +1,114 @@
+/************************************************************************************************************************************/
+/** @file       gesture_latency.cpp
+ *  @brief      every mode button gesture fires its row, and only waits where a longer gesture could still match
+ *  @details    Scripted edges on the mode button (PIN_BUTTON_BOTTOM), with the top or middle button held for the chorded
+ *              rows. The latency of a gesture is taken from the physical edge that decides it (the last release of a
+ *              click series, or the moment a long click or the pairing hold is reached) to the loop() pass the engine
+ *              fires the row on, and it may only exceed the debounce by the click gap where the table has a row with more
+ *              presses. The six click soft reset has nothing longer after it, so it fires on release. Prints the latency
+ *              of every gesture next to the engine's own lastLatency.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+#include "ario_gesture.h"
+
+extern GestureEngine modeButton;
+
+#define GESTURE_PRESS_TIME  80UL    // ms a short press is held
+#define GESTURE_GAP_TIME    120UL   // ms between the presses of a series, under GESTURE_CLICK_GAP
+
+// rows of modeGestures in the NW variant
+#define ROW_CLICK           0
+#define ROW_LED_CHECK       1
+#define ROW_RAISE_HAND      2
+#define ROW_DEMO            3
+#define ROW_SOFT_RESET      4
+#define ROW_MAC             5
+#define ROW_MENU            6
+#define ROW_ONLINE          7
+#define ROW_PAIRING         8
+#define ROW_MAC_LONG        9
+#define ROW_PAIRING_HOLD    10
+
+struct GestureScript {
+    const char* name;
+    int chord;                      // button held through the gesture, GESTURE_NO_CHORD if none
+    int presses;                    // short presses, including the final one of a click series
+    unsigned long hold;             // ms the final press is held after the short ones, 0 for a click series
+    unsigned long decide;           // ms into the held press that decides the gesture
+    int row;
+    unsigned long wait;             // ms the engine has to wait for a longer gesture after the deciding edge
+};
+
+// The LED check comes last, its diagnostic mode takes the mode button over until the next press
+static const GestureScript scripts[] = {
+    { "click",              GESTURE_NO_CHORD,   1, 0,                               0,                          ROW_CLICK,          GESTURE_CLICK_GAP },
+    { "double click",       GESTURE_NO_CHORD,   2, 0,                               0,                          ROW_DEMO,           GESTURE_CLICK_GAP },
+    { "middle double",      PIN_BUTTON_MIDDLE,  2, 0,                               0,                          ROW_RAISE_HAND,     GESTURE_CLICK_GAP },
+    { "long",               GESTURE_NO_CHORD,   0, GESTURE_LONG_TIME + 200,         GESTURE_LONG_TIME,          ROW_MENU,           0 },
+    { "middle long",        PIN_BUTTON_MIDDLE,  0, GESTURE_LONG_TIME + 200,         GESTURE_LONG_TIME,          ROW_MAC,            0 },
+    { "2-press long",       GESTURE_NO_CHORD,   1, GESTURE_LONG_TIME + 200,         GESTURE_LONG_TIME,          ROW_ONLINE,         0 },
+    { "3-press long",       GESTURE_NO_CHORD,   2, GESTURE_LONG_TIME + 200,         GESTURE_LONG_TIME,          ROW_PAIRING,        0 },
+    { "4-press long",       GESTURE_NO_CHORD,   3, GESTURE_LONG_TIME + 200,         GESTURE_LONG_TIME,          ROW_MAC_LONG,       0 },
+    { "15 s hold",          GESTURE_NO_CHORD,   0, ENTER_WIFI_PAIRING_TIME + 200,   ENTER_WIFI_PAIRING_TIME,    ROW_PAIRING_HOLD,   0 },
+    { "6 clicks",           GESTURE_NO_CHORD,   6, 0,                               0,                          ROW_SOFT_RESET,     0 },
+    { "top double",         PIN_BUTTON_TOP,     2, 0,                               0,                          ROW_LED_CHECK,      GESTURE_CLICK_GAP },
+};
+
+static LampHarness lamp;
+static int seenRow;
+static unsigned long passStart;     // millis() when the current pass started, an action may delay() past it
+static unsigned long firedAt;       // passStart of the pass the last row change was seen on
+
+static void Pass_Start(void){
+    passStart = millis();
+}
+
+static void Observe(void){
+    if(modeButton.lastRow == seenRow) return;
+    seenRow = modeButton.lastRow;
+    firedAt = passStart;
+}
+
+static void Gesture_Check(const GestureScript* script){
+    modeButton.lastRow = seenRow = -1;
+    if(GESTURE_NO_CHORD != script->chord) lamp.Pin_Set(script->chord, HIGH);
+    unsigned long decidedAt = 0;
+    for(int i = 0; i < script->presses; i++){
+        lamp.Press(PIN_BUTTON_BOTTOM, GESTURE_PRESS_TIME);
+        decidedAt = millis();
+        if((i + 1 < script->presses) || script->hold) lamp.Run_For(GESTURE_GAP_TIME);
+    }
+    if(script->hold){
+        decidedAt = millis() + script->decide;
+        lamp.Press(PIN_BUTTON_BOTTOM, script->hold);
+    }
+    lamp.Run_For(GESTURE_CLICK_GAP + 2*GESTURE_DEBOUNCE_TIME);
+    if(GESTURE_NO_CHORD != script->chord) lamp.Pin_Set(script->chord, LOW);
+
+    long latency = (long)(firedAt - decidedAt);
+    long limit = script->wait + GESTURE_DEBOUNCE_TIME + lamp.activeStep;
+    printf("%-14s row %2d after %4ld ms (engine %4lu ms), limit %4ld ms\n", script->name, seenRow, latency, modeButton.lastLatency, limit);
+    Harness_Expect(script->row == seenRow, "%s: fired row %d, expected %d", script->name, seenRow, script->row);
+    Harness_Expect((latency >= (long)script->wait) && (latency <= limit), "%s: %ld ms from the deciding edge, expected %lu to %ld",
+                   script->name, latency, script->wait, limit);
+    Harness_Expect(modeButton.lastLatency <= script->wait + lamp.activeStep, "%s: engine latency %lu ms", script->name,
+                   modeButton.lastLatency);
+    lamp.Run_For(1000);
+}
+
+int main(){
+    lamp.Boot(1767643200L, TRUE); // Monday 2026-01-05 12:00 Pacific
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,0"), "PWR,0");
+    lamp.Run_For(5000);
+    lamp.idleStep = lamp.activeStep; // a real loop() keeps polling through a 15 s hold, the harness would go idle after 2 s
+    lamp.beforePass = Pass_Start;
+    lamp.afterPass = Observe;
+    for(unsigned int i = 0; i < sizeof(scripts)/sizeof(scripts[0]); i++) Gesture_Check(&scripts[i]);
+    return Harness_Result();
+}
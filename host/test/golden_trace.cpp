@@ -0,0 +1,141 @@
+/************************************************************************************************************************************/
+/** @file       golden_trace.cpp
+ *  @brief      PSoC write traces of the lamp programs against the golden traces in host/golden
+ *  @details    golden_trace <scenario> runs one scenario from a fresh boot, captures every register write the PSoC sees
+ *              and compares it with host/golden/<scenario>.trace (see trace.h for the tolerances). Prints the bus traffic
+ *              per minute next to the golden numbers and fails if it grew. golden_trace <scenario> --update writes the
+ *              capture as the new golden trace instead, for a change that is meant to move the output.
+ *
+ *              Every scenario runs in its own process, the firmware keeps its state in globals that setup() does not
+ *              reset.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+#include "trace.h"
+
+#define GOLDEN_DAY      1767600000L // Monday 2026-01-05 00:00 Pacific Standard Time
+
+static LampHarness lamp;
+static unsigned long traceStart;     // millis() at the start of the capture
+
+static void Trace_Start(void){
+    Host_Trace_Start();
+    traceStart = millis();
+}
+
+static time_t Local(int hour, int minute){
+    return GOLDEN_DAY + hour*3600L + minute*60L;
+}
+
+static void Lamp_On(void){
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,1"), "PWR,1");
+    lamp.Run_For(5000); // turn on ramp
+}
+
+static void Lamp_Off(void){
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,0"), "PWR,0");
+    lamp.Run_For(5000);
+}
+
+// The built in demonstration program from a lamp that is on
+static void Scenario_Demo(void){
+    lamp.Boot(Local(12, 0), TRUE);
+    Lamp_On();
+    Trace_Start();
+    Harness_Expect(200 == lamp.Cloud("arioDo", "DEMO"), "DEMO");
+    lamp.Run_For(40000);
+}
+
+// A 1 minute wake alarm at 06:02, the lamp is off until the dawn simulation starts
+static void Scenario_DawnSim(void){
+    lamp.Boot(Local(6, 0), TRUE);
+    Lamp_Off();
+    Harness_Expect(200 == lamp.Cloud("arioSet", "WAKE,2,1,0602,1"), "WAKE");
+    Trace_Start();
+    lamp.Run_To(Local(6, 4));
+}
+
+// A 2 minute bedtime reminder at 22:01 dims the lamp down and turns it off
+static void Scenario_BedTime(void){
+    lamp.Boot(Local(22, 0), TRUE);
+    Lamp_On();
+    Harness_Expect(200 == lamp.Cloud("arioSet", "BED,2,1,2201,2"), "BED");
+    Trace_Start();
+    lamp.Run_To(Local(22, 6));
+}
+
+// The default schedule over a whole day, the hourly Load_RTC_Val steps. Idle minutes are skipped in one jump.
+static void Scenario_Schedule(void){
+    lamp.Boot(Local(0, 0), TRUE);
+    Lamp_On();
+    lamp.idleStep = ONE_MINUTE;
+    Trace_Start();
+    lamp.Run_To(Local(24, 0));
+}
+
+// Set_CCT and Set_Brightness ramps from the app, one of them retargeted while it runs
+static void Scenario_Ramps(void){
+    lamp.Boot(Local(12, 0), TRUE);
+    Lamp_On();
+    Trace_Start();
+    const char* commands[][2] = { { "CCT,2700", "3000" }, { "BRI,60", "3000" }, { "CCT,5000", "200" }, { "CCT,3500", "3000" },
+                                  { "BRI,200", "3000" } };
+    for(unsigned int i = 0; i < sizeof(commands)/sizeof(commands[0]); i++){
+        Harness_Expect(200 == lamp.Cloud("arioDo", commands[i][0]), "%s", commands[i][0]);
+        lamp.Run_For(atoi(commands[i][1]));
+    }
+}
+
+struct GoldenScenario {
+    const char* name;
+    void (*run)(void);
+};
+
+static const GoldenScenario scenarios[] = {
+    { "demo",       Scenario_Demo },
+    { "dawnsim",    Scenario_DawnSim },
+    { "bedtime",    Scenario_BedTime },
+    { "schedule",   Scenario_Schedule },
+    { "ramps",      Scenario_Ramps },
+};
+
+int main(int argc, char* argv[]){
+    const GoldenScenario* scenario = NULL;
+    for(unsigned int i = 0; (argc > 1) && (i < sizeof(scenarios)/sizeof(scenarios[0])); i++){
+        if(0 == strcmp(argv[1], scenarios[i].name)) scenario = &scenarios[i];
+    }
+    if(NULL == scenario){
+        printf("usage: golden_trace <demo|dawnsim|bedtime|schedule|ramps> [--update]\n");
+        return 2;
+    }
+    bool update = (argc > 2) && (0 == strcmp(argv[2], "--update"));
+
+    scenario->run();
+    unsigned long duration = millis() - traceStart;
+    Harness_Expect((aCtrl.busStats.transactions == hostDevice.psocTransactions) && (aCtrl.busStats.bytes == hostDevice.psocBytes),
+                   "busStats counted %lu transactions, %lu bytes, the PSoC saw %lu, %lu", aCtrl.busStats.transactions,
+                   aCtrl.busStats.bytes, hostDevice.psocTransactions, hostDevice.psocBytes);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.trace", GOLDEN_DIR, scenario->name);
+    if(update){
+        std::vector<TraceFrame> frames;
+        Trace_Decode(hostDevice.psocTrace, &frames);
+        TraceTraffic traffic = Trace_Traffic(frames, duration);
+        Harness_Expect(Trace_Save(path, hostDevice.psocTrace), "cannot write %s", path);
+        printf("%s: %zu bytes, %lu transactions, %lu bytes in %.1f s, %.0f transactions/min, %.0f bytes/min\n", path,
+               hostDevice.psocTrace.size(), traffic.transactions, traffic.bytes, duration/1000.0, traffic.transactionsPerMinute,
+               traffic.bytesPerMinute);
+        return Harness_Result();
+    }
+    std::vector<uint8_t> golden;
+    if(Harness_Expect(Trace_Load(path, &golden), "no golden trace %s, run with --update", path)){
+        Trace_Compare(scenario->name, golden, hostDevice.psocTrace, duration);
+    }
+    return Harness_Result();
+}
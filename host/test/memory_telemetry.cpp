@@ -0,0 +1,55 @@
+/************************************************************************************************************************************/
+/** @file       memory_telemetry.cpp
+ *  @brief      the heap and stack samples of MemoryMonitor
+ *  @details    Runs an idle hour and an hour with a program segment upload every second, and reads the "HEAP" report after each.
+ *              The painted stack has to lie inside the application thread's own stack and some of it has to be left
+ *              untouched, an idle pass may not allocate more than MEMORY_IDLE_ALLOCS times, and the allocation count
+ *              of a pass that handles a cloud command has to show the String churn of the handler. Prints both reports.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+#include "ario_memory.h"
+
+extern MemoryMonitor memMonitor;
+extern MemoryLog memoryLog;
+
+#define MEMORY_IDLE_ALLOCS  4       // most allocations of an idle pass
+
+// long enough that its substrings do not fit the host std::string's inline buffer, like every String on the device
+static const char* segmentUpload = "PROG,0,D007800010270000E80300000000";
+
+static LampHarness lamp;
+
+static MemoryRecord Report(const char* name){
+    char report[256];
+    memMonitor.Report(report, sizeof(report), FALSE);
+    printf("%-8s %s\n", name, report);
+    return memoryLog.ring[(memoryLog.head + MEMORY_RING_SIZE - 1) % MEMORY_RING_SIZE];
+}
+
+int main(){
+    lamp.Boot(1767643200L, TRUE); // Monday 2026-01-05 12:00 Pacific
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,0"), "PWR,0");
+    lamp.Run_For(ONE_HOUR);
+    MemoryRecord idle = Report("idle");
+    Harness_Expect(MEMORY_RING_SIZE == memoryLog.count, "%u samples in the ring after an hour", memoryLog.count);
+    Harness_Expect((0 < idle.stackFree) && (idle.stackFree <= MEMORY_STACK_PAINT), "%u bytes of stack untouched", idle.stackFree);
+    Harness_Expect(idle.loopAllocs <= MEMORY_IDLE_ALLOCS, "an idle pass allocated %u times", idle.loopAllocs);
+
+    int rejected = 0;
+    for(int second = 0; second < 3600; second++){
+        if(200 != lamp.Cloud("arioSet", segmentUpload)) rejected++;
+        lamp.Run_For(1000);
+    }
+    Harness_Expect(0 == rejected, "%s rejected %d times", segmentUpload, rejected);
+    MemoryRecord busy = Report("commands");
+    Harness_Expect(busy.loopAllocs > idle.loopAllocs, "a pass with a cloud command allocated %u times, idle %u", busy.loopAllocs,
+                   idle.loopAllocs);
+    Harness_Expect(memoryLog.worst.loopAllocs >= busy.loopAllocs, "worst %u allocations", memoryLog.worst.loopAllocs);
+    return Harness_Result();
+}
@@ -0,0 +1,133 @@
+/************************************************************************************************************************************/
+/** @file       output_jitter.cpp
+ *  @brief      frames reach the bus on time while the application thread is busy
+ *  @details    Built against ario_host_stubs_threads, so the output thread is a std::thread and runs alongside loop()
+ *              in real time. The demo program runs for JITTER_PASSES passes, one every RAMP_DELAY of wall time, and
+ *              after every pass the application thread burns a random 0 to JITTER_LOAD_MAX_US of CPU, the way cloud
+ *              handlers, String work and delay() take it on the device. Every frame is followed from the start of the
+ *              pass that queued it to its write on the bus. The latency may not pass JITTER_LATENCY_P99 for 99% of the
+ *              frames, and the spacing of the writes may not stray from the spacing of their passes by more than
+ *              JITTER_INTERVAL_RMS. No frame may be lost. Prints the latency percentiles and the interval jitter.
+ *
+ *              The host stubs give the output thread a real time priority where they may, the way it preempts the
+ *              application thread on the device. On a single CPU without that the numbers are the host scheduler's
+ *              time slices and not the firmware's, so the test is skipped.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+
+#define JITTER_PASSES           1000    // 5 s of passes
+#define JITTER_LOAD_MAX_US      4000    // busy work after a pass, most of the RAMP_DELAY left over
+#define JITTER_LATENCY_P99      1000    // us from the start of the pass to the write
+#define JITTER_INTERVAL_RMS     500     // us, write spacing against pass spacing
+#define JITTER_DRAIN_TIME       1000    // ms the output thread gets to empty the queue at the end
+#define JITTER_MAX_FRAMES       (16*JITTER_PASSES)
+#define JITTER_SKIPPED          77      // ctest SKIP_RETURN_CODE
+
+extern std::atomic<uint8_t> outputHead, outputTail;
+
+typedef std::chrono::steady_clock JitterClock;
+
+static LampHarness lamp;
+static JitterClock::time_point writeTime[JITTER_MAX_FRAMES];
+static std::atomic<unsigned int> written(0);
+
+// on the output thread
+static void Written(void){
+    unsigned int n = written.load(std::memory_order_relaxed);
+    if(n < JITTER_MAX_FRAMES) writeTime[n] = JitterClock::now();
+    written.store(n + 1, std::memory_order_release);
+}
+
+static void Load(unsigned long us){
+    JitterClock::time_point end = JitterClock::now() + std::chrono::microseconds(us);
+    while(JitterClock::now() < end);
+}
+
+static long Us(JitterClock::duration d){
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+// TRUE if a thread may get the real time priority the stubs give the output thread
+static bool Priority_Available(void){
+    static std::mutex probing;
+    probing.lock();
+    std::thread probe([]{ std::lock_guard<std::mutex> wait(probing); }); // asleep until the priority is set
+    struct sched_param schedule;
+    schedule.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    bool available = (0 == pthread_setschedparam(probe.native_handle(), SCHED_FIFO, &schedule));
+    probing.unlock();
+    probe.join();
+    return available;
+}
+
+int main(){
+    if(!Priority_Available() && (std::thread::hardware_concurrency() < 2)){
+        printf("SKIPPED, one CPU and no real time priority for the output thread\n");
+        return JITTER_SKIPPED;
+    }
+    lamp.Boot(1767643200L, TRUE); // Monday 2026-01-05 12:00 Pacific
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,1"), "PWR,1");
+    lamp.Run_For(5000);
+    Harness_Expect(200 == lamp.Cloud("arioDo", "DEMO"), "DEMO");
+
+    // frame i was queued in pass framePass[i]
+    std::vector<JitterClock::time_point> passStart(JITTER_PASSES);
+    std::vector<int> framePass;
+    srand(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(JITTER_DRAIN_TIME));
+    uint8_t head = outputHead.load();
+    written = 0;
+    hostDevice.psocWritten = Written;
+    JitterClock::time_point next = JitterClock::now();
+    for(int pass = 0; pass < JITTER_PASSES; pass++){
+        std::this_thread::sleep_until(next);
+        passStart[pass] = JitterClock::now();
+        next = passStart[pass] + std::chrono::milliseconds(RAMP_DELAY);
+        Host_Clock_Advance(RAMP_DELAY*1000UL);
+        loop();
+        uint8_t now = outputHead.load();
+        for(uint8_t queued = (now - head) & (OUTPUT_QUEUE_SIZE - 1); queued > 0; queued--) framePass.push_back(pass);
+        head = now;
+        Load(rand() % JITTER_LOAD_MAX_US);
+    }
+    for(int wait = 0; (wait < JITTER_DRAIN_TIME) && (outputTail.load() != outputHead.load()); wait++){
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10)); // the last write finishes after the tail moved
+    hostDevice.psocWritten = NULL;
+
+    unsigned int frames = std::min<unsigned int>(framePass.size(), JITTER_MAX_FRAMES);
+    Harness_Expect(frames > JITTER_PASSES/4, "only %u frames in %d passes", frames, JITTER_PASSES);
+    Harness_Expect(written.load() == framePass.size(), "%zu frames queued, %u written", framePass.size(), written.load());
+    if(written.load() < frames) frames = written.load();
+
+    std::vector<long> latency;
+    double squares = 0;
+    for(unsigned int i = 0; i < frames; i++){
+        latency.push_back(Us(writeTime[i] - passStart[framePass[i]]));
+        if(0 == i) continue;
+        long interval = Us(writeTime[i] - writeTime[i - 1]);
+        long intended = Us(passStart[framePass[i]] - passStart[framePass[i - 1]]);
+        squares += (double)(interval - intended)*(interval - intended);
+    }
+    std::sort(latency.begin(), latency.end());
+    long p50 = latency[frames/2], p99 = latency[frames*99/100], worst = latency.back();
+    double rms = sqrt(squares/(frames - 1));
+    printf("%u frames in %d passes, latency p50 %ld us, p99 %ld us, max %ld us, interval jitter %.0f us rms\n", frames, JITTER_PASSES,
+           p50, p99, worst, rms);
+    Harness_Expect(p99 <= JITTER_LATENCY_P99, "p99 latency %ld us", p99);
+    Harness_Expect(rms <= JITTER_INTERVAL_RMS, "interval jitter %.0f us rms", rms);
+    return Harness_Result();
+}
@@ -0,0 +1,114 @@
+/************************************************************************************************************************************/
+/** @file       ramp_curves.cpp
+ *  @brief      every RAMP_CURVE_* moves monotonically, has its shape, and lands exactly on its target
+ *  @details    Each curve runs as an uploaded program: set the start point, ramp CCT and level up, hold, ramp them back
+ *              down, hold. Every loop() pass is sampled. Both channels may never move against the ramp direction, have
+ *              to sit exactly on the segment target once the ramp is over, and a quarter of the way in the level has to
+ *              be where the curve puts it (linear a quarter, smoothstep 0.156, exponential and perceptual well below).
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+
+#define CURVE_RAMP_TIME     8000UL
+#define CURVE_HOLD_TIME     1000UL
+#define CURVE_LOW_CCT       2000
+#define CURVE_HIGH_CCT      6000
+#define CURVE_LOW_LEVEL     10
+#define CURVE_HIGH_LEVEL    250
+#define CURVE_SHAPE_MARGIN  0.02    // of the level span, a quarter of the way in
+
+struct CurveCase {
+    const char* name;
+    int curve;
+    float quarterMin, quarterMax;   // level progress a quarter of the way into the rising ramp
+};
+
+static const CurveCase curves[] = {
+    { "linear",     RAMP_CURVE_LINEAR,      0.25,  0.25 },
+    { "ease",       RAMP_CURVE_EASE,        0.156, 0.156 },
+    { "exp",        RAMP_CURVE_EXP,         0,     0.15 },
+    { "perceptual", RAMP_CURVE_PERCEPTUAL,  0,     0.15 },
+};
+
+struct CurveSample {
+    unsigned long time;             // ms since the program was started
+    float cct, level;
+};
+
+static LampHarness lamp;
+static std::vector<CurveSample> samples;
+static unsigned long programStart;
+
+static void Sample(void){
+    CurveSample sample = { millis() - programStart, aCtrl.currentCCT, aCtrl.currentLevel };
+    samples.push_back(sample);
+}
+
+// direction +1 or -1 over [from, to) ms, TRUE if neither channel ever stepped back
+static bool Monotonic(unsigned long from, unsigned long to, int direction, const char* name){
+    bool monotonic = TRUE;
+    for(size_t i = 1; i < samples.size(); i++){
+        if((samples[i - 1].time < from) || (samples[i].time >= to)) continue;
+        if(((samples[i].cct - samples[i - 1].cct)*direction < 0) || ((samples[i].level - samples[i - 1].level)*direction < 0)){
+            monotonic = Harness_Expect(FALSE, "%s: stepped back at %lu ms, CCT %.1f -> %.1f, level %.2f -> %.2f", name, samples[i].time,
+                                       samples[i - 1].cct, samples[i].cct, samples[i - 1].level, samples[i].level);
+            break;
+        }
+    }
+    return monotonic;
+}
+
+static const CurveSample* Sample_At(unsigned long time){
+    for(size_t i = 0; i < samples.size(); i++){
+        if(samples[i].time >= time) return &samples[i];
+    }
+    return &samples.back();
+}
+
+int main(){
+    lamp.Boot(1767643200L, TRUE); // Monday 2026-01-05 12:00 Pacific
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,1"), "PWR,1");
+    lamp.Run_For(5000);
+    lamp.afterPass = Sample;
+
+    unsigned long riseStart = CURVE_HOLD_TIME, riseEnd = riseStart + CURVE_RAMP_TIME;
+    unsigned long fallStart = riseEnd + CURVE_HOLD_TIME, fallEnd = fallStart + CURVE_RAMP_TIME;
+    for(unsigned int c = 0; c < sizeof(curves)/sizeof(curves[0]); c++){
+        const CurveCase* test = &curves[c];
+        uint8_t flags = SEG_CURVE(test->curve);
+        const LampSegment program[] = {
+            { CURVE_LOW_CCT,  CURVE_LOW_LEVEL,  flags, 0,               CURVE_HOLD_TIME, 0 },
+            { CURVE_HIGH_CCT, CURVE_HIGH_LEVEL, flags, CURVE_RAMP_TIME, CURVE_HOLD_TIME, 0 },
+            { CURVE_LOW_CCT,  CURVE_LOW_LEVEL,  flags, CURVE_RAMP_TIME, CURVE_HOLD_TIME, 0 },
+        };
+        Harness_Expect(lamp.Program_Upload(program, sizeof(program)/sizeof(program[0])), "%s: upload", test->name);
+        samples.clear();
+        programStart = millis();
+        Harness_Expect(200 == lamp.Cloud("arioDo", "PROG"), "%s: PROG", test->name);
+        lamp.Run_For(fallEnd + CURVE_HOLD_TIME/2);
+
+        Monotonic(riseStart/2, riseEnd + CURVE_HOLD_TIME/2, 1, test->name);
+        Monotonic(riseEnd + CURVE_HOLD_TIME/2, fallEnd + CURVE_HOLD_TIME/2, -1, test->name);
+        const CurveSample* top = Sample_At(riseEnd + CURVE_HOLD_TIME/2);
+        Harness_Expect((CURVE_HIGH_CCT == top->cct) && (CURVE_HIGH_LEVEL == top->level), "%s: rise ended at CCT %.2f level %.3f",
+                       test->name, top->cct, top->level);
+        const CurveSample* bottom = &samples.back();
+        Harness_Expect((CURVE_LOW_CCT == bottom->cct) && (CURVE_LOW_LEVEL == bottom->level), "%s: fall ended at CCT %.2f level %.3f",
+                       test->name, bottom->cct, bottom->level);
+        const CurveSample* quarter = Sample_At(riseStart + CURVE_RAMP_TIME/4);
+        float progress = (quarter->level - CURVE_LOW_LEVEL)/(CURVE_HIGH_LEVEL - CURVE_LOW_LEVEL);
+        Harness_Expect((progress >= test->quarterMin - CURVE_SHAPE_MARGIN) && (progress <= test->quarterMax + CURVE_SHAPE_MARGIN),
+                       "%s: a quarter of the way in the level is at %.3f of the span", test->name, progress);
+        printf("%-10s quarter way level %.3f of the span, landed on %.0fK %.0f and %.0fK %.0f\n", test->name, progress,
+               top->cct, top->level, bottom->cct, bottom->level);
+        lamp.afterPass = NULL;
+        lamp.Run_For(5000); // the program ends and the lamp returns to the schedule
+        lamp.afterPass = Sample;
+    }
+    return Harness_Result();
+}
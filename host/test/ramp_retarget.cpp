@@ -0,0 +1,127 @@
+/************************************************************************************************************************************/
+/** @file       ramp_retarget.cpp
+ *  @brief      bursts of app brightness commands blend into one ramp and settle in time
+ *  @details    Five "BRI,UP" taps 100 ms apart, commands that arrive between two loop() passes, and a reversal while the
+ *              lamp is still moving. Every pass is sampled. A retarget keeps the velocity of the running ramp, so the
+ *              step a pass makes right after a command may not differ from the one right before it by more than
+ *              RETARGET_JUMP. The level may never step against the direction it is heading in or pass the final target,
+ *              and it has to sit exactly on the target APP_ADJUST_FADE_TIME after the last command. Prints the settle
+ *              time of every burst.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+
+#define RETARGET_TAP_GAP    100UL   // ms between taps in a burst
+#define RETARGET_JUMP       0.5     // level LSB, change of the per pass step at a retarget
+#define RETARGET_START      20      // level every burst starts from
+
+struct RetargetSample {
+    unsigned long time;             // ms since the first command of the burst
+    float level;
+};
+
+static LampHarness lamp;
+static std::vector<RetargetSample> samples;
+static unsigned long burstStart;
+
+static void Sample(void){
+    RetargetSample sample = { millis() - burstStart, aCtrl.currentLevel };
+    samples.push_back(sample);
+}
+
+static void Settle_At(int level){
+    char command[16];
+    snprintf(command, sizeof(command), "BRI,%d", level);
+    Harness_Expect(200 == lamp.Cloud("arioDo", command), "%s", command);
+    lamp.Run_For(3000);
+}
+
+// index of the first sample at or after time
+static size_t Sample_Index(unsigned long time){
+    for(size_t i = 0; i < samples.size(); i++){
+        if(samples[i].time >= time) return i;
+    }
+    return samples.size() - 1;
+}
+
+// Checks the samples of one burst. A reversal command at turn (0 if none) sends the level back the way it came.
+static void Burst_Check(const char* name, float target, const unsigned long* commands, unsigned int count, unsigned long turn){
+    unsigned long last = commands[count - 1];
+    int direction = (target > samples[Sample_Index(turn)].level) ? 1 : -1; // after the turn
+    long settled = -1;
+    for(size_t i = 1; i < samples.size(); i++){
+        float step = samples[i].level - samples[i - 1].level;
+        bool turned = (0 == turn) || (samples[i].time > turn);
+        if(step*(turned ? direction : -direction) < 0){
+            Harness_Expect(FALSE, "%s: stepped back at %lu ms, %.3f -> %.3f", name, samples[i].time, samples[i - 1].level, samples[i].level);
+            break;
+        }
+        if(turned && ((samples[i].level - target)*direction > 0)){
+            Harness_Expect(FALSE, "%s: passed the target %.0f at %lu ms, %.3f", name, target, samples[i].time, samples[i].level);
+            break;
+        }
+        if((settled < 0) && (target == samples[i].level)) settled = samples[i].time;
+    }
+    for(unsigned int c = 1; c < count; c++){ // the first command starts from rest, every later one is a retarget
+        if(commands[c] == turn) continue;   // a reversal starts from rest on purpose
+        size_t i = Sample_Index(commands[c]);
+        if((i < 1) || (i + 1 >= samples.size())) continue;
+        float before = samples[i].level - samples[i - 1].level, after = samples[i + 1].level - samples[i].level;
+        Harness_Expect(fabs(after - before) <= RETARGET_JUMP, "%s: the step went from %.3f to %.3f at the command at %lu ms", name,
+                       before, after, commands[c]);
+    }
+    printf("%-10s settled on %.0f %ld ms after the first and %ld ms after the last command\n", name, target, settled, settled - (long)last);
+    Harness_Expect((settled >= 0) && (settled - last <= APP_ADJUST_FADE_TIME + lamp.activeStep), "%s: settled %ld ms after the last command",
+                   name, settled - (long)last);
+}
+
+int main(){
+    lamp.Boot(1767643200L, TRUE); // Monday 2026-01-05 12:00 Pacific
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,1"), "PWR,1");
+    lamp.Run_For(5000);
+
+    // five taps, each a step above where the previous one was heading: 20 -> 30 -> 40 -> 70 -> 100 -> 150
+    Settle_At(RETARGET_START);
+    const unsigned long taps[] = { 0, RETARGET_TAP_GAP, 2*RETARGET_TAP_GAP, 3*RETARGET_TAP_GAP, 4*RETARGET_TAP_GAP };
+    samples.clear();
+    burstStart = millis();
+    lamp.afterPass = Sample;
+    for(unsigned int i = 0; i < sizeof(taps)/sizeof(taps[0]); i++){
+        Harness_Expect(200 == lamp.Cloud("arioDo", "BRI,UP"), "BRI,UP");
+        lamp.Run_For(RETARGET_TAP_GAP);
+    }
+    lamp.Run_For(2000);
+    lamp.afterPass = NULL;
+    Burst_Check("taps", 150, taps, sizeof(taps)/sizeof(taps[0]), 0);
+
+    // three commands before the next pass, only the last one is driven
+    Settle_At(RETARGET_START);
+    const unsigned long together[] = { 0 };
+    samples.clear();
+    burstStart = millis();
+    lamp.afterPass = Sample;
+    Harness_Expect((200 == lamp.Cloud("arioDo", "BRI,5")) && (200 == lamp.Cloud("arioDo", "BRI,200")) &&
+                   (200 == lamp.Cloud("arioDo", "BRI,100")), "BRI,5 BRI,200 BRI,100");
+    lamp.Run_For(2000);
+    lamp.afterPass = NULL;
+    Burst_Check("coalesced", 100, together, 1, 0);
+
+    // up, and back down before it got there
+    Settle_At(RETARGET_START);
+    const unsigned long reversal[] = { 0, 2*RETARGET_TAP_GAP };
+    samples.clear();
+    burstStart = millis();
+    lamp.afterPass = Sample;
+    Harness_Expect(200 == lamp.Cloud("arioDo", "BRI,200"), "BRI,200");
+    lamp.Run_For(reversal[1]);
+    Harness_Expect(200 == lamp.Cloud("arioDo", "BRI,40"), "BRI,40");
+    lamp.Run_For(2000);
+    lamp.afterPass = NULL;
+    Burst_Check("reversal", 40, reversal, sizeof(reversal)/sizeof(reversal[0]), reversal[1]);
+    return Harness_Result();
+}
@@ -0,0 +1,99 @@
+/************************************************************************************************************************************/
+/** @file       ramp_timing.cpp
+ *  @brief      ramps finish on time and on target however often loop() runs
+ *  @details    A 10 s ramp and a half hour dawn segment run as uploaded programs while loop() is held up: on some passes
+ *              the clock jumps ahead by up to RAMP_STALL_MAX before loop() gets to run, and in a second round loop() only
+ *              runs every RAMP_COARSE_STEP. The ramp output comes from elapsed time, so the time from the first frame that
+ *              moves to the frame that lands on the target may only differ from the segment duration by one pass plus
+ *              one stall (and one step of the Q16 progress, 27 ms on a half hour), and that frame has to be exactly on
+ *              the target. A ramp that counts ticks instead overruns by about the time lost to the stalls.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+
+#define RAMP_STALL_CHANCE   50      // one pass in this many is held up
+#define RAMP_STALL_MIN      20UL    // ms
+#define RAMP_STALL_MAX      200UL   // ms
+#define RAMP_COARSE_STEP    250UL   // ms between loop() passes in the coarse round
+#define RAMP_LOW_CCT        2000
+#define RAMP_HIGH_CCT       6000
+#define RAMP_LOW_LEVEL      10
+#define RAMP_HIGH_LEVEL     250
+
+static LampHarness lamp;
+static uint32_t stallSeed = 1;
+static unsigned long stalled;       // ms lost to stalls in the current ramp
+static bool atStart;                // the first segment put the lamp on the low point
+static long firstMove, landed;      // ms since the program start, -1 until seen
+static unsigned long programStart;
+static float landedCCT, landedLevel;
+
+// Holds the loop up before some passes, the way a cloud reconnect or a long EEPROM write would
+static void Stall(void){
+    stallSeed = stallSeed*1103515245 + 12345;
+    if(0 != (stallSeed >> 16) % RAMP_STALL_CHANCE) return;
+    unsigned long ms = RAMP_STALL_MIN + (stallSeed >> 8) % (RAMP_STALL_MAX - RAMP_STALL_MIN + 1);
+    Host_Clock_Advance((uint64_t)ms*1000);
+    stalled += ms;
+}
+
+static void Observe(void){
+    long now = millis() - programStart;
+    if((RAMP_LOW_CCT == aCtrl.currentCCT) && (RAMP_LOW_LEVEL == aCtrl.currentLevel)) atStart = TRUE;
+    if(atStart && (firstMove < 0) && (aCtrl.currentLevel > RAMP_LOW_LEVEL)) firstMove = now;
+    if((landed < 0) && (firstMove >= 0) && !aCtrl.Ramp_State()){
+        landed = now;
+        landedCCT = aCtrl.currentCCT;
+        landedLevel = aCtrl.currentLevel;
+    }
+}
+
+// One ramp of duration ms from the low to the high point, tolerance is the longest time loop() may not run
+static void Ramp_Check(const char* name, unsigned long duration, unsigned long tolerance){
+    const LampSegment program[] = {
+        { RAMP_LOW_CCT,  RAMP_LOW_LEVEL,  SEG_CURVE(RAMP_CURVE_LINEAR), 0,        1000, 0 },
+        { RAMP_HIGH_CCT, RAMP_HIGH_LEVEL, SEG_CURVE(RAMP_CURVE_LINEAR), (uint32_t)duration, 1000, 0 },
+    };
+    Harness_Expect(lamp.Program_Upload(program, sizeof(program)/sizeof(program[0])), "%s: upload", name);
+    stalled = 0;
+    atStart = FALSE;
+    firstMove = landed = -1;
+    programStart = millis();
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PROG"), "%s: PROG", name);
+    lamp.Run_For(1000 + duration + 1000);
+
+    long took = landed - firstMove;
+    tolerance += duration/65536 + 1; // the first move waits for one step of Q16 progress
+    printf("%-12s %8lu ms ramp took %8ld ms with %6lu ms of stalls, landed on %.0fK %.0f\n", name, duration, took, stalled,
+           landedCCT, landedLevel);
+    Harness_Expect((firstMove >= 0) && (landed >= 0), "%s: the ramp did not run", name);
+    Harness_Expect(labs(took - (long)duration) <= (long)tolerance, "%s: took %ld ms for %lu ms", name, took, duration);
+    Harness_Expect((RAMP_HIGH_CCT == landedCCT) && (RAMP_HIGH_LEVEL == landedLevel), "%s: landed on CCT %.2f level %.3f", name,
+                   landedCCT, landedLevel);
+    lamp.Run_For(5000); // the program ends and the lamp returns to the schedule
+}
+
+int main(){
+    lamp.Boot(1767643200L, TRUE); // Monday 2026-01-05 12:00 Pacific
+    Harness_Expect(200 == lamp.Cloud("arioDo", "PWR,1"), "PWR,1");
+    lamp.Run_For(5000);
+    lamp.afterPass = Observe;
+
+    Ramp_Check("steady", 10000, lamp.activeStep);
+    Ramp_Check("steady dawn", HALF_HOUR, lamp.activeStep);
+
+    lamp.beforePass = Stall;
+    Ramp_Check("stalls", 10000, lamp.activeStep + RAMP_STALL_MAX);
+    Ramp_Check("stalls dawn", HALF_HOUR, lamp.activeStep + RAMP_STALL_MAX);
+    lamp.beforePass = NULL;
+
+    lamp.activeStep = RAMP_COARSE_STEP;
+    Ramp_Check("coarse", 10000, RAMP_COARSE_STEP);
+    Ramp_Check("coarse dawn", HALF_HOUR, RAMP_COARSE_STEP);
+    return Harness_Result();
+}
@@ -0,0 +1,123 @@
+/************************************************************************************************************************************/
+/** @file       week_sim.cpp
+ *  @brief      one week of lamp behavior on the virtual clock
+ *  @details    A user schedule of 24 points, the ambient light sensor following daylight, a 06:30 wake alarm and a 22:30
+ *              bedtime reminder on every day, and PIR turn on / auto-off with somebody in the room in the morning and the
+ *              evening. Checks every day that the wake alarm and the reminder ran, that the lamp went off on its own
+ *              once the room was empty, and that the evening output follows the uploaded schedule. Prints the wall time
+ *              and the number of loop() passes it took. Built once per product variant (week_sim_ario_nw, week_sim_ario_fw15).
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "harness.h"
+#include <chrono>
+
+#define WEEK_START          1767600000L // Monday 2026-01-05 00:00 Pacific Standard Time
+#define WEEK_DAYS           7
+#define WEEK_SIM_STEP       20UL        // ms while the lamp is moving, the ramps are evaluated from elapsed time anyway
+#define WEEK_SIM_BUDGET     30.0        // s of wall time for the whole week
+
+#define PIR_PULSE_PERIOD    300         // s between motion pulses while somebody is in the room
+#define PIR_PULSE_LENGTH    3           // s, long enough for the 1.6 s debounce
+
+// 24 point user schedule, uploaded the way the app does it
+static const char* scheduleUpload[][2] = {
+    { "cctUpload",   "1,180018001800180018002200300040005000550060006500" },
+    { "cctUpload",   "2,650065006500600055005000400035003000270022001800" },
+    { "levelUpload", "1,020020020020020040080150200230255255" },
+    { "levelUpload", "2,255255255255230200180160120080050030" },
+};
+#define SCHEDULE_LEVEL_0800 200     // points at 08:00 and 20:00
+#define SCHEDULE_CCT_2000   3000
+#define SCHEDULE_LEVEL_2000 120
+
+// somebody is in the room (local minute of day)
+static const int occupied[][2] = { { 6*60 + 45, 8*60 + 15 }, { 17*60 + 30, 22*60 + 50 } };
+
+static LampHarness lamp;
+
+static time_t Local(int day, int hour, int minute){
+    return WEEK_START + day*86400L + hour*3600L + minute*60L;
+}
+
+// Daylight on the sensor, 0 at night and up to 2400 at noon
+static float Daylight(float hour){
+    return ((hour > 7) && (hour < 17)) ? 2400*sin(M_PI*(hour - 7)/10) : 0;
+}
+
+// plus what the lamp itself adds, the inverse of the interference ALS_Routine takes off
+static int32_t Ambient(void){
+    float ambient = Daylight((Time.local() % 86400)/3600.0);
+    if(hostDevice.psoc[0]) ambient += 6.95 + 0.38*aCtrl.currentLevel - 0.00065*aCtrl.currentLevel*aCtrl.currentLevel;
+    return ambient;
+}
+
+static void Inputs(void){
+    hostDevice.pins[PIN_SENSOR_ALS] = Ambient();
+    int second = Time.local() % 86400;
+    bool motion = FALSE;
+    for(unsigned int i = 0; i < sizeof(occupied)/sizeof(occupied[0]); i++){
+        if((second >= occupied[i][0]*60) && (second < occupied[i][1]*60)) motion = (second % PIR_PULSE_PERIOD) < PIR_PULSE_LENGTH;
+    }
+    lamp.Pin_Set(PIN_SENSOR_PIR, motion);
+}
+
+// counted on every transition
+static unsigned long dawnSims, bedTimes, pirOns, pirOffs;
+static unsigned int lastMode;
+static bool lastOn;
+
+static void Observe(void){
+    if((MODE_DAWNSIM == aCtrl.operatingMode) && (MODE_DAWNSIM != lastMode)) dawnSims++;
+    if((MODE_BEDTIME == aCtrl.operatingMode) && (MODE_BEDTIME != lastMode)) bedTimes++;
+    if(aCtrl.lightIsOn && !lastOn && (MODE_DAWNSIM != aCtrl.operatingMode)) pirOns++; // nobody touches a button
+    if(!aCtrl.lightIsOn && lastOn && (MODE_BEDTIME != lastMode)) pirOffs++; // the reminder turns off by itself
+    lastMode = aCtrl.operatingMode;
+    lastOn = aCtrl.lightIsOn;
+}
+
+int main(){
+    lamp.Boot(Local(0, 0, 0), OFFLINE_MODE_AVAILABLE); // the NW lamp runs offline, FW15 is always connected
+    lamp.activeStep = WEEK_SIM_STEP;
+    for(unsigned int i = 0; i < sizeof(scheduleUpload)/sizeof(scheduleUpload[0]); i++){
+        Harness_Expect(200 == lamp.Cloud(scheduleUpload[i][0], scheduleUpload[i][1]), "%s %s", scheduleUpload[i][0], scheduleUpload[i][1]);
+    }
+    const char* settings[] = { "ZONE,16", "ALS,1,16", "PIR,1,1,020,0", "WAKE,1,1,0630,30", "WAKE,2,1,0630,30",
+                               "WAKE,3,1,0630,30", "WAKE,4,1,0630,30", "WAKE,5,1,0630,30", "WAKE,6,1,0630,30", "WAKE,7,1,0630,30",
+                               "BED,1,1,2230,10", "BED,2,1,2230,10", "BED,3,1,2230,10", "BED,4,1,2230,10",
+                               "BED,5,1,2230,10", "BED,6,1,2230,10", "BED,7,1,2230,10" };
+    for(unsigned int i = 0; i < sizeof(settings)/sizeof(settings[0]); i++){
+        Harness_Expect(200 == lamp.Cloud("arioSet", settings[i]), "arioSet %s", settings[i]);
+    }
+    lamp.beforePass = Inputs;
+    lamp.afterPass = Observe;
+
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+    for(int day = 0; day < WEEK_DAYS; day++){
+        unsigned long dayDawnSims = dawnSims, dayBedTimes = bedTimes, dayPirOffs = pirOffs;
+        lamp.Run_To(Local(day, 8, 0)); // after the dawn simulation, daylight dims the schedule (ALS sensitivity 16)
+        float alsLevel = SCHEDULE_LEVEL_0800 - Daylight(8)/ALS_SENSITIVITY_HIGH;
+        Harness_Expect(aCtrl.lightIsOn && (fabs(aCtrl.currentLevel - alsLevel) <= 3), "day %d 08:00 lamp on %d level %.1f, expected %.1f",
+                       day, aCtrl.lightIsOn, aCtrl.currentLevel, alsLevel);
+        lamp.Run_To(Local(day, 20, 0));
+        Harness_Expect(aCtrl.lightIsOn && (MODE_DEFAULT == aCtrl.operatingMode), "day %d 20:00 lamp on %d mode %u", day, aCtrl.lightIsOn, aCtrl.operatingMode);
+        Harness_Expect(fabs(aCtrl.currentCCT - SCHEDULE_CCT_2000) <= 50, "day %d 20:00 CCT %.0f", day, aCtrl.currentCCT);
+        Harness_Expect(fabs(aCtrl.currentLevel - SCHEDULE_LEVEL_2000) <= 3, "day %d 20:00 level %.1f", day, aCtrl.currentLevel);
+        lamp.Run_To(Local(day + 1, 0, 0));
+        Harness_Expect(!aCtrl.lightIsOn, "day %d lamp still on at midnight", day);
+        Harness_Expect(1 == dawnSims - dayDawnSims, "day %d %lu dawn simulations", day, dawnSims - dayDawnSims);
+        Harness_Expect(1 == bedTimes - dayBedTimes, "day %d %lu bedtime reminders", day, bedTimes - dayBedTimes);
+        Harness_Expect(2 == pirOffs - dayPirOffs, "day %d %lu PIR auto-offs", day, pirOffs - dayPirOffs);
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+    printf("simulated %d days in %.2f s: %lu loop passes (%.0f per s)\n", WEEK_DAYS, wall, lamp.passes, lamp.passes/wall);
+    printf("%lu dawn simulations, %lu bedtime reminders, %lu PIR turn ons, %lu PIR auto-offs\n", dawnSims, bedTimes, pirOns, pirOffs);
+    printf("PSoC %lu transactions, %lu bytes, EEPROM %lu writes\n", hostDevice.psocTransactions, hostDevice.psocBytes, hostDevice.eepromWrites);
+    Harness_Expect(wall < WEEK_SIM_BUDGET, "the week took %.2f s, budget %.0f s", wall, WEEK_SIM_BUDGET);
+    return Harness_Result();
+}
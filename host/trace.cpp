@@ -0,0 +1,129 @@
+/************************************************************************************************************************************/
+/** @file       trace.cpp
+ *  @brief      see trace.h
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#include "trace.h"
+#include "harness.h"
+
+bool Trace_Decode(const std::vector<uint8_t>& raw, std::vector<TraceFrame>* frames){
+    frames->clear();
+    unsigned long time = 0;
+    size_t i = 0;
+    while(i < raw.size()){
+        if(i + 4 > raw.size()) return FALSE;
+        TraceFrame frame;
+        time += raw[i] | (raw[i + 1] << 8);
+        frame.time = time;
+        frame.sub = raw[i + 2];
+        frame.length = raw[i + 3];
+        if((frame.sub + frame.length > HOST_PSOC_REGISTERS) || (i + 4 + frame.length > raw.size())) return FALSE;
+        memcpy(frame.data, &raw[i + 4], frame.length);
+        frames->push_back(frame);
+        i += 4 + frame.length;
+    }
+    return TRUE;
+}
+
+bool Trace_Load(const char* path, std::vector<uint8_t>* raw){
+    FILE* file = fopen(path, "rb");
+    if(NULL == file) return FALSE;
+    raw->clear();
+    uint8_t chunk[4096];
+    size_t count;
+    while((count = fread(chunk, 1, sizeof(chunk), file)) > 0) raw->insert(raw->end(), chunk, chunk + count);
+    fclose(file);
+    return TRUE;
+}
+
+bool Trace_Save(const char* path, const std::vector<uint8_t>& raw){
+    FILE* file = fopen(path, "wb");
+    if(NULL == file) return FALSE;
+    bool written = (fwrite(raw.data(), 1, raw.size(), file) == raw.size());
+    return (0 == fclose(file)) && written;
+}
+
+TraceTraffic Trace_Traffic(const std::vector<TraceFrame>& frames, unsigned long duration){
+    TraceTraffic traffic = { 0, 0, 0, 0 };
+    for(size_t i = 1; i < frames.size(); i++){ // the first record is the image at the start, not a write
+        if(0 == frames[i].length) continue; // gap
+        traffic.transactions++;
+        traffic.bytes += 1 + frames[i].length;
+    }
+    float minutes = (float)duration/ONE_MINUTE;
+    if(minutes > 0){
+        traffic.transactionsPerMinute = traffic.transactions/minutes;
+        traffic.bytesPerMinute = traffic.bytes/minutes;
+    }
+    return traffic;
+}
+
+// Time weighted average of every register over each window, and the on flag at the end of each window
+static void Trace_Windows(const std::vector<TraceFrame>& frames, unsigned long duration, std::vector<float>* average,
+                          std::vector<uint8_t>* onFlag){
+    uint8_t image[HOST_PSOC_REGISTERS];
+    memset(image, 0, sizeof(image));
+    unsigned long sum[HOST_PSOC_REGISTERS];
+    size_t next = 0;
+    for(unsigned long start = 0; start < duration; start += TRACE_WINDOW){
+        memset(sum, 0, sizeof(sum));
+        unsigned long end = (start + TRACE_WINDOW < duration) ? start + TRACE_WINDOW : duration;
+        for(unsigned long ms = start; ms < end; ms++){
+            while((next < frames.size()) && (frames[next].time <= ms)){
+                memcpy(&image[frames[next].sub], frames[next].data, frames[next].length);
+                next++;
+            }
+            for(int reg = 0; reg < HOST_PSOC_REGISTERS; reg++) sum[reg] += image[reg];
+        }
+        for(int reg = 0; reg < HOST_PSOC_REGISTERS; reg++) average[reg].push_back((float)sum[reg]/(end - start));
+        onFlag->push_back(image[0]);
+    }
+}
+
+bool Trace_Compare(const char* name, const std::vector<uint8_t>& golden, const std::vector<uint8_t>& actual, unsigned long duration){
+    std::vector<TraceFrame> goldenFrames, actualFrames;
+    if(!Harness_Expect(Trace_Decode(golden, &goldenFrames), "%s: golden trace is malformed", name)) return FALSE;
+    if(!Harness_Expect(Trace_Decode(actual, &actualFrames), "%s: captured trace is malformed", name)) return FALSE;
+
+    std::vector<float> goldenAverage[HOST_PSOC_REGISTERS], actualAverage[HOST_PSOC_REGISTERS];
+    std::vector<uint8_t> goldenOn, actualOn;
+    Trace_Windows(goldenFrames, duration, goldenAverage, &goldenOn);
+    Trace_Windows(actualFrames, duration, actualAverage, &actualOn);
+
+    bool match = TRUE;
+    int reported = 0;
+    for(size_t w = 0; w < goldenOn.size(); w++){
+        bool edge = ((w > 0) && (goldenOn[w - 1] != goldenOn[w])) || ((w + 1 < goldenOn.size()) && (goldenOn[w + 1] != goldenOn[w]));
+        if((goldenOn[w] != actualOn[w]) && !edge){
+            match = FALSE;
+            if(reported++ < TRACE_REPORT_LIMIT) Harness_Expect(FALSE, "%s: on flag %u at %lu ms, golden %u", name, actualOn[w], w*TRACE_WINDOW, goldenOn[w]);
+        }
+    }
+    for(int reg = 1; reg < HOST_PSOC_REGISTERS; reg++){
+        reported = 0;
+        for(size_t w = 0; w < goldenAverage[reg].size(); w++){
+            if(fabs(goldenAverage[reg][w] - actualAverage[reg][w]) <= TRACE_LEVEL_TOLERANCE) continue;
+            match = FALSE;
+            if(reported++ < TRACE_REPORT_LIMIT){
+                Harness_Expect(FALSE, "%s: register %d averages %.2f at %lu ms, golden %.2f", name, reg, actualAverage[reg][w],
+                               w*TRACE_WINDOW, goldenAverage[reg][w]);
+            }
+        }
+    }
+
+    TraceTraffic goldenTraffic = Trace_Traffic(goldenFrames, duration);
+    TraceTraffic actualTraffic = Trace_Traffic(actualFrames, duration);
+    printf("%s: %lu transactions, %lu bytes in %.1f s, %.0f transactions/min, %.0f bytes/min (golden %.0f, %.0f)\n", name,
+           actualTraffic.transactions, actualTraffic.bytes, duration/1000.0, actualTraffic.transactionsPerMinute,
+           actualTraffic.bytesPerMinute, goldenTraffic.transactionsPerMinute, goldenTraffic.bytesPerMinute);
+    match &= Harness_Expect(actualTraffic.transactions <= goldenTraffic.transactions*(1 + TRACE_TRAFFIC_TOLERANCE),
+                            "%s: %lu transactions, golden %lu", name, actualTraffic.transactions, goldenTraffic.transactions);
+    match &= Harness_Expect(actualTraffic.bytes <= goldenTraffic.bytes*(1 + TRACE_TRAFFIC_TOLERANCE),
+                            "%s: %lu bytes, golden %lu", name, actualTraffic.bytes, goldenTraffic.bytes);
+    return match;
+}
@@ -0,0 +1,49 @@
+/************************************************************************************************************************************/
+/** @file       trace.h
+ *  @brief      PSoC write traces: decode, golden files and the tolerant compare
+ *  @details    A trace is the record stream of the firmware's I2C trace (dt ms, sub address, length, data), starting with
+ *              the register image at the start of the capture (Host_Trace_Start). Two traces are compared as register
+ *              timelines rather than byte for byte: each LED register is averaged over TRACE_WINDOW, so a dither pattern
+ *              or a ramp step that moved by a tick still matches as long as the light it makes is within
+ *              TRACE_LEVEL_TOLERANCE. The on flag has to match exactly, except within a window of a golden edge.
+ *
+ *              Bus traffic is the trace without its first record and the empty gap records, per minute of the capture. A
+ *              capture may use at most TRACE_TRAFFIC_TOLERANCE more transactions or bytes than its golden trace.
+ *
+ *  @section    Legal Disclaimer
+ *          All contents of this source file and/or any other Ario, Inc. related source files are the explicit property of
+ *          Ario, Inc. Do not distribute. Do not copy.
+ */
+/************************************************************************************************************************************/
+
+#ifndef trace_h
+#define trace_h
+
+#include "application.h"
+#include <vector>
+
+#define TRACE_WINDOW            100UL   // ms
+#define TRACE_LEVEL_TOLERANCE   1.5     // LED register LSB, average over a window
+#define TRACE_TRAFFIC_TOLERANCE 0.10    // share of the golden traffic a capture may add
+#define TRACE_REPORT_LIMIT      5       // mismatching windows printed per register
+
+struct TraceFrame {
+    unsigned long time;                 // ms since the start of the capture
+    uint8_t sub, length;
+    uint8_t data[HOST_PSOC_REGISTERS];
+};
+
+struct TraceTraffic {
+    unsigned long transactions, bytes;
+    float transactionsPerMinute, bytesPerMinute;
+};
+
+bool Trace_Decode(const std::vector<uint8_t>& raw, std::vector<TraceFrame>* frames);
+bool Trace_Load(const char* path, std::vector<uint8_t>* raw);
+bool Trace_Save(const char* path, const std::vector<uint8_t>& raw);
+TraceTraffic Trace_Traffic(const std::vector<TraceFrame>& frames, unsigned long duration);
+
+// Counts a Harness_Expect failure for every difference beyond the tolerances, TRUE if there was none
+bool Trace_Compare(const char* name, const std::vector<uint8_t>& golden, const std::vector<uint8_t>& actual, unsigned long duration);
+
+#endif
@@ -0,0 +1,70 @@
+# Generates the FW15 base lamp project (FW15_base_src_4da94031) from the shared source in ArioLamp_0-2-6-15nw.
+# The Particle cloud compiler only uploads the project directory, so FW15 holds full copies instead of includes of the other
+# project. The copies differ in three ways: the sketch is named Ario_protoG.ino, globals.h defaults ARIO_VARIANT to
+# ARIO_VARIANT_FW15, and every source starts with a line that says it was generated. Edit ArioLamp_0-2-6-15nw, then:
+#
+#   cmake -P tools/generate_fw15.cmake              rewrites FW15_base_src_4da94031
+#   cmake -DCHECK=ON -P tools/generate_fw15.cmake   fails if FW15_base_src_4da94031 is out of date (the fw15_in_sync test)
+
+get_filename_component(root "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+set(source_dir "${root}/ArioLamp_0-2-6-15nw")
+set(target_dir "${root}/FW15_base_src_4da94031")
+set(source_sketch ariolamp-0-2-6-15nw.ino)
+set(target_sketch Ario_protoG.ino)
+set(variant_default "#define ARIO_VARIANT            ARIO_VARIANT_NW")
+set(variant_fw15    "#define ARIO_VARIANT            ARIO_VARIANT_FW15")
+
+file(GLOB sources RELATIVE "${source_dir}" "${source_dir}/*.h" "${source_dir}/*.cpp" "${source_dir}/*.ino" "${source_dir}/project.properties")
+set(expected "")
+set(stale "")
+foreach(name ${sources})
+    file(READ "${source_dir}/${name}" content)
+    set(output "${name}")
+    if(name STREQUAL source_sketch)
+        set(output "${target_sketch}")
+    endif()
+    if(name STREQUAL "globals.h")
+        string(FIND "${content}" "${variant_default}" at)
+        if(at EQUAL -1)
+            message(FATAL_ERROR "globals.h: no \"${variant_default}\" line to switch to the FW15 variant")
+        endif()
+        string(REPLACE "${variant_default}" "${variant_fw15}" content "${content}")
+    endif()
+    if(NOT name STREQUAL "project.properties")
+        set(content "// Generated from ArioLamp_0-2-6-15nw/${name} by tools/generate_fw15.cmake, do not edit\n${content}")
+    endif()
+    list(APPEND expected "${output}")
+
+    set(current "")
+    if(EXISTS "${target_dir}/${output}")
+        file(READ "${target_dir}/${output}" current)
+    endif()
+    if(NOT current STREQUAL content)
+        list(APPEND stale "${output}")
+        if(NOT CHECK)
+            file(WRITE "${target_dir}/${output}" "${content}")
+        endif()
+    endif()
+endforeach()
+
+# files the shared source no longer has
+file(GLOB existing RELATIVE "${target_dir}" "${target_dir}/*")
+foreach(name ${existing})
+    list(FIND expected "${name}" at)
+    if(at EQUAL -1)
+        list(APPEND stale "${name}")
+        if(NOT CHECK)
+            file(REMOVE "${target_dir}/${name}")
+        endif()
+    endif()
+endforeach()
+
+if(CHECK AND stale)
+    string(REPLACE ";" ", " stale "${stale}")
+    message(FATAL_ERROR "FW15_base_src_4da94031 is out of date (${stale}), run cmake -P tools/generate_fw15.cmake")
+elseif(stale)
+    string(REPLACE ";" ", " stale "${stale}")
+    message(STATUS "FW15_base_src_4da94031: updated ${stale}")
+else()
+    message(STATUS "FW15_base_src_4da94031 is up to date")
+endif()
@@ -0,0 +1,56 @@
+# Per-variant size check of the host build. Sums text, data and bss of one variant's firmware library (the project sources
+# without the harness) and fails if any of them grew more than 10% past the budget recorded in variant_size.txt. The host
+# compiler makes bigger code than arm-none-eabi, so the numbers only catch growth; the Photon size itself is the size summary
+# of "particle compile photon <project>". After a change that is meant to grow a variant, record the new budget with:
+#
+#   cmake -DUPDATE=ON -DVARIANT=<ario_nw|ario_fw15> -DLIBRARY=<build>/lib<variant>_firmware.a -DSIZE=size -P tools/variant_size.cmake
+
+set(budget_file "${CMAKE_CURRENT_LIST_DIR}/variant_size.txt")
+set(tolerance 10) # percent
+
+execute_process(COMMAND "${SIZE}" -t "${LIBRARY}" OUTPUT_VARIABLE report RESULT_VARIABLE failed)
+if(failed)
+    message(FATAL_ERROR "${SIZE} -t ${LIBRARY} failed")
+endif()
+if(NOT report MATCHES "\n[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)[ \t]+[0-9]+[ \t]+[0-9a-f]+[ \t]+\\(TOTALS\\)")
+    message(FATAL_ERROR "no totals in the size report of ${LIBRARY}")
+endif()
+set(size_text ${CMAKE_MATCH_1})
+set(size_data ${CMAKE_MATCH_2})
+set(size_bss  ${CMAKE_MATCH_3})
+
+file(STRINGS "${budget_file}" lines)
+set(budget "")
+set(kept "")
+foreach(line ${lines})
+    if(line MATCHES "^${VARIANT} +([0-9]+) +([0-9]+) +([0-9]+)$")
+        set(budget ${CMAKE_MATCH_1} ${CMAKE_MATCH_2} ${CMAKE_MATCH_3})
+    else()
+        string(APPEND kept "${line}\n")
+    endif()
+endforeach()
+
+if(UPDATE)
+    file(WRITE "${budget_file}" "${kept}${VARIANT} ${size_text} ${size_data} ${size_bss}\n")
+    message(STATUS "${VARIANT}: budget set to text ${size_text} data ${size_data} bss ${size_bss}")
+    return()
+endif()
+if(NOT budget)
+    message(FATAL_ERROR "${VARIANT}: no budget in ${budget_file}")
+endif()
+
+list(GET budget 0 budget_text)
+list(GET budget 1 budget_data)
+list(GET budget 2 budget_bss)
+message(STATUS "${VARIANT}: text ${size_text} data ${size_data} bss ${size_bss} (budget ${budget_text} ${budget_data} ${budget_bss})")
+set(over "")
+foreach(section text data bss)
+    math(EXPR limit "${budget_${section}} + ${budget_${section}}*${tolerance}/100")
+    if(size_${section} GREATER limit)
+        list(APPEND over "${section} ${size_${section}} > ${limit}")
+    endif()
+endforeach()
+if(over)
+    string(REPLACE ";" ", " over "${over}")
+    message(FATAL_ERROR "${VARIANT} grew more than ${tolerance}% past its budget: ${over}")
+endif()